@@ -0,0 +1,184 @@
+#ifndef _IA_AUGMENTED_TREE_H_
+#define _IA_AUGMENTED_TREE_H_
+
+#include <cstddef>
+#include "FError.h"
+#include "ThreadPolicy.h"
+#include "CheckPolicy.h"
+#include "NodeAllocator.h"
+#include "BinaryTree.h"
+#include "Traversal.h"
+
+namespace dstruct
+{
+	/* A binary tree whose nodes know the size and height of their subtree.
+		The ops keep both up to date in attach_node/detach_node, by walking from the changed
+		node up to the root, so anything built with them (construct_at_end, construct_balanced,
+		a hand-made tree) is augmented with no more work from the caller.
+
+		On top of the sizes, select() and rank() answer order statistics in one root-to-leaf
+		search, instead of a walk of the whole tree.  tree_depth() is the real height, so
+		child_order_tr allocates its stack once, at the right size.
+
+		The sizes are written outside the seqlock, so these trees are single-threaded. */
+
+	namespace aug_tree
+	{
+		using bin_tree_sample::ichild;
+		using bin_tree_sample::ilabel;
+		using bin_tree_sample::LABEL_INVALID;
+		using bin_tree_sample::LABEL_LEFT;
+		using bin_tree_sample::LABEL_RIGHT;
+		using bin_tree_sample::LABEL_PARENT;
+
+		template<typename ThreadPolicy = foundation::tp_single_thread>
+		struct node
+		{
+			using sequence_t = typename foundation::atomique<ThreadPolicy, unsigned long>::type;
+			long m_key;
+			node* m_edges[3];  // three -- left-child, right-child, parent
+			sequence_t m_sequence;
+			size_t m_size;  // nodes in the subtree, this one included
+			int m_height;  // a leaf is 1
+
+			node()
+				:m_key(0),
+				m_sequence(0),
+				m_size(1),
+				m_height(1)
+			{
+				m_edges[LABEL_LEFT] = m_edges[LABEL_RIGHT] = m_edges[LABEL_PARENT] = nullptr;
+			}
+		};
+
+		template<typename ThreadPolicy = foundation::tp_single_thread,
+			typename AllocPolicy = foundation::ap_heap,
+			typename Check = foundation::check_default>
+		struct ops : public bin_tree_sample::ops<ThreadPolicy, AllocPolicy, node<ThreadPolicy>, Check>
+		{
+			using base = bin_tree_sample::ops<ThreadPolicy, AllocPolicy, node<ThreadPolicy>, Check>;
+			using mnode = typename base::mnode;
+
+			static_assert(!ThreadPolicy::sm_concurrent, "augmented trees are single-threaded");
+
+			static inline int tree_depth(mnode* n) { return height(n); }
+
+			static inline size_t subtree_size(mnode* n) { return n ? n->m_size : 0; }
+			static inline int height(mnode* n) { return n ? n->m_height : 0; }
+
+			static inline void update(mnode* n)
+			{
+				mnode* l = n->m_edges[LABEL_LEFT];
+				mnode* r = n->m_edges[LABEL_RIGHT];
+				int hl = height(l);
+				int hr = height(r);
+				n->m_size = 1 + subtree_size(l) + subtree_size(r);
+				n->m_height = 1 + (hl > hr ? hl : hr);
+			}
+
+			// Every node from n to the root has a new subtree
+			static inline void update_up(mnode* n)
+			{
+				for (; n; n = n->m_edges[LABEL_PARENT]) {
+					update(n);
+				}
+			}
+
+			static inline mnode* detach_node(mnode* n, ilabel lbl)
+			{
+				mnode* p = lbl == LABEL_PARENT ? n->m_edges[LABEL_PARENT] : n;
+				mnode* r = base::detach_node(n, lbl);
+				update_up(p);
+				return r;
+			}
+
+			static inline void attach_node(mnode* to, ilabel lbl, mnode* n)
+			{
+				base::attach_node(to, lbl, n);
+				update_up(lbl == LABEL_PARENT ? n : to);
+			}
+		};
+
+		/* The k-th smallest key's node (k from 0), or null if the tree is smaller than that.
+			At each node the left subtree's size says which way k lies.  The amount to take off k
+			on going right is only taken off once the search has moved on, so the predicate may be
+			asked again about the same node. */
+		template<typename TO>
+		typename TO::mnode* select(typename TO::mnode* root, size_t k)
+		{
+			using mnode = typename TO::mnode;
+
+			if (k >= TO::subtree_size(root)) {
+				return nullptr;
+			}
+
+			size_t pending = 0;
+			int at_depth = -1;
+			auto condition = [&](mnode* bn, int depth) -> ilabel
+			{
+				if (depth != at_depth) {
+					k -= pending;
+					pending = 0;
+					at_depth = depth;
+				}
+
+				size_t left = TO::subtree_size(bn->m_edges[LABEL_LEFT]);
+				if (k < left) {
+					return LABEL_LEFT;
+				}
+				if (k == left) {
+					return LABEL_INVALID;  // here
+				}
+				pending = left + 1;
+				return LABEL_RIGHT;
+			};
+
+			ttraversal::linear_tr<decltype(condition), TO> trav(root, condition);
+			while (trav.next());
+			return trav.node();
+		}
+
+		// The number of keys less than key: where key is, or would go, in sorted order
+		template<typename TO>
+		size_t rank(typename TO::mnode* root, long key)
+		{
+			using mnode = typename TO::mnode;
+
+			size_t below = 0;
+			size_t pending = 0;
+			int at_depth = -1;
+			auto condition = [&](mnode* bn, int depth) -> ilabel
+			{
+				if (depth != at_depth) {
+					below += pending;
+					pending = 0;
+					at_depth = depth;
+				}
+
+				if (TO::get_key(bn) < key) {
+					pending = TO::subtree_size(bn->m_edges[LABEL_LEFT]) + 1;  // all of these are below key
+					return LABEL_RIGHT;
+				}
+				return LABEL_LEFT;
+			};
+
+			ttraversal::linear_tr<decltype(condition), TO> trav(root, condition);
+			while (trav.next());
+			return below + pending;
+		}
+
+		// The node at quantile q (0 the smallest key, 1 the largest), or null for an empty tree
+		template<typename TO>
+		typename TO::mnode* quantile(typename TO::mnode* root, double q)
+		{
+			size_t n = TO::subtree_size(root);
+			if (n == 0) {
+				return nullptr;
+			}
+			q = q < 0.0 ? 0.0 : (q > 1.0 ? 1.0 : q);
+			return select<TO>(root, (size_t)(q * (double)(n - 1) + 0.5));
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,174 @@
+#ifndef _IA_BALANCED_TREE_H_
+#define _IA_BALANCED_TREE_H_
+
+#include "FError.h"
+#include "ThreadPolicy.h"
+#include "NodeAllocator.h"
+#include "BinaryTree.h"
+#include "Traversal.h"
+#include "Construction.h"
+
+namespace dstruct
+{
+	/* An AVL tree on top of the binary tree ops.  The node carries its height, the ops add
+	   rotations built from detach_node/attach_node, and insert() restores the balance on the way
+	   back up from the new leaf.  Everything else (searching with linear_tr, walking with
+	   child_order_tr, printing) is the plain binary tree's.
+
+	   It is single-threaded: one writer and no readers alongside it.  The edges are plain
+	   pointers and a rotation is several attach/detach calls with no write section around
+	   them, so tp_multi_thread is refused at compile time. */
+
+	namespace avl_tree
+	{
+		using bin_tree_sample::ichild;
+		using bin_tree_sample::ilabel;
+		using bin_tree_sample::LABEL_INVALID;
+		using bin_tree_sample::LABEL_LEFT;
+		using bin_tree_sample::LABEL_RIGHT;
+		using bin_tree_sample::LABEL_PARENT;
+
+		template<typename ThreadPolicy = foundation::tp_single_thread>
+		struct node
+		{
+			using sequence_t = typename foundation::atomique<ThreadPolicy, unsigned long>::type;
+			long m_key;
+			node* m_edges[3];  // three -- left-child, right-child, parent
+			sequence_t m_sequence;
+			int m_height;  // a leaf is 1
+
+			node()
+				:m_key(0),
+				m_sequence(0),
+				m_height(1)
+			{
+				m_edges[LABEL_LEFT] = m_edges[LABEL_RIGHT] = m_edges[LABEL_PARENT] = nullptr;
+			}
+		};
+
+		template<typename ThreadPolicy = foundation::tp_single_thread,
+			typename AllocPolicy = foundation::ap_heap,
+			typename Check = foundation::check_default>
+		struct ops : public bin_tree_sample::ops<ThreadPolicy, AllocPolicy, node<ThreadPolicy>, Check>
+		{
+			using base = bin_tree_sample::ops<ThreadPolicy, AllocPolicy, node<ThreadPolicy>, Check>;
+			using mnode = typename base::mnode;
+
+			static_assert(!ThreadPolicy::sm_concurrent, "AVL trees are single-threaded");
+
+			// The height is known, so traversers can size their stacks up front
+			static inline int tree_depth(mnode* n) { return n ? n->m_height : 0; }
+
+			static inline int height(mnode* n) { return n ? n->m_height : 0; }
+
+			static inline int balance(mnode* n)
+			{
+				return height(n->m_edges[LABEL_LEFT]) - height(n->m_edges[LABEL_RIGHT]);
+			}
+
+			static inline void update_height(mnode* n)
+			{
+				int hl = height(n->m_edges[LABEL_LEFT]);
+				int hr = height(n->m_edges[LABEL_RIGHT]);
+				n->m_height = 1 + (hl > hr ? hl : hr);
+			}
+
+			/* Rotate n down towards lbl: rotating towards LABEL_LEFT lifts the right child into n's place.
+			   The subtree keeps its parent; if n was the root, root now points at the new top.
+			   Returns the new top of the subtree. */
+			static mnode* rotate(mnode* n, ilabel lbl, mnode*& root)
+			{
+				ilabel up_lbl = lbl == LABEL_LEFT ? LABEL_RIGHT : LABEL_LEFT;  // the side that comes up
+				mnode* c = n->m_edges[up_lbl];
+				if (Check::sm_strict && c == nullptr) {
+					throw foundation::foundation_exception("nothing to rotate up", "avl_tree::ops::rotate");
+				}
+				mnode* p = n->m_edges[LABEL_PARENT];
+				ilabel p_lbl = LABEL_INVALID;
+				if (p) {
+					p_lbl = p->m_edges[LABEL_LEFT] == n ? LABEL_LEFT : LABEL_RIGHT;
+					base::detach_node(n, LABEL_PARENT);
+				}
+
+				// c's inner subtree changes sides
+				base::detach_node(n, up_lbl);
+				mnode* inner = c->m_edges[lbl];
+				if (inner) {
+					base::detach_node(c, lbl);
+					base::attach_node(n, up_lbl, inner);
+				}
+				base::attach_node(c, lbl, n);
+
+				if (p) {
+					base::attach_node(p, p_lbl, c);
+				}
+				else {
+					root = c;
+				}
+
+				update_height(n);
+				update_height(c);
+				return c;
+			}
+
+			static inline mnode* rotate_left(mnode* n, mnode*& root) { return rotate(n, LABEL_LEFT, root); }
+			static inline mnode* rotate_right(mnode* n, mnode*& root) { return rotate(n, LABEL_RIGHT, root); }
+
+			// Fix heights and balance from n up to the root
+			static void rebalance_up(mnode* n, mnode*& root)
+			{
+				while (n)
+				{
+					int old_height = n->m_height;
+					update_height(n);
+
+					int bal = balance(n);
+					if (bal > 1) {
+						if (balance(n->m_edges[LABEL_LEFT]) < 0) {
+							rotate_left(n->m_edges[LABEL_LEFT], root);
+						}
+						n = rotate_right(n, root);
+					}
+					else if (bal < -1) {
+						if (balance(n->m_edges[LABEL_RIGHT]) > 0) {
+							rotate_right(n->m_edges[LABEL_RIGHT], root);
+						}
+						n = rotate_left(n, root);
+					}
+					else if (n->m_height == old_height) {
+						break;  // nothing above can change
+					}
+
+					n = n->m_edges[LABEL_PARENT];
+				}
+			}
+		};
+
+		// Insert a key as a BST would (ties go left), then rebalance.  Returns the new node.
+		template<typename TO>
+		typename TO::mnode* insert(long key, typename TO::mnode*& root)
+		{
+			using mnode = typename TO::mnode;
+
+			auto condition = [&](mnode* bn, int depth) -> ilabel
+			{
+				return key <= bn->m_key ? LABEL_LEFT : LABEL_RIGHT;
+			};
+
+			mnode* new_node = nullptr;
+			auto initializer = [&](mnode* n)
+			{
+				n->m_key = key;
+				new_node = n;
+			};
+
+			using l_tr = ttraversal::linear_tr<decltype(condition), TO>;
+			tconstruction::construct_at_end<l_tr>(root, initializer, condition);
+
+			TO::rebalance_up(new_node->m_edges[LABEL_PARENT], root);
+			return new_node;
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef _IA_BATCH_TRAVERSAL_H_
+#define _IA_BATCH_TRAVERSAL_H_
+
+#include <cstddef>
+#include "FError.h"
+#include "Traversal.h"
+
+namespace dstruct
+{
+	namespace ttraversal
+	{
+		/* Many linear_tr searches at once.
+			A lone search is a chain of cache misses: the next node is not known until the current
+			one has been read.  Here up to Width searches are in flight, each one a small state
+			machine (the node it is at, its depth, its predicate).  They take turns a step at a
+			time, and a search that moves to a node prefetches it and makes way for the others,
+			so by the time its turn comes round the node has had Width - 1 steps to arrive.
+			When a search ends, the next one in the batch takes its place.
+
+			The predicates are DirPreds, as for linear_tr: called with a node and its depth, they
+			return the label to follow, or sm_invalid_lbl to stop there. */
+
+		// Where a search ended, as linear_tr would have left it
+		template<typename TO>
+		struct search_end
+		{
+			typename TO::node_handle m_node;  // the last node reached; null only in an empty tree
+			typename TO::node_label m_arrow;  // sm_invalid_lbl: the predicate stopped here.  Otherwise the empty child it asked for
+			int m_depth;
+
+			bool stopped() const { return m_arrow == TO::sm_invalid_lbl; }
+		};
+
+		/* Run the search *it from root for every it in [first, last), Width at a time, and store
+			where the i-th one ended in out[i].  PredIt is a random access iterator. */
+		template<typename TO, int Width = 8, typename PredIt>
+		void linear_search_batch(typename TO::node_handle root, PredIt first, PredIt last, search_end<TO>* out)
+		{
+			using node_handle = typename TO::node_handle;
+			using node_label = typename TO::node_label;
+
+			static_assert(Width > 0, "linear_search_batch -- at least one search in flight");
+
+			struct lane
+			{
+				PredIt m_pred;
+				node_handle m_node;
+				int m_depth;
+				size_t m_slot;  // in out
+			};
+
+			const size_t count = (size_t)(last - first);
+			if (TO::is_null(root)) {
+				for (size_t i = 0; i < count; ++i) {
+					out[i].m_node = root;
+					out[i].m_arrow = TO::sm_invalid_lbl;
+					out[i].m_depth = -1;
+				}
+				return;
+			}
+
+			size_t started = 0;
+			auto start = [&](lane& l)
+			{
+				l.m_pred = first + started;
+				l.m_node = root;
+				l.m_depth = 0;
+				l.m_slot = started++;
+			};
+
+			lane lanes[Width];
+			int active = 0;
+			for (; active < Width && started < count; ++active) {
+				start(lanes[active]);
+			}
+
+			while (active > 0) {
+				for (int i = 0; i < active; ) {
+					lane& l = lanes[i];
+
+					// One step, read as linear_tr reads it
+					node_label arrow;
+					node_handle nx;
+					typename TO::sequence s;
+					do {
+						s = TO::read_begin(l.m_node);
+						arrow = (*l.m_pred)(l.m_node, l.m_depth);
+						nx = arrow != TO::sm_invalid_lbl ? TO::get_node_labeled(l.m_node, arrow) : node_handle(nullptr);
+					} while (!TO::read_validate(l.m_node, s));
+
+					if (!TO::is_null(nx)) {
+						TO::prefetch_node(nx);
+						l.m_node = nx;
+						l.m_depth++;
+						++i;
+						continue;
+					}
+
+					search_end<TO>& e = out[l.m_slot];
+					e.m_node = l.m_node;
+					e.m_arrow = arrow;
+					e.m_depth = l.m_depth;
+
+					if (started < count) {
+						start(l);
+						++i;
+					}
+					else {
+						l = lanes[--active];  // the last lane moves here, and takes its step now
+					}
+				}
+			}
+		}
+	}
+}
+
+#endif
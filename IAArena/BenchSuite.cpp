@@ -0,0 +1,469 @@
+// BenchSuite.cpp : the benchmark suite, a program of its own that reports in JSON.
+//
+//	ia_bench [--sizes 1e3,1e4,...] [--dists random,sorted,zipfian,reverse]
+//		[--benches construct_at_end,add_to_bst,...] [--out file.json] [--max-degenerate n]
+//
+// Every bench runs at every size and key distribution asked for:
+//	random		keys 0..n-1 inserted in random order, looked up in another random order
+//	sorted		inserted in increasing order, so the BST is one long chain
+//	reverse		inserted in decreasing order, the same chain the other way
+//	zipfian		inserted as random; looked up by Zipf-distributed rank (theta 0.99), so a few keys take
+//				most of the lookups
+// The chains make building quadratic, so sorted and reverse are skipped above --max-degenerate keys.
+// zipfian builds and walks the same tree as random, so only its lookups are run; the rest are reported
+// as skipped.  peak_rss_kb is the resident set's high-water mark over one bench, from the mark reset
+// before it (so it includes the tree the bench is given); it is left out where the mark cannot be reset.
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include "BenchUtils.h"
+#include "BinaryTree.h"
+#include "Construction.h"
+#include "IOUtils.h"
+#include "LispIO.h"
+#include "Traversal.h"
+#include "TreeUtils.h"
+
+namespace
+{
+	using namespace dstruct::bin_tree_sample;
+	using ops_t = ops<foundation::tp_single_thread, foundation::ap_heap>;
+	using node_handle = ops_t::node_handle;
+
+	// An ostream that counts what it is given and keeps none of it, so the printers are timed without the I/O
+	class null_buffer : public std::streambuf
+	{
+	public:
+		null_buffer() :m_bytes(0) { }
+		size_t bytes() const { return m_bytes; }
+	protected:
+		int_type overflow(int_type c) override
+		{
+			m_bytes++;
+			return traits_type::not_eof(c);
+		}
+
+		std::streamsize xsputn(const char*, std::streamsize n) override
+		{
+			m_bytes += (size_t)n;
+			return n;
+		}
+	private:
+		size_t m_bytes;
+	};
+
+	struct settings
+	{
+		std::vector<size_t> m_sizes;
+		std::vector<std::string> m_dists;
+		std::vector<std::string> m_benches;
+		std::string m_out;
+		size_t m_max_degenerate;
+	};
+
+	struct result
+	{
+		std::string m_bench;
+		std::string m_dist;
+		size_t m_n;
+		size_t m_ops;  // operations timed: inserts, lookups or nodes
+		double m_ms;
+		size_t m_bytes;  // of text, for the printers
+		size_t m_peak_kb;  // 0 if it could not be had for this bench alone
+		const char* m_skipped;  // why the bench was not run, or null
+	};
+
+	std::vector<std::string> split(const char* list)
+	{
+		std::vector<std::string> out;
+		std::string cur;
+		for (const char* p = list; ; ++p) {
+			if (*p == ',' || *p == '\0') {
+				if (!cur.empty()) {
+					out.push_back(cur);
+				}
+				cur.clear();
+				if (*p == '\0') {
+					break;
+				}
+			}
+			else {
+				cur += *p;
+			}
+		}
+		return out;
+	}
+
+	bool contains(const std::vector<std::string>& v, const char* s)
+	{
+		for (const std::string& x : v) {
+			if (x == s) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// The keys to insert and the keys to look up, for one distribution
+	void make_workload(const std::string& dist, size_t n, std::vector<long>& inserts, std::vector<long>& probes)
+	{
+		bench::key_order order = dist == "sorted" ? bench::KEYS_SORTED
+			: (dist == "reverse" ? bench::KEYS_REVERSE : bench::KEYS_RANDOM);
+		inserts = bench::make_keys(n, order);
+
+		if (dist == "zipfian") {
+			// Scatter the popular ranks over the key space, or they would all be down one side of the tree
+			bench::zipf_generator zipf(n);
+			probes.resize(n);
+			for (long& k : probes) {
+				k = (long)(((unsigned long long)zipf.next() * 0x9e3779b97f4a7c15ULL) % n);
+			}
+		}
+		else {
+			probes = bench::make_keys(n, bench::KEYS_RANDOM, 54321);
+		}
+	}
+
+	node_handle build_construct_at_end(const std::vector<long>& keys)
+	{
+		node_handle root = nullptr;
+		for (long k : keys) {
+			auto condition = [&](node_handle bn, int) -> ilabel
+			{
+				return k <= bn->m_key ? LABEL_LEFT : LABEL_RIGHT;
+			};
+
+			auto initializer = [&](node_handle nn)
+			{
+				nn->m_key = k;
+			};
+
+			using l_tr = dstruct::ttraversal::linear_tr<decltype(condition), ops_t>;
+			dstruct::tconstruction::construct_at_end<l_tr>(root, initializer, condition);
+		}
+		return root;
+	}
+
+	node_handle build_add_to_bst(const std::vector<long>& keys)
+	{
+		node_handle root = nullptr;
+		node_handle added = nullptr;
+		for (long k : keys) {
+			add_to_bst<foundation::tp_single_thread>(k, root, added);
+		}
+		return root;
+	}
+
+	size_t lookup(node_handle root, const std::vector<long>& probes)
+	{
+		size_t found = 0;
+		for (long k : probes) {
+			auto condition = [&](node_handle bn, int) -> ilabel
+			{
+				return k == bn->m_key ? LABEL_INVALID : (k < bn->m_key ? LABEL_LEFT : LABEL_RIGHT);
+			};
+
+			dstruct::ttraversal::linear_tr<decltype(condition), ops_t> trav(root, condition);
+			while (trav.next());
+			found += trav.node() != nullptr && trav.node()->m_key == k;
+		}
+		return found;
+	}
+
+	long walk(node_handle root)
+	{
+		dstruct::ttraversal::child_order_tr<ops_t> trav(root);
+		long sum = 0;
+		while (trav.depth() >= 0) {
+			if (ops_t::is_index_pre(trav.node(0), trav.location(0))) {
+				sum += trav.node(0)->m_key;
+			}
+			trav.next();
+		}
+		return sum;
+	}
+
+	// Small trees are built again and again, so that each measurement is long enough to mean something
+	size_t repeats_for(size_t n)
+	{
+		size_t r = 1000000 / (n > 0 ? n : 1);
+		return r < 1 ? 1 : (r > 1000 ? 1000 : r);
+	}
+
+	void run_one(const settings& s, const std::string& dist, size_t n, std::vector<result>& results)
+	{
+		// Each bench starts the peak resident set again, so its peak is its own
+		bool peak_reset = false;
+		auto start = [&]()
+		{
+			peak_reset = bench::reset_peak_resident();
+		};
+
+		auto record = [&](const char* name, size_t ops, double ms, size_t bytes)
+		{
+			result r;
+			r.m_bench = name;
+			r.m_dist = dist;
+			r.m_n = n;
+			r.m_ops = ops;
+			r.m_ms = ms;
+			r.m_bytes = bytes;
+			r.m_peak_kb = peak_reset ? bench::peak_resident_kb() : 0;
+			r.m_skipped = nullptr;
+			results.push_back(r);
+			std::cerr << name << " " << dist << " n=" << n << ": " << (ops ? ms * 1e6 / (double)ops : 0.0) << " ns/op" << std::endl;
+		};
+
+		auto skip = [&](const std::string& name, const char* why)
+		{
+			result r;
+			r.m_bench = name;
+			r.m_dist = dist;
+			r.m_n = n;
+			r.m_ops = 0;
+			r.m_ms = 0.0;
+			r.m_bytes = 0;
+			r.m_peak_kb = 0;
+			r.m_skipped = why;
+			results.push_back(r);
+		};
+
+		bool degenerate = dist == "sorted" || dist == "reverse";
+		if (degenerate && n > s.m_max_degenerate) {
+			for (const std::string& b : s.m_benches) {
+				skip(b, "degenerate tree");
+			}
+			return;
+		}
+
+		// Only the lookups differ from random
+		const bool probes_only = dist == "zipfian";
+		if (probes_only) {
+			for (const std::string& b : s.m_benches) {
+				if (b != "lookup") {
+					skip(b, "same as random");
+				}
+			}
+		}
+		auto wants = [&](const char* name)
+		{
+			return contains(s.m_benches, name) && (!probes_only || strcmp(name, "lookup") == 0);
+		};
+
+		std::vector<long> inserts, probes;
+		make_workload(dist, n, inserts, probes);
+		const size_t reps = degenerate ? 1 : repeats_for(n);
+
+		if (wants("add_to_bst")) {
+			start();
+			double ms = 0.0;
+			for (size_t i = 0; i < reps; i++) {
+				bench::stopwatch sw;
+				node_handle root = build_add_to_bst(inserts);
+				ms += sw.elapsed_ms();
+				dstruct::tree_utils::destroy_tree<ops_t>(root);
+			}
+			record("add_to_bst", n * reps, ms, 0);
+		}
+
+		// The rest share one tree, built with construct_at_end
+		const size_t build_reps = wants("construct_at_end") ? reps : 1;
+		start();
+		double build_ms = 0.0;
+		node_handle root = nullptr;
+		for (size_t i = 0; i < build_reps; i++) {
+			if (root) {
+				dstruct::tree_utils::destroy_tree<ops_t>(root);
+			}
+			bench::stopwatch sw;
+			root = build_construct_at_end(inserts);
+			build_ms += sw.elapsed_ms();
+		}
+		if (wants("construct_at_end")) {
+			record("construct_at_end", n * reps, build_ms, 0);
+		}
+
+		if (wants("lookup")) {
+			start();
+			bench::stopwatch sw;
+			size_t found = 0;
+			for (size_t i = 0; i < reps; i++) {
+				found += lookup(root, probes);
+			}
+			double ms = sw.elapsed_ms();
+			if (found != n * reps) {
+				std::cerr << "lookup " << dist << " n=" << n << ": found " << found << " of " << n * reps << std::endl;
+			}
+			record("lookup", n * reps, ms, 0);
+		}
+
+		if (wants("walk")) {
+			start();
+			bench::stopwatch sw;
+			long sum = 0;
+			for (size_t i = 0; i < reps; i++) {
+				sum += walk(root);
+			}
+			double ms = sw.elapsed_ms();
+			if (sum != (long)reps * (long)(n * (n - 1) / 2)) {
+				std::cerr << "walk " << dist << " n=" << n << ": wrong key sum" << std::endl;
+			}
+			record("walk", n * reps, ms, 0);
+		}
+
+		if (wants("print_tree_view")) {
+			null_buffer nb;
+			std::ostream os(&nb);
+			start();
+			bench::stopwatch sw;
+			for (size_t i = 0; i < reps; i++) {
+				print::tree::print_tree_view<ops_t>(os, root);
+			}
+			record("print_tree_view", n * reps, sw.elapsed_ms(), nb.bytes());
+		}
+
+		if (wants("print_lisp_tree")) {
+			null_buffer nb;
+			std::ostream os(&nb);
+			start();
+			bench::stopwatch sw;
+			for (size_t i = 0; i < reps; i++) {
+				print::tree::print_lisp_tree<ops_t>(os, root);
+			}
+			record("print_lisp_tree", n * reps, sw.elapsed_ms(), nb.bytes());
+		}
+
+		if (wants("write_lisp_tree")) {
+			null_buffer nb;
+			std::ostream os(&nb);
+			start();
+			bench::stopwatch sw;
+			for (size_t i = 0; i < reps; i++) {
+				print::tree::text_buffer out(os);
+				print::tree::write_lisp_tree<ops_t>(out, root);
+			}
+			record("write_lisp_tree", n * reps, sw.elapsed_ms(), nb.bytes());
+		}
+
+		dstruct::tree_utils::destroy_tree<ops_t>(root);
+	}
+
+	void write_json(std::ostream& os, const std::vector<result>& results)
+	{
+		os << "{\n  \"suite\": \"ia_bench\",\n  \"format\": 1,\n";
+#if defined(__AVX2__)
+		os << "  \"avx2\": true,\n";
+#else
+		os << "  \"avx2\": false,\n";
+#endif
+		os << "  \"results\": [";
+		for (size_t i = 0; i < results.size(); i++) {
+			const result& r = results[i];
+			os << (i ? ",\n" : "\n") << "    {\"bench\": \"" << r.m_bench << "\", \"dist\": \"" << r.m_dist
+				<< "\", \"n\": " << r.m_n;
+			if (r.m_skipped) {
+				os << ", \"skipped\": \"" << r.m_skipped << "\"}";
+				continue;
+			}
+			double ns_per_op = r.m_ops ? r.m_ms * 1e6 / (double)r.m_ops : 0.0;
+			double per_sec = r.m_ms > 0.0 ? (double)r.m_ops / r.m_ms * 1000.0 : 0.0;
+			os << ", \"ops\": " << r.m_ops
+				<< ", \"ms\": " << r.m_ms
+				<< ", \"ns_per_op\": " << ns_per_op
+				<< ", \"nodes_per_sec\": " << (unsigned long long)per_sec;
+			if (r.m_bytes) {
+				os << ", \"bytes\": " << r.m_bytes;
+			}
+			if (r.m_peak_kb) {
+				os << ", \"peak_rss_kb\": " << r.m_peak_kb;
+			}
+			os << "}";
+		}
+		os << "\n  ]\n}\n";
+	}
+
+	void usage()
+	{
+		std::cerr << "ia_bench [--sizes 1e3,1e4,...] [--dists random,sorted,zipfian,reverse]\n"
+			<< "\t[--benches construct_at_end,add_to_bst,lookup,walk,print_tree_view,print_lisp_tree,write_lisp_tree]\n"
+			<< "\t[--out file.json] [--max-degenerate n]" << std::endl;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	settings s;
+	s.m_sizes = {1000, 10000, 100000, 1000000};
+	s.m_dists = {"random", "sorted", "zipfian", "reverse"};
+	s.m_benches = {"construct_at_end", "add_to_bst", "lookup", "walk", "print_tree_view", "print_lisp_tree", "write_lisp_tree"};
+	s.m_max_degenerate = 20000;
+
+	for (int i = 1; i < argc; i++) {
+		bool has_value = i + 1 < argc;
+		if (strcmp(argv[i], "--sizes") == 0 && has_value) {
+			s.m_sizes.clear();
+			for (const std::string& v : split(argv[++i])) {
+				size_t n = (size_t)strtod(v.c_str(), nullptr);  // 1e6 as well as 1000000
+				if (n > 0) {
+					s.m_sizes.push_back(n);
+				}
+			}
+		}
+		else if (strcmp(argv[i], "--dists") == 0 && has_value) {
+			s.m_dists = split(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--benches") == 0 && has_value) {
+			s.m_benches = split(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--out") == 0 && has_value) {
+			s.m_out = argv[++i];
+		}
+		else if (strcmp(argv[i], "--max-degenerate") == 0 && has_value) {
+			s.m_max_degenerate = (size_t)strtod(argv[++i], nullptr);
+		}
+		else {
+			usage();
+			return 1;
+		}
+	}
+
+	for (const std::string& d : s.m_dists) {
+		if (d != "random" && d != "sorted" && d != "zipfian" && d != "reverse") {
+			std::cerr << "Unknown distribution " << d << std::endl;
+			return 1;
+		}
+	}
+	for (const std::string& b : s.m_benches) {
+		if (b != "construct_at_end" && b != "add_to_bst" && b != "lookup" && b != "walk"
+			&& b != "print_tree_view" && b != "print_lisp_tree" && b != "write_lisp_tree") {
+			std::cerr << "Unknown bench " << b << std::endl;
+			return 1;
+		}
+	}
+
+	std::vector<result> results;
+	for (size_t n : s.m_sizes) {
+		for (const std::string& d : s.m_dists) {
+			run_one(s, d, n, results);
+		}
+	}
+
+	if (s.m_out.empty()) {
+		write_json(std::cout, results);
+	}
+	else {
+		std::ofstream f(s.m_out.c_str());
+		write_json(f, results);
+		if (!f) {
+			std::cerr << "Cannot write " << s.m_out << std::endl;
+			return 1;
+		}
+	}
+	return 0;
+}
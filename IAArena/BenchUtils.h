@@ -0,0 +1,205 @@
+#ifndef _IA_BENCH_UTILS_H_
+#define _IA_BENCH_UTILS_H_
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+namespace bench
+{
+	// Wall-clock timing for benchmark phases
+	class stopwatch
+	{
+	public:
+		stopwatch() { restart(); }
+
+		void restart() { m_start = std::chrono::steady_clock::now(); }
+
+		double elapsed_ms() const
+		{
+			return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_start).count();
+		}
+	private:
+		std::chrono::steady_clock::time_point m_start;
+	};
+
+	// Current resident set size in kilobytes, or 0 where we cannot tell
+	inline size_t resident_kb()
+	{
+#if defined(_WIN32)
+		PROCESS_MEMORY_COUNTERS pmc;
+		if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+			return pmc.WorkingSetSize / 1024;
+		}
+		return 0;
+#elif defined(__linux__)
+		size_t pages_total = 0, pages_resident = 0;
+		FILE* f = fopen("/proc/self/statm", "r");
+		if (f == nullptr) {
+			return 0;
+		}
+		if (fscanf(f, "%zu %zu", &pages_total, &pages_resident) != 2) {
+			pages_resident = 0;
+		}
+		fclose(f);
+		return pages_resident * 4;  // 4K pages
+#else
+		return 0;
+#endif
+	}
+
+	/* Starts the resident set's high-water mark again from where the resident set is now, so
+		peak_resident_kb() covers what runs after it.  Only Linux can (since 4.0, by writing 5 to
+		/proc/self/clear_refs); elsewhere it returns false and the peak is the process's. */
+	inline bool reset_peak_resident()
+	{
+#if defined(__linux__)
+#if defined(__GLIBC__)
+		malloc_trim(0);  // give back what earlier runs freed, or the mark starts from it
+#endif
+		FILE* f = fopen("/proc/self/clear_refs", "w");
+		if (f == nullptr) {
+			return false;
+		}
+		bool done = fputs("5", f) >= 0;
+		done = fclose(f) == 0 && done;
+		return done;
+#else
+		return false;
+#endif
+	}
+
+	// The most the resident set has been since the last reset, in kilobytes, or 0 where we cannot tell
+	inline size_t peak_resident_kb()
+	{
+#if defined(_WIN32)
+		PROCESS_MEMORY_COUNTERS pmc;
+		if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+			return pmc.PeakWorkingSetSize / 1024;
+		}
+		return 0;
+#else
+#if defined(__linux__)
+		// VmHWM, as ru_maxrss is never reset
+		FILE* f = fopen("/proc/self/status", "r");
+		if (f != nullptr) {
+			char line[128];
+			size_t kb = 0;
+			bool found = false;
+			while (!found && fgets(line, sizeof(line), f) != nullptr) {
+				found = sscanf(line, "VmHWM: %zu kB", &kb) == 1;
+			}
+			fclose(f);
+			if (found) {
+				return kb;
+			}
+		}
+#endif
+		struct rusage ru;
+		if (getrusage(RUSAGE_SELF, &ru) != 0) {
+			return 0;
+		}
+#if defined(__APPLE__)
+		return (size_t)ru.ru_maxrss / 1024;  // bytes there
+#else
+		return (size_t)ru.ru_maxrss;
+#endif
+#endif
+	}
+
+	enum key_order {
+		KEYS_RANDOM,
+		KEYS_SORTED,
+		KEYS_REVERSE
+	};
+
+	// Keys 0..n-1 in the given order
+	inline std::vector<long> make_keys(size_t n, key_order order, unsigned int seed = 12345)
+	{
+		std::vector<long> keys(n);
+		for (size_t i = 0; i < n; i++) {
+			keys[i] = (long)i;
+		}
+
+		if (order == KEYS_RANDOM) {
+			std::mt19937 gen(seed);
+			std::shuffle(keys.begin(), keys.end(), gen);
+		}
+		else if (order == KEYS_REVERSE) {
+			std::reverse(keys.begin(), keys.end());
+		}
+		return keys;
+	}
+
+	/* Ranks 0..n-1 drawn with P(r) proportional to 1 / (r + 1)^theta, theta < 1, after Gray et al.,
+		"Quickly generating billion-record synthetic databases".  Rank 0 is the most popular. */
+	class zipf_generator
+	{
+	public:
+		zipf_generator(size_t n, double theta = 0.99, unsigned int seed = 12345)
+			:m_n(n > 1 ? n : 2),
+			m_gen(seed),
+			m_uniform(0.0, 1.0)
+		{
+			m_zetan = zeta(m_n, theta);
+			m_zeta2 = 1.0 + std::pow(0.5, theta);
+			m_alpha = 1.0 / (1.0 - theta);
+			m_eta = (1.0 - std::pow(2.0 / (double)m_n, 1.0 - theta)) / (1.0 - m_zeta2 / m_zetan);
+		}
+
+		size_t next()
+		{
+			double u = m_uniform(m_gen);
+			double uz = u * m_zetan;
+			if (uz < 1.0) {
+				return 0;
+			}
+			if (uz < m_zeta2) {
+				return 1;
+			}
+			size_t r = (size_t)((double)m_n * std::pow(m_eta * u - m_eta + 1.0, m_alpha));
+			return r < m_n ? r : m_n - 1;
+		}
+
+		// The sum of 1 / i^theta for i = 1..n: exactly for the first million terms, the rest by its integral
+		static double zeta(size_t n, double theta)
+		{
+			const size_t exact = n < 1000000 ? n : 1000000;
+			double sum = 0.0;
+			for (size_t i = 1; i <= exact; i++) {
+				sum += 1.0 / std::pow((double)i, theta);
+			}
+			if (n > exact) {
+				double a = (double)exact + 0.5;
+				double b = (double)n + 0.5;
+				sum += (std::pow(b, 1.0 - theta) - std::pow(a, 1.0 - theta)) / (1.0 - theta);
+			}
+			return sum;
+		}
+	private:
+		size_t m_n;
+		double m_zetan;
+		double m_zeta2;
+		double m_alpha;
+		double m_eta;
+		std::mt19937_64 m_gen;
+		std::uniform_real_distribution<double> m_uniform;
+	};
+}
+
+#endif
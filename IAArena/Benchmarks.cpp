@@ -0,0 +1,1745 @@
+#include <atomic>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include "BenchUtils.h"
+#include "Benchmarks.h"
+#include "BalancedTree.h"
+#include "BatchTraversal.h"
+#include "AugmentedTree.h"
+#include "BinaryTree.h"
+#include "CompactTree.h"
+#include "Complexity.h"
+#include "Construction.h"
+#include "FrozenTree.h"
+#include "LispIO.h"
+#include "ParallelTraversal.h"
+#include "PerfCounters.h"
+#include "Snapshot.h"
+#include "TAnalyticsUtils.h"
+#include "TraversalRange.h"
+#include "TreeUtils.h"
+#include "WideTree.h"
+
+namespace
+{
+	using namespace dstruct::bin_tree_sample;
+
+	// Build a BST the way bst_test does: one construct_at_end per key
+	template<typename TO, typename Instr = foundation::instrument_none>
+	typename TO::node_handle build_bst(const std::vector<long>& keys)
+	{
+		using node_handle = typename TO::node_handle;
+
+		node_handle root = nullptr;
+		for (long k : keys) {
+			auto condition = [&](node_handle bn, int depth) -> ilabel
+			{
+				return k <= TO::get_key(bn) ? LABEL_LEFT : LABEL_RIGHT;
+			};
+
+			auto initializer = [&](node_handle n)
+			{
+				TO::set_key(n, k);
+			};
+
+			using l_tr = dstruct::ttraversal::linear_tr<decltype(condition), TO, Instr>;
+			dstruct::tconstruction::construct_at_end<l_tr>(root, initializer, condition);
+		}
+		return root;
+	}
+
+	// Search for every key with a linear_tr; returns how many were found
+	template<typename TO, typename Instr = foundation::instrument_none>
+	size_t lookup_all(typename TO::node_handle root, const std::vector<long>& keys)
+	{
+		using node_handle = typename TO::node_handle;
+
+		size_t found = 0;
+		for (long k : keys) {
+			auto condition = [&](node_handle bn, int depth) -> ilabel
+			{
+				long nk = TO::get_key(bn);
+				return k == nk ? LABEL_INVALID : (k < nk ? LABEL_LEFT : LABEL_RIGHT);
+			};
+
+			dstruct::ttraversal::linear_tr<decltype(condition), TO, Instr> trav(root, condition);
+			while (trav.next());
+
+			if (!TO::is_null(trav.node()) && TO::get_key(trav.node()) == k) {
+				found++;
+			}
+		}
+		return found;
+	}
+
+	// lookup_all, counting into dimension 0 each step of a search and into 1 each key found
+	template<typename TO, typename Counter>
+	size_t counted_lookups(typename TO::node_handle root, const std::vector<long>& keys, Counter& counter)
+	{
+		using node_handle = typename TO::node_handle;
+
+		size_t found = 0;
+		for (long k : keys) {
+			auto condition = [&](node_handle bn, int depth) -> ilabel
+			{
+				counter.add_to_counter(1, 0);
+				long nk = TO::get_key(bn);
+				return k == nk ? LABEL_INVALID : (k < nk ? LABEL_LEFT : LABEL_RIGHT);
+			};
+
+			dstruct::ttraversal::linear_tr<decltype(condition), TO> trav(root, condition);
+			while (trav.next());
+
+			if (!TO::is_null(trav.node()) && TO::get_key(trav.node()) == k) {
+				counter.add_to_counter(1, 1);
+				found++;
+			}
+		}
+		return found;
+	}
+
+	// A recursion of (hi - lo) calls, split in halves, that profiles itself into b if there is one
+	template<typename Builder>
+	long profiled_sum(Builder* b, long lo, long hi)
+	{
+		if (b) {
+			b->push();
+			b->add_to_counter(1);
+		}
+		long sum = lo;
+		long mid = lo + (hi - lo) / 2;
+		if (lo + 1 < hi) {
+			sum += profiled_sum(b, lo + 1, mid + 1);
+			if (mid + 1 < hi) {
+				sum += profiled_sum(b, mid + 1, hi);
+			}
+		}
+		if (b) {
+			b->pop();
+		}
+		return sum;
+	}
+
+	// A node with key k, attached under lbl of parent if there is one
+	template<typename TO>
+	typename TO::node_handle add_node(typename TO::node_handle parent, typename TO::node_label lbl, long k)
+	{
+		typename TO::node_handle n = TO::create_free_node();
+		TO::set_key(n, k);
+		if (!TO::is_null(parent)) {
+			TO::attach_node(parent, lbl, n);
+		}
+		return n;
+	}
+
+	// Write a tree as LISP text, read it back and write that: true if both texts are the same
+	template<typename TO>
+	bool lisp_round_trips(typename TO::node_handle root)
+	{
+		std::ostringstream first, second;
+		{
+			print::tree::text_buffer out(first);
+			print::tree::write_lisp_tree<TO>(out, root);
+		}
+		std::istringstream in(first.str());
+		typename TO::node_handle back = print::tree::read_lisp_tree<TO>(in);
+		{
+			print::tree::text_buffer out(second);
+			print::tree::write_lisp_tree<TO>(out, back);
+		}
+		dstruct::tree_utils::destroy_tree<TO>(back);
+		return first.str() == second.str();
+	}
+
+	// Hardware counts per operation for one region, or why there are none
+	void report_perf(const char* label, const foundation::perf_group& group, const foundation::acounter<foundation::PERF_KINDS>& counts, size_t ops, double ms)
+	{
+		std::cout << label << ": " << ms * 1e6 / (double)ops << " ns/op";
+		if (group.available()) {
+			for (int k = 0; k < foundation::PERF_KINDS; k++) {
+				foundation::perf_kind kind = (foundation::perf_kind)k;
+				if (group.has(kind)) {
+					std::cout << ", " << (double)counts.get_counter(k) / (double)ops << " " << foundation::perf_group::kind_name(kind);
+				}
+			}
+		}
+		std::cout << std::endl;
+	}
+
+	// A DirPred looking for one key in a BST, for the batched searches
+	template<typename TO>
+	struct bst_probe
+	{
+		long m_key;
+
+		ilabel operator()(typename TO::node_handle bn, int) const
+		{
+			long nk = TO::get_key(bn);
+			return m_key == nk ? LABEL_INVALID : (m_key < nk ? LABEL_LEFT : LABEL_RIGHT);
+		}
+	};
+
+	// Search for every key, Width searches at a time; returns how many were found
+	template<typename TO, int Width>
+	size_t lookup_batch(typename TO::node_handle root, const std::vector<bst_probe<TO> >& probes)
+	{
+		std::vector<dstruct::ttraversal::search_end<TO> > ends(probes.size());
+		dstruct::ttraversal::linear_search_batch<TO, Width>(root, probes.begin(), probes.end(), ends.data());
+
+		size_t found = 0;
+		for (const auto& e : ends) {
+			found += e.stopped() && !TO::is_null(e.m_node);
+		}
+		return found;
+	}
+
+	// Height of a tree, by walking it with child_order_tr
+	template<typename TO>
+	int tree_height(typename TO::node_handle root)
+	{
+		dstruct::ttraversal::child_order_tr<TO> trav(root);
+		int height = 0;
+		bool proceed = trav.depth() >= 0;
+		while (proceed) {
+			height = std::max(height, trav.depth() + 1);
+			proceed = trav.next();
+		}
+		return height;
+	}
+
+	// Walk a whole tree with traverser Tr; returns the sum of the keys, so the walk is not optimised away
+	template<typename TO, typename Tr>
+	long walk_sum(typename TO::node_handle root)
+	{
+		Tr trav(root);
+		long sum = 0;
+		bool proceed = trav.depth() >= 0;
+		while (proceed) {
+			if (TO::is_index_pre(trav.node(0), trav.location(0))) {
+				sum += TO::get_key(trav.node(0));
+			}
+			proceed = trav.next();
+		}
+		return sum;
+	}
+
+	/* Walk a tree with two traversers in step: true if they make the same events, the same
+		(node, location, depth) at every step, and end together.  An empty tree has no events. */
+	template<typename TO, typename TrA, typename TrB>
+	bool same_events(typename TO::node_handle root)
+	{
+		TrA a(root);
+		TrB b(root);
+		if (TO::is_null(root)) {
+			return a.is_trivial() && b.is_trivial() && !a.next() && !b.next();
+		}
+
+		bool more_a = a.depth() >= 0;
+		bool more_b = b.depth() >= 0;
+		while (more_a && more_b) {
+			if (a.node(0) != b.node(0) || a.location(0) != b.location(0) || a.depth() != b.depth()) {
+				return false;
+			}
+			more_a = a.next();
+			more_b = b.next();
+		}
+		return more_a == more_b && a.depth() == b.depth();
+	}
+
+	// Walk a tree with each traverser under one check policy, and report nodes per second
+	template<typename TO>
+	void walk_with_checks(const char* label, typename TO::node_handle root, size_t n)
+	{
+		using namespace dstruct::ttraversal;
+
+		auto rate = [n](double ms) { return (size_t)(n / ms * 1000.0); };
+
+		bench::stopwatch sw;
+		long sum = walk_sum<TO, child_order_tr<TO> >(root);
+		double child_ms = sw.elapsed_ms();
+
+		sw.restart();
+		sum -= walk_sum<TO, parent_order_tr<TO> >(root);
+		double parent_ms = sw.elapsed_ms();
+
+		sw.restart();
+		level_order_tr<TO> levels(root);
+		bool proceed = levels.depth() >= 0;
+		while (proceed) {
+			sum += TO::get_key(levels.node());
+			proceed = levels.next();
+		}
+		double level_ms = sw.elapsed_ms();
+
+		sw.restart();
+		for (typename TO::node_handle nn : preorder_range<TO>(root)) {
+			sum -= TO::get_key(nn);
+		}
+		double range_ms = sw.elapsed_ms();
+
+		std::cout << label << ": child_order_tr " << rate(child_ms) << " nodes/s"
+			<< ", parent_order_tr " << rate(parent_ms)
+			<< ", level_order_tr " << rate(level_ms)
+			<< ", preorder_range " << rate(range_ms)
+			<< (sum == 0 ? "" : " (SUM MISMATCH)") << std::endl;
+	}
+
+	void report(const char* label, double build_ms, double free_ms, size_t rss_before, size_t rss_after)
+	{
+		std::cout << label
+			<< ": build " << build_ms << " ms"
+			<< ", free " << free_ms << " ms"
+			<< ", rss +" << (rss_after > rss_before ? rss_after - rss_before : 0) << " KB"
+			<< std::endl;
+	}
+}
+
+void bench::bench_arena(size_t n)
+{
+	std::vector<long> keys = make_keys(n, KEYS_RANDOM);
+	std::cout << "bench_arena: " << n << " random keys" << std::endl;
+
+	// The arena goes first: its slabs go straight back to the OS when released,
+	// whereas the heap tends to keep what it freed.
+	{
+		using ops_t = ops<foundation::tp_single_thread, foundation::ap_arena>;
+
+		size_t rss_before = resident_kb();
+		foundation::node_arena<ops_t::mnode> arena;
+
+		stopwatch sw;
+		size_t rss_after = 0;
+		{
+			foundation::arena_scope<ops_t::mnode> scope(arena);
+			build_bst<ops_t>(keys);
+			rss_after = resident_kb();
+		}
+		double build_ms = sw.elapsed_ms();
+
+		sw.restart();
+		arena.release();  // the whole tree at once
+		double free_ms = sw.elapsed_ms();
+
+		report("arena", build_ms, free_ms, rss_before, rss_after);
+	}
+
+	{
+		using ops_t = ops<foundation::tp_single_thread, foundation::ap_heap>;
+
+		size_t rss_before = resident_kb();
+
+		stopwatch sw;
+		ops_t::node_handle root = build_bst<ops_t>(keys);
+		double build_ms = sw.elapsed_ms();
+		size_t rss_after = resident_kb();
+
+		sw.restart();
+		dstruct::tree_utils::destroy_tree<ops_t>(root);
+		double free_ms = sw.elapsed_ms();
+
+		report("heap", build_ms, free_ms, rss_before, rss_after);
+	}
+}
+
+void bench::bench_compact(size_t n)
+{
+	std::vector<long> keys = make_keys(n, KEYS_RANDOM);
+	std::vector<long> probes = make_keys(n, KEYS_RANDOM, 54321);
+	std::cout << "bench_compact: " << n << " random keys" << std::endl;
+
+	{
+		using ops_t = dstruct::compact_tree::ops<long>;
+
+		size_t rss_before = resident_kb();
+		ops_t::pool pool(n);
+		ops_t::binding bind(pool);
+
+		stopwatch sw;
+		ops_t::node_handle root = build_bst<ops_t>(keys);
+		double build_ms = sw.elapsed_ms();
+		size_t rss_after = resident_kb();
+
+		sw.restart();
+		size_t found = lookup_all<ops_t>(root, probes);
+		double lookup_ms = sw.elapsed_ms();
+
+		std::cout << "compact: " << sizeof(ops_t::mnode) << " bytes/node"
+			<< ", build " << build_ms << " ms"
+			<< ", lookup " << lookup_ms << " ms (" << found << " found)"
+			<< ", rss +" << (rss_after > rss_before ? rss_after - rss_before : 0) << " KB"
+			<< std::endl;
+	}
+
+	{
+		using ops_t = ops<foundation::tp_single_thread>;
+
+		size_t rss_before = resident_kb();
+
+		stopwatch sw;
+		ops_t::node_handle root = build_bst<ops_t>(keys);
+		double build_ms = sw.elapsed_ms();
+		size_t rss_after = resident_kb();
+
+		sw.restart();
+		size_t found = lookup_all<ops_t>(root, probes);
+		double lookup_ms = sw.elapsed_ms();
+
+		std::cout << "pointer: " << sizeof(ops_t::mnode) << " bytes/node"
+			<< ", build " << build_ms << " ms"
+			<< ", lookup " << lookup_ms << " ms (" << found << " found)"
+			<< ", rss +" << (rss_after > rss_before ? rss_after - rss_before : 0) << " KB"
+			<< std::endl;
+
+		dstruct::tree_utils::destroy_tree<ops_t>(root);
+	}
+}
+
+void bench::bench_bulk(size_t n)
+{
+	using ops_t = ops<foundation::tp_single_thread, foundation::ap_arena>;
+	using dstruct::tconstruction::construct_balanced;
+
+	std::cout << "bench_bulk: " << n << " keys" << std::endl;
+	auto set_key = [](ops_t::node_handle nn, long k) { ops_t::set_key(nn, k); };
+
+	const key_order orders[] = { KEYS_RANDOM, KEYS_SORTED };
+	const char* order_names[] = { "random", "sorted" };
+	for (int o = 0; o < 2; o++)
+	{
+		std::vector<long> keys = make_keys(n, orders[o]);
+		foundation::node_arena<ops_t::mnode> arena;
+
+		{
+			foundation::arena_scope<ops_t::mnode> scope(arena);
+			stopwatch sw;
+			construct_balanced<ops_t>(keys.begin(), keys.end(), set_key, dstruct::tconstruction::BULK_DFS);
+			std::cout << order_names[o] << " bulk dfs: " << sw.elapsed_ms() << " ms" << std::endl;
+		}
+		arena.release();
+
+		{
+			foundation::arena_scope<ops_t::mnode> scope(arena);
+			stopwatch sw;
+			construct_balanced<ops_t>(keys.begin(), keys.end(), set_key, dstruct::tconstruction::BULK_BFS);
+			std::cout << order_names[o] << " bulk bfs: " << sw.elapsed_ms() << " ms" << std::endl;
+		}
+		arena.release();
+
+		// Key by key is quadratic on sorted input; keep it to a size that finishes
+		size_t per_key_n = orders[o] == KEYS_SORTED ? std::min<size_t>(n, 20000) : n;
+		std::vector<long> per_key(keys.begin(), keys.begin() + per_key_n);
+		{
+			foundation::arena_scope<ops_t::mnode> scope(arena);
+			stopwatch sw;
+			build_bst<ops_t>(per_key);
+			std::cout << order_names[o] << " construct_at_end (" << per_key_n << " keys): "
+				<< sw.elapsed_ms() << " ms" << std::endl;
+		}
+		arena.release();
+	}
+}
+
+void bench::bench_balanced(size_t n)
+{
+	std::vector<long> keys = make_keys(n, KEYS_SORTED);
+	std::cout << "bench_balanced: " << n << " sorted keys" << std::endl;
+
+	{
+		using ops_t = dstruct::avl_tree::ops<foundation::tp_single_thread, foundation::ap_arena>;
+		foundation::node_arena<ops_t::mnode> arena;
+		foundation::arena_scope<ops_t::mnode> scope(arena);
+
+		stopwatch sw;
+		ops_t::mnode* root = nullptr;
+		for (long k : keys) {
+			dstruct::avl_tree::insert<ops_t>(k, root);
+		}
+		double build_ms = sw.elapsed_ms();
+
+		sw.restart();
+		size_t found = lookup_all<ops_t>(root, keys);
+		double lookup_ms = sw.elapsed_ms();
+
+		std::cout << "avl: build " << build_ms << " ms"
+			<< ", lookup " << lookup_ms << " ms (" << found << " found)"
+			<< ", height " << tree_height<ops_t>(root) << std::endl;
+	}
+
+	{
+		// The unbalanced tree degenerates into a list: keep it to a size that finishes
+		using ops_t = ops<foundation::tp_single_thread, foundation::ap_arena>;
+		size_t plain_n = std::min<size_t>(n, 20000);
+		std::vector<long> plain_keys(keys.begin(), keys.begin() + plain_n);
+
+		foundation::node_arena<ops_t::mnode> arena;
+		foundation::arena_scope<ops_t::mnode> scope(arena);
+
+		stopwatch sw;
+		ops_t::node_handle root = build_bst<ops_t>(plain_keys);
+		double build_ms = sw.elapsed_ms();
+
+		sw.restart();
+		size_t found = lookup_all<ops_t>(root, plain_keys);
+		double lookup_ms = sw.elapsed_ms();
+
+		std::cout << "plain (" << plain_n << " keys): build " << build_ms << " ms"
+			<< ", lookup " << lookup_ms << " ms (" << found << " found)"
+			<< ", height " << tree_height<ops_t>(root) << std::endl;
+	}
+}
+
+void bench::bench_concurrent(size_t n)
+{
+	using ops_t = ops<foundation::tp_multi_thread>;
+	using node_handle = ops_t::node_handle;
+
+	// Even keys go in up front; the writer adds odd ones while the readers search
+	std::vector<long> keys = make_keys(n, KEYS_SORTED);
+	for (long& k : keys) {
+		k *= 2;
+	}
+
+	auto set_key = [](node_handle nn, long k) { ops_t::set_key(nn, k); };
+	node_handle root = dstruct::tconstruction::construct_balanced<ops_t>(keys.begin(), keys.end(), set_key);
+
+	const double run_ms = 1000.0;
+	unsigned int max_readers = std::max(2u, std::thread::hardware_concurrency()) - 1;
+	std::cout << "bench_concurrent: " << n << " keys, " << run_ms << " ms per run" << std::endl;
+
+	long next_odd = 1;
+	for (unsigned int readers = 1; readers <= max_readers; readers *= 2)
+	{
+		for (int with_writer = 0; with_writer < 2; with_writer++)
+		{
+			std::atomic<bool> stop(false);
+			std::atomic<size_t> reads(0);
+			size_t writes = 0;
+
+			std::vector<std::thread> threads;
+			for (unsigned int r = 0; r < readers; r++) {
+				threads.emplace_back([&, r]() {
+					std::mt19937 gen(r + 1);
+					std::uniform_int_distribution<long> dist(0, (long)(2 * n));
+					size_t done = 0;
+					std::vector<long> batch(64);
+					while (!stop.load(std::memory_order_relaxed)) {
+						for (long& k : batch) {
+							k = dist(gen);
+						}
+						lookup_all<ops_t>(root, batch);
+						done += batch.size();
+					}
+					reads += done;
+				});
+			}
+
+			stopwatch sw;
+			if (with_writer) {
+				while (sw.elapsed_ms() < run_ms) {
+					long k = next_odd;
+					next_odd += 2;
+
+					auto condition = [&](node_handle bn, int depth) -> ilabel
+					{
+						return k <= ops_t::get_key(bn) ? LABEL_LEFT : LABEL_RIGHT;
+					};
+					auto initializer = [&](node_handle nn) { ops_t::set_key(nn, k); };
+
+					using l_tr = dstruct::ttraversal::linear_tr<decltype(condition), ops_t>;
+					dstruct::tconstruction::construct_at_end<l_tr>(root, initializer, condition);
+					writes++;
+				}
+			}
+			else {
+				std::this_thread::sleep_for(std::chrono::milliseconds((long)run_ms));
+			}
+			stop = true;
+			for (std::thread& t : threads) {
+				t.join();
+			}
+			double secs = sw.elapsed_ms() / 1000.0;
+
+			std::cout << readers << " readers" << (with_writer ? " + writer" : "")
+				<< ": " << (size_t)(reads / secs) << " reads/s";
+			if (with_writer) {
+				std::cout << ", " << (size_t)(writes / secs) << " writes/s";
+			}
+			std::cout << std::endl;
+		}
+	}
+
+	dstruct::tree_utils::destroy_tree<ops_t>(root);
+}
+
+void bench::bench_parallel(size_t n)
+{
+	using ops_t = ops<foundation::tp_single_thread, foundation::ap_arena>;
+	using node_handle = ops_t::node_handle;
+
+	std::vector<long> keys = make_keys(n, KEYS_RANDOM);
+	foundation::node_arena<ops_t::mnode> arena;
+	foundation::arena_scope<ops_t::mnode> scope(arena);
+
+	auto set_key = [](node_handle nn, long k) { ops_t::set_key(nn, k); };
+	node_handle root = dstruct::tconstruction::construct_balanced<ops_t>(keys.begin(), keys.end(), set_key);
+
+	std::cout << "bench_parallel: sum of " << n << " keys" << std::endl;
+
+	// The serial walk, for reference
+	stopwatch sw;
+	long serial_sum = 0;
+	{
+		dstruct::ttraversal::child_order_tr<ops_t> trav(root);
+		bool proceed = trav.depth() >= 0;
+		while (proceed) {
+			if (ops_t::is_index_pre(trav.node(0), trav.location(0))) {
+				serial_sum += ops_t::get_key(trav.node(0));
+			}
+			proceed = trav.next();
+		}
+	}
+	double serial_ms = sw.elapsed_ms();
+	std::cout << "serial: " << serial_ms << " ms" << std::endl;
+
+	unsigned int max_threads = std::max(1u, std::thread::hardware_concurrency());
+	for (unsigned int threads = 1; threads <= max_threads; threads *= 2)
+	{
+		foundation::ws_pool pool(threads);
+
+		sw.restart();
+		long sum = dstruct::ttraversal::parallel_reduce<ops_t>(pool, root, -1, 0L,
+			[](long& acc, node_handle nn, int) { acc += ops_t::get_key(nn); },
+			[](long& into, const long& from) { into += from; });
+		double ms = sw.elapsed_ms();
+
+		std::cout << threads << " threads: " << ms << " ms, speedup " << serial_ms / ms
+			<< (sum == serial_sum ? "" : " (SUM MISMATCH)") << std::endl;
+	}
+}
+
+void bench::bench_stackless(size_t n)
+{
+	using ops_t = ops<foundation::tp_single_thread, foundation::ap_arena>;
+	using node_handle = ops_t::node_handle;
+	using stack_tr = dstruct::ttraversal::child_order_tr<ops_t>;
+	using parent_tr = dstruct::ttraversal::parent_order_tr<ops_t>;
+
+	foundation::node_arena<ops_t::mnode> arena;
+	foundation::arena_scope<ops_t::mnode> scope(arena);
+
+	std::cout << "bench_stackless: " << n << " keys" << std::endl;
+
+	std::vector<long> keys = make_keys(n, KEYS_SORTED);
+	auto set_key = [](node_handle nn, long k) { ops_t::set_key(nn, k); };
+	node_handle balanced = dstruct::tconstruction::construct_balanced<ops_t>(keys.begin(), keys.end(), set_key);
+
+	// What sorted keys make of a plain BST, built directly: n levels deep
+	node_handle chain = nullptr;
+	node_handle tail = nullptr;
+	for (long k : keys) {
+		node_handle nn = ops_t::create_free_node();
+		ops_t::set_key(nn, k);
+		if (tail) {
+			ops_t::attach_node(tail, LABEL_RIGHT, nn);
+		}
+		else {
+			chain = nn;
+		}
+		tail = nn;
+	}
+
+	const char* names[] = { "balanced", "degenerate" };
+	node_handle roots[] = { balanced, chain };
+	for (int t = 0; t < 2; t++)
+	{
+		size_t rss_before = resident_kb();
+		stopwatch sw;
+		walk_sum<ops_t, stack_tr>(roots[t]);
+		double stack_ms = sw.elapsed_ms();
+		size_t rss_after = resident_kb();
+
+		sw.restart();
+		walk_sum<ops_t, parent_tr>(roots[t]);
+		double parent_ms = sw.elapsed_ms();
+
+		std::cout << names[t] << ": child_order_tr " << stack_ms << " ms"
+			<< " (rss +" << (rss_after > rss_before ? rss_after - rss_before : 0) << " KB)"
+			<< ", parent_order_tr " << parent_ms << " ms"
+			<< (same_events<ops_t, stack_tr, parent_tr>(roots[t]) ? "" : " (EVENT MISMATCH)") << std::endl;
+	}
+
+	// Shapes the two trees above do not have: nodes with only a left or only a right child, and no tree
+	node_handle left_only = add_node<ops_t>(nullptr, LABEL_INVALID, 5);
+	add_node<ops_t>(add_node<ops_t>(left_only, LABEL_LEFT, 3), LABEL_RIGHT, 4);
+	node_handle right_only = add_node<ops_t>(nullptr, LABEL_INVALID, 1);
+	add_node<ops_t>(add_node<ops_t>(right_only, LABEL_RIGHT, 3), LABEL_LEFT, 2);
+	node_handle mixed = add_node<ops_t>(nullptr, LABEL_INVALID, 4);
+	add_node<ops_t>(add_node<ops_t>(mixed, LABEL_LEFT, 2), LABEL_LEFT, 1);
+	add_node<ops_t>(add_node<ops_t>(mixed, LABEL_RIGHT, 6), LABEL_RIGHT, 7);
+
+	node_handle shapes[] = { nullptr, add_node<ops_t>(nullptr, LABEL_INVALID, 0), left_only, right_only, mixed };
+	const size_t count = sizeof(shapes) / sizeof(shapes[0]);
+	size_t same = 0;
+	for (node_handle s : shapes) {
+		same += same_events<ops_t, stack_tr, parent_tr>(s);
+	}
+	std::cout << "edge cases (empty, single node, one-child nodes): " << same << " of " << count << " walk alike"
+		<< (same == count ? "" : " (EVENT MISMATCH)") << std::endl;
+}
+
+void bench::bench_ranges(size_t n)
+{
+	using ops_t = ops<foundation::tp_single_thread, foundation::ap_arena>;
+	using node_handle = ops_t::node_handle;
+	using namespace dstruct::ttraversal;
+
+	std::vector<long> keys = make_keys(n, KEYS_RANDOM);
+	foundation::node_arena<ops_t::mnode> arena;
+	foundation::arena_scope<ops_t::mnode> scope(arena);
+	node_handle root = build_bst<ops_t>(keys);
+
+	std::cout << "bench_ranges: sum of " << n << " random keys" << std::endl;
+
+	stopwatch sw;
+	long expect = walk_sum<ops_t, child_order_tr<ops_t> >(root);
+	std::cout << "child_order_tr loop: " << sw.elapsed_ms() << " ms" << std::endl;
+
+	auto run = [&](const char* label, long sum) {
+		std::cout << label << ": " << sw.elapsed_ms() << " ms"
+			<< (sum == expect ? "" : " (SUM MISMATCH)") << std::endl;
+	};
+
+	sw.restart();
+	long sum = 0;
+	for (node_handle nn : preorder_range<ops_t>(root)) {
+		sum += ops_t::get_key(nn);
+	}
+	run("preorder_range", sum);
+
+	sw.restart();
+	sum = 0;
+	for (node_handle nn : inorder_range<ops_t>(root)) {
+		sum += ops_t::get_key(nn);
+	}
+	run("inorder_range", sum);
+
+	sw.restart();
+	postorder_range<ops_t> post(root);
+	sum = std::accumulate(post.begin(), post.end(), 0L,
+		[](long acc, node_handle nn) { return acc + ops_t::get_key(nn); });
+	run("postorder_range + std::accumulate", sum);
+
+	sw.restart();
+	sum = 0;
+	inorder_range<ops_t> in(root);
+	for (auto it = in.end(); it != in.begin(); ) {
+		sum += ops_t::get_key(*--it);
+	}
+	run("inorder_range backwards", sum);
+}
+
+void bench::bench_levels(size_t n)
+{
+	using ops_t = ops<foundation::tp_single_thread, foundation::ap_heap>;
+	using node_handle = ops_t::node_handle;
+	using level_tr = dstruct::ttraversal::level_order_tr<ops_t>;
+
+	// Heap nodes, so that a level is scattered about memory
+	std::vector<long> keys = make_keys(n, KEYS_RANDOM);
+	node_handle root = build_bst<ops_t>(keys);
+
+	std::cout << "bench_levels: " << n << " random keys" << std::endl;
+
+	stopwatch sw;
+	long expect = walk_sum<ops_t, dstruct::ttraversal::child_order_tr<ops_t> >(root);
+	std::cout << "child_order_tr: " << sw.elapsed_ms() << " ms" << std::endl;
+
+	size_t widest = 0;
+	int levels = 0;
+	for (int prefetch = 0; prefetch < 2; prefetch++)
+	{
+		level_tr trav(root, prefetch != 0);
+		for (int pass = 0; pass < 2; pass++)  // the second pass reuses the frontier
+		{
+			sw.restart();
+			trav.reset(root);
+			long sum = 0;
+			bool proceed = trav.depth() >= 0;
+			while (proceed) {
+				if (trav.is_level_start()) {
+					widest = std::max(widest, trav.level_size());
+					levels = trav.depth() + 1;
+				}
+				sum += ops_t::get_key(trav.node());
+				proceed = trav.next();
+			}
+			std::cout << "level_order_tr" << (prefetch ? " + prefetch" : "")
+				<< (pass ? ", reused" : "") << ": " << sw.elapsed_ms() << " ms"
+				<< (sum == expect ? "" : " (SUM MISMATCH)") << std::endl;
+		}
+	}
+	std::cout << levels << " levels, the widest " << widest << " nodes" << std::endl;
+
+	dstruct::tree_utils::destroy_tree<ops_t>(root);
+}
+
+void bench::bench_checks(size_t n)
+{
+	using foundation::tp_single_thread;
+	using foundation::ap_arena;
+	using mnode = node<tp_single_thread>;
+
+	// One tree, seen through ops that differ only in their check policy
+	using ops_none = ops<tp_single_thread, ap_arena, mnode, foundation::check_none>;
+	using ops_sequence = ops<tp_single_thread, ap_arena, mnode, foundation::check_sequence>;
+	using ops_strict = ops<tp_single_thread, ap_arena, mnode, foundation::check_strict>;
+
+	std::vector<long> keys = make_keys(n, KEYS_RANDOM);
+	foundation::node_arena<mnode> arena;
+	foundation::arena_scope<mnode> scope(arena);
+	auto set_key = [](mnode* nn, long k) { nn->m_key = k; };
+	mnode* root = dstruct::tconstruction::construct_balanced<ops_none>(keys.begin(), keys.end(), set_key);
+
+	std::cout << "bench_checks: walking " << n << " nodes" << std::endl;
+	walk_with_checks<ops_none>("check_none", root, n);
+	walk_with_checks<ops_sequence>("check_sequence", root, n);
+	walk_with_checks<ops_strict>("check_strict", root, n);
+}
+
+void bench::bench_percentile(size_t n)
+{
+	using foundation::tp_single_thread;
+	using foundation::ap_arena;
+	using plain_ops = ops<tp_single_thread, ap_arena>;
+	using aug_ops = dstruct::aug_tree::ops<tp_single_thread, ap_arena>;
+	using mnode = aug_ops::mnode;
+
+	std::vector<long> keys = make_keys(n, KEYS_RANDOM);
+	std::cout << "bench_percentile: " << n << " random keys" << std::endl;
+
+	// What keeping the sizes costs on insert
+	{
+		foundation::node_arena<plain_ops::mnode> arena;
+		foundation::arena_scope<plain_ops::mnode> scope(arena);
+		stopwatch sw;
+		build_bst<plain_ops>(keys);
+		std::cout << "build, plain: " << sw.elapsed_ms() << " ms" << std::endl;
+	}
+
+	foundation::node_arena<mnode> arena;
+	foundation::arena_scope<mnode> scope(arena);
+	stopwatch sw;
+	mnode* root = build_bst<aug_ops>(keys);
+	std::cout << "build, augmented: " << sw.elapsed_ms() << " ms" << std::endl;
+
+	const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+	// By select: one search per query
+	const int rounds = 100000;
+	long check = 0;
+	sw.restart();
+	for (int i = 0; i < rounds; i++) {
+		check += dstruct::aug_tree::quantile<aug_ops>(root, quantiles[i % 4])->m_key;
+	}
+	double select_us = sw.elapsed_ms() * 1000.0 / rounds;
+
+	// By walking: count nodes in order up to the one wanted
+	long walk_check = 0;
+	sw.restart();
+	for (double q : quantiles) {
+		size_t want = (size_t)(q * (double)(n - 1) + 0.5);
+		size_t seen = 0;
+		for (mnode* nn : dstruct::ttraversal::inorder_range<aug_ops>(root)) {
+			if (seen++ == want) {
+				walk_check += nn->m_key;
+				break;
+			}
+		}
+	}
+	double walk_us = sw.elapsed_ms() * 1000.0 / 4;
+
+	long select_check = 0;
+	for (double q : quantiles) {
+		select_check += dstruct::aug_tree::quantile<aug_ops>(root, q)->m_key;
+	}
+
+	std::cout << "quantile by select: " << select_us << " us/query"
+		<< ", by in-order walk: " << walk_us << " us/query"
+		<< (select_check == walk_check && check == select_check * (rounds / 4) ? "" : " (MISMATCH)") << std::endl;
+	std::cout << "height " << aug_ops::tree_depth(root) << ", rank of the median key "
+		<< dstruct::aug_tree::rank<aug_ops>(root, dstruct::aug_tree::quantile<aug_ops>(root, 0.5)->m_key) << std::endl;
+}
+
+void bench::bench_frozen(size_t n)
+{
+	using ops_t = ops<foundation::tp_single_thread, foundation::ap_heap>;
+	using node_handle = ops_t::node_handle;
+	using dstruct::frozen::frozen_tree;
+
+	const size_t queries = 1000000;
+	std::cout << "bench_frozen: " << queries << " lookups per size, ns/lookup" << std::endl;
+
+	// From L1-sized trees up to n keys
+	for (size_t size = 1000; size <= n; size *= 10)
+	{
+		std::vector<long> keys = make_keys(size, KEYS_RANDOM);
+		auto set_key = [](node_handle nn, long k) { ops_t::set_key(nn, k); };
+		node_handle root = dstruct::tconstruction::construct_balanced<ops_t>(keys.begin(), keys.end(), set_key);
+
+		frozen_tree<long> eytzinger = dstruct::frozen::freeze<ops_t>(root, dstruct::frozen::LAYOUT_EYTZINGER);
+		frozen_tree<long> veb = dstruct::frozen::freeze<ops_t>(root, dstruct::frozen::LAYOUT_VEB);
+		std::vector<long> sorted(keys);
+		std::sort(sorted.begin(), sorted.end());
+
+		std::mt19937 gen(7);
+		std::uniform_int_distribution<long> dist(0, (long)size - 1);
+		std::vector<long> probe(queries);
+		for (long& k : probe) {
+			k = dist(gen);
+		}
+
+		auto per_lookup = [&](double ms) { return ms * 1e6 / (double)queries; };
+
+		stopwatch sw;
+		size_t found = lookup_all<ops_t>(root, probe);
+		double pointer_ns = per_lookup(sw.elapsed_ms());
+
+		size_t found_std = 0;
+		sw.restart();
+		for (long k : probe) {
+			auto it = std::lower_bound(sorted.begin(), sorted.end(), k);
+			found_std += it != sorted.end() && *it == k;
+		}
+		double std_ns = per_lookup(sw.elapsed_ms());
+
+		auto time_frozen = [&](const frozen_tree<long>& ft, double& ns) {
+			size_t hits = 0;
+			sw.restart();
+			for (long k : probe) {
+				const long* r = ft.lower_bound(k);
+				hits += r != nullptr && *r == k;
+			}
+			ns = per_lookup(sw.elapsed_ms());
+			return hits;
+		};
+		double eytzinger_ns = 0.0, veb_ns = 0.0;
+		size_t found_eytzinger = time_frozen(eytzinger, eytzinger_ns);
+		size_t found_veb = time_frozen(veb, veb_ns);
+
+		std::vector<const long*> out(probe.size());
+		sw.restart();
+		eytzinger.lower_bound_batch(probe.data(), probe.size(), out.data());
+		double batch_ns = per_lookup(sw.elapsed_ms());
+		size_t found_batch = 0;
+		for (size_t i = 0; i < probe.size(); i++) {
+			found_batch += out[i] != nullptr && *out[i] == probe[i];
+		}
+
+		bool agree = found == queries && found_std == queries && found_eytzinger == queries
+			&& found_veb == queries && found_batch == queries;
+		std::cout << size << " keys: pointer " << pointer_ns
+			<< ", std::lower_bound " << std_ns
+			<< ", eytzinger " << eytzinger_ns
+			<< ", eytzinger batch " << batch_ns
+			<< ", veb " << veb_ns
+			<< (agree ? "" : " (MISMATCH)") << std::endl;
+
+		dstruct::tree_utils::destroy_tree<ops_t>(root);
+	}
+}
+
+void bench::bench_wide(size_t n)
+{
+	using ops_t = ops<foundation::tp_single_thread, foundation::ap_heap>;
+	using wide_ops = dstruct::wide_tree::ops<long>;
+	using wide_node = wide_ops::mnode;
+
+	std::vector<long> keys = make_keys(n, KEYS_RANDOM);
+	std::vector<long> probe = make_keys(n, KEYS_RANDOM, 11);
+	std::cout << "bench_wide: " << n << " random keys, " << wide_ops::sm_capacity << " keys a node" << std::endl;
+
+	size_t rss_before = resident_kb();
+	stopwatch sw;
+	ops_t::node_handle root = build_bst<ops_t>(keys);
+	double bst_build_ms = sw.elapsed_ms();
+	size_t bst_kb = resident_kb() - rss_before;
+
+	sw.restart();
+	size_t bst_found = lookup_all<ops_t>(root, probe);
+	double bst_lookup_ms = sw.elapsed_ms();
+	int bst_height = tree_height<ops_t>(root);
+
+	rss_before = resident_kb();
+	sw.restart();
+	wide_node* wroot = nullptr;
+	for (long k : keys) {
+		dstruct::wide_tree::insert<wide_ops>(k, wroot);
+	}
+	double wide_build_ms = sw.elapsed_ms();
+	size_t wide_kb = resident_kb() - rss_before;
+
+	sw.restart();
+	size_t wide_found = 0;
+	for (long k : probe) {
+		wide_found += dstruct::wide_tree::contains<wide_ops>(wroot, k);
+	}
+	double wide_lookup_ms = sw.elapsed_ms();
+
+	// Every key once, in order, off a child_order_tr walk: key i comes after child i
+	sw.restart();
+	dstruct::ttraversal::child_order_tr<wide_ops> trav(wroot);
+	long last = std::numeric_limits<long>::min();
+	size_t seen = 0;
+	bool sorted = true;
+	while (trav.depth() >= 0) {
+		wide_node* wn = trav.node(0);
+		int at = trav.location(0);
+		int from = wide_ops::is_leaf(wn) ? (at == dstruct::wide_tree::CHILD_PRE ? 0 : wn->m_count) : at;
+		int to = wide_ops::is_leaf(wn) ? wn->m_count : (at >= 0 && at < wn->m_count ? at + 1 : at);
+		for (int i = from; i < to; ++i) {
+			sorted = sorted && last <= wn->m_keys[i];
+			last = wn->m_keys[i];
+			seen++;
+		}
+		trav.next();
+	}
+	double wide_walk_ms = sw.elapsed_ms();
+
+	auto per_lookup = [&](double ms) { return ms * 1e6 / (double)n; };
+	std::cout << "binary: build " << bst_build_ms << " ms, " << per_lookup(bst_lookup_ms) << " ns/lookup"
+		<< ", height " << bst_height << ", rss +" << bst_kb << " KB" << std::endl;
+	std::cout << "wide: build " << wide_build_ms << " ms, " << per_lookup(wide_lookup_ms) << " ns/lookup"
+		<< ", height " << wide_ops::tree_depth(wroot) << ", rss +" << wide_kb << " KB"
+		<< ", in-order walk " << wide_walk_ms << " ms"
+		<< (bst_found == wide_found && seen == n && sorted ? "" : " (MISMATCH)") << std::endl;
+
+	dstruct::tree_utils::destroy_tree<ops_t>(root);
+	dstruct::tree_utils::destroy_tree<wide_ops>(wroot);
+}
+
+void bench::bench_batch(size_t n)
+{
+	using ops_t = ops<foundation::tp_single_thread, foundation::ap_heap>;
+	using wide_ops = dstruct::wide_tree::ops<long>;
+
+	std::vector<long> keys = make_keys(n, KEYS_RANDOM);
+	std::vector<long> probe = make_keys(n, KEYS_RANDOM, 11);
+	std::vector<bst_probe<ops_t> > probes(n);
+	for (size_t i = 0; i < n; i++) {
+		probes[i].m_key = probe[i];
+	}
+	std::cout << "bench_batch: " << n << " random keys, ns/lookup" << std::endl;
+
+	auto per_lookup = [&](double ms) { return ms * 1e6 / (double)n; };
+
+	ops_t::node_handle root = build_bst<ops_t>(keys);
+	stopwatch sw;
+	size_t found = lookup_all<ops_t>(root, probe);
+	double one_ns = per_lookup(sw.elapsed_ms());
+
+	sw.restart();
+	size_t found4 = lookup_batch<ops_t, 4>(root, probes);
+	double batch4_ns = per_lookup(sw.elapsed_ms());
+
+	sw.restart();
+	size_t found8 = lookup_batch<ops_t, 8>(root, probes);
+	double batch8_ns = per_lookup(sw.elapsed_ms());
+
+	sw.restart();
+	size_t found16 = lookup_batch<ops_t, 16>(root, probes);
+	double batch16_ns = per_lookup(sw.elapsed_ms());
+
+	std::cout << "binary: one at a time " << one_ns
+		<< ", batch of 4 " << batch4_ns
+		<< ", of 8 " << batch8_ns
+		<< ", of 16 " << batch16_ns
+		<< (found == n && found4 == n && found8 == n && found16 == n ? "" : " (MISMATCH)") << std::endl;
+	dstruct::tree_utils::destroy_tree<ops_t>(root);
+
+	// The same on a wide tree, where each step is one node search
+	wide_ops::mnode* wroot = nullptr;
+	for (long k : keys) {
+		dstruct::wide_tree::insert<wide_ops>(k, wroot);
+	}
+	auto wide_probe = [](long k) {
+		return [k](wide_ops::mnode* wn, int) -> int {
+			int r = wide_ops::lower_slot(wn, k);
+			if (r < wn->m_count && wn->m_keys[r] == k) {
+				return wide_ops::sm_invalid_lbl;
+			}
+			return wide_ops::is_leaf(wn) ? wide_ops::sm_invalid_lbl : r;
+		};
+	};
+	using wide_pred = decltype(wide_probe(0));
+	std::vector<wide_pred> wprobes;
+	wprobes.reserve(n);
+	for (long k : probe) {
+		wprobes.push_back(wide_probe(k));
+	}
+
+	sw.restart();
+	size_t wide_found = 0;
+	for (long k : probe) {
+		wide_found += dstruct::wide_tree::contains<wide_ops>(wroot, k);
+	}
+	double wide_one_ns = per_lookup(sw.elapsed_ms());
+
+	sw.restart();
+	std::vector<dstruct::ttraversal::search_end<wide_ops> > ends(n);
+	dstruct::ttraversal::linear_search_batch<wide_ops, 8>(wroot, wprobes.begin(), wprobes.end(), ends.data());
+	size_t wide_found8 = 0;
+	for (size_t i = 0; i < n; i++) {
+		const auto& e = ends[i];
+		int r = wide_ops::lower_slot(e.m_node, probe[i]);
+		wide_found8 += r < e.m_node->m_count && e.m_node->m_keys[r] == probe[i];
+	}
+	double wide_batch_ns = per_lookup(sw.elapsed_ms());
+
+	std::cout << "wide: one at a time " << wide_one_ns
+		<< ", batch of 8 " << wide_batch_ns
+		<< (wide_found == n && wide_found8 == n ? "" : " (MISMATCH)") << std::endl;
+	dstruct::tree_utils::destroy_tree<wide_ops>(wroot);
+}
+
+void bench::bench_scan(size_t n)
+{
+	using ops_t = ops<foundation::tp_single_thread, foundation::ap_heap>;
+	using node_handle = ops_t::node_handle;
+	using namespace dstruct::ttraversal;
+
+	std::vector<long> keys = make_keys(n, KEYS_RANDOM);
+	auto set_key = [](node_handle nn, long k) { ops_t::set_key(nn, k); };
+	node_handle root = dstruct::tconstruction::construct_balanced<ops_t>(keys.begin(), keys.end(), set_key);
+	std::cout << "bench_scan: " << n << " keys, us/scan" << std::endl;
+
+	std::mt19937 gen(5);
+	for (size_t width = 10; width <= n / 10; width *= 100)
+	{
+		const int scans = 200;
+		std::uniform_int_distribution<long> dist(0, (long)(n - width));
+		std::vector<long> los(scans);
+		for (long& lo : los) {
+			lo = dist(gen);
+		}
+		auto per_scan = [&](double ms) { return ms * 1e3 / scans; };
+
+		// Without a seek, all there is is to walk in order from the smallest key
+		stopwatch sw;
+		long walk_sum = 0;
+		for (long lo : los) {
+			for (node_handle nn : inorder_range<ops_t>(root)) {
+				long k = ops_t::get_key(nn);
+				if (k >= lo + (long)width) {
+					break;
+				}
+				if (k >= lo) {
+					walk_sum += k;
+				}
+			}
+		}
+		double walk_us = per_scan(sw.elapsed_ms());
+
+		sw.restart();
+		long range_sum = 0;
+		for (long lo : los) {
+			for (node_handle nn : key_range<ops_t>(root, lo, lo + (long)width)) {
+				range_sum += ops_t::get_key(nn);
+			}
+		}
+		double range_us = per_scan(sw.elapsed_ms());
+
+		sw.restart();
+		long chunk_sum = 0;
+		long buf[256];
+		for (long lo : los) {
+			key_scan<ops_t> scan(root, lo, lo + (long)width);
+			for (size_t got = scan.next_chunk(buf, 256); got > 0; got = scan.next_chunk(buf, 256)) {
+				chunk_sum = std::accumulate(buf, buf + got, chunk_sum);
+			}
+		}
+		double chunk_us = per_scan(sw.elapsed_ms());
+
+		std::cout << width << " keys a scan: in-order walk " << walk_us
+			<< ", key_range " << range_us
+			<< ", key_scan in chunks of 256 " << chunk_us
+			<< (walk_sum == range_sum && range_sum == chunk_sum ? "" : " (MISMATCH)") << std::endl;
+	}
+
+	dstruct::tree_utils::destroy_tree<ops_t>(root);
+}
+
+void bench::bench_snapshot(size_t n)
+{
+	using ops_t = ops<foundation::tp_single_thread, foundation::ap_heap>;
+	using snap_ops = dstruct::snapshot::ops<long>;
+	const char* path = "bench_snapshot.bin";
+
+	std::vector<long> keys = make_keys(n, KEYS_RANDOM);
+	std::vector<long> probe = make_keys(n, KEYS_RANDOM, 11);
+	std::cout << "bench_snapshot: " << n << " random keys" << std::endl;
+
+	stopwatch sw;
+	ops_t::node_handle root = build_bst<ops_t>(keys);
+	double rebuild_ms = sw.elapsed_ms();
+
+	sw.restart();
+	dstruct::snapshot::save<ops_t>(root, path);
+	double save_ms = sw.elapsed_ms();
+
+	sw.restart();
+	size_t found = lookup_all<ops_t>(root, probe);
+	double lookup_ms = sw.elapsed_ms();
+	long sum = walk_sum<ops_t, dstruct::ttraversal::child_order_tr<ops_t> >(root);
+	dstruct::tree_utils::destroy_tree<ops_t>(root);
+
+	sw.restart();
+	{
+		dstruct::snapshot::snapshot_file<long> unchecked(path, false);
+	}
+	double open_ms = sw.elapsed_ms();
+
+	sw.restart();
+	dstruct::snapshot::snapshot_file<long> snap(path);
+	double open_checked_ms = sw.elapsed_ms();
+	snap_ops::binding bind(snap);
+
+	sw.restart();
+	size_t snap_found = lookup_all<snap_ops>(snap.root(), probe);
+	double snap_lookup_ms = sw.elapsed_ms();
+	long snap_sum = walk_sum<snap_ops, dstruct::ttraversal::child_order_tr<snap_ops> >(snap.root());
+
+	std::cout << "rebuild from keys " << rebuild_ms << " ms, save " << save_ms << " ms ("
+		<< (dstruct::snapshot::SNAPSHOT_RECORDS_AT + (n + 1) * sizeof(dstruct::snapshot::record<long>)) / 1024 << " KB)" << std::endl;
+	std::cout << "open " << open_ms << " ms, with checksum " << open_checked_ms << " ms" << std::endl;
+	std::cout << "lookup: pointer tree " << lookup_ms << " ms, snapshot " << snap_lookup_ms << " ms"
+		<< (found == snap_found && found == n && sum == snap_sum ? "" : " (MISMATCH)") << std::endl;
+
+	std::remove(path);
+}
+
+void bench::bench_lisp(size_t n)
+{
+	using ops_t = ops<foundation::tp_single_thread, foundation::ap_heap>;
+	using node_handle = ops_t::node_handle;
+
+	std::vector<long> keys = make_keys(n, KEYS_RANDOM);
+	auto set_key = [](node_handle nn, long k) { ops_t::set_key(nn, k); };
+	node_handle root = dstruct::tconstruction::construct_balanced<ops_t>(keys.begin(), keys.end(), set_key);
+	std::cout << "bench_lisp: " << n << " keys" << std::endl;
+
+	auto mb_per_s = [](size_t bytes, double ms) { return (double)bytes / 1048576.0 / ms * 1000.0; };
+
+	std::ostringstream slow;
+	stopwatch sw;
+	print::tree::print_lisp_tree<ops_t>(slow, root);
+	double print_ms = sw.elapsed_ms();
+
+	std::ostringstream fast;
+	sw.restart();
+	{
+		print::tree::text_buffer out(fast);
+		print::tree::write_lisp_tree<ops_t>(out, root);
+	}
+	double write_ms = sw.elapsed_ms();
+	std::string text = fast.str();
+
+	std::istringstream in(text);
+	sw.restart();
+	node_handle back = print::tree::read_lisp_tree<ops_t>(in);
+	double read_ms = sw.elapsed_ms();
+
+	bool same = slow.str() == text
+		&& walk_sum<ops_t, dstruct::ttraversal::child_order_tr<ops_t> >(root) == walk_sum<ops_t, dstruct::ttraversal::child_order_tr<ops_t> >(back)
+		&& tree_height<ops_t>(root) == tree_height<ops_t>(back);
+
+	std::cout << text.size() / 1024 << " KB of text"
+		<< ": print_lisp_tree " << print_ms << " ms (" << mb_per_s(text.size(), print_ms) << " MB/s)"
+		<< ", write_lisp_tree " << write_ms << " ms (" << mb_per_s(text.size(), write_ms) << " MB/s)"
+		<< ", read_lisp_tree " << read_ms << " ms (" << mb_per_s(text.size(), read_ms) << " MB/s)"
+		<< (same ? "" : " (MISMATCH)") << std::endl;
+
+	dstruct::tree_utils::destroy_tree<ops_t>(root);
+	dstruct::tree_utils::destroy_tree<ops_t>(back);
+
+	// The shapes and keys a balanced tree of 0..n-1 never has
+	const long lmax = std::numeric_limits<long>::max();
+	const long lmin = std::numeric_limits<long>::min();
+	std::vector<node_handle> edge_trees;
+
+	node_handle right_only = add_node<ops_t>(nullptr, LABEL_INVALID, 1);
+	add_node<ops_t>(add_node<ops_t>(right_only, LABEL_RIGHT, 2), LABEL_RIGHT, 3);
+	edge_trees.push_back(right_only);
+
+	node_handle negative = add_node<ops_t>(nullptr, LABEL_INVALID, -10);
+	add_node<ops_t>(negative, LABEL_LEFT, -20);
+	add_node<ops_t>(add_node<ops_t>(negative, LABEL_RIGHT, -5), LABEL_LEFT, -7);
+	edge_trees.push_back(negative);
+
+	node_handle extreme = add_node<ops_t>(nullptr, LABEL_INVALID, 0);
+	add_node<ops_t>(add_node<ops_t>(extreme, LABEL_LEFT, lmin), LABEL_RIGHT, lmin + 1);
+	add_node<ops_t>(add_node<ops_t>(extreme, LABEL_RIGHT, lmax), LABEL_LEFT, -999999999999999999L);
+	edge_trees.push_back(extreme);
+
+	edge_trees.push_back(add_node<ops_t>(nullptr, LABEL_INVALID, lmin));
+
+	size_t round_trips = 0;
+	for (node_handle t : edge_trees) {
+		round_trips += lisp_round_trips<ops_t>(t);
+		dstruct::tree_utils::destroy_tree<ops_t>(t);
+	}
+	std::cout << "edge cases (one-child nodes, negative and extreme keys): " << round_trips << " of " << edge_trees.size() << " round-trip"
+		<< (round_trips == edge_trees.size() ? "" : " (MISMATCH)") << std::endl;
+}
+
+void bench::bench_counters(size_t n)
+{
+	using sharded_t = foundation::acounter_sharded<2>;
+
+	std::cout << "bench_counters: " << n << " increments per thread" << std::endl;
+
+	// Every thread adds n ones through count(t), started together
+	auto run = [n](unsigned int threads, const std::function<void(unsigned int)>& count) -> double
+	{
+		std::atomic<unsigned int> ready(0);
+		std::vector<std::thread> pool;
+		stopwatch sw;
+		for (unsigned int t = 0; t < threads; t++) {
+			pool.emplace_back([&, t]()
+			{
+				ready.fetch_add(1);
+				while (ready.load() < threads) { }
+				count(t);
+			});
+		}
+		for (std::thread& th : pool) {
+			th.join();
+		}
+		return sw.elapsed_ms() * 1e6 / ((double)n * threads);
+	};
+
+	unsigned int max_threads = std::max(1u, std::thread::hardware_concurrency());
+	for (unsigned int threads = 1; threads <= max_threads; threads *= 2)
+	{
+		std::atomic<foundation::acount_t> shared(0);
+		double atomic_ns = run(threads, [&](unsigned int)
+		{
+			for (size_t i = 0; i < n; i++) {
+				shared.fetch_add(1, std::memory_order_relaxed);
+			}
+		});
+
+		sharded_t sharded;
+		foundation::acounter_sampler<sharded_t> sampler(sharded, 256);
+		sampler.start(std::chrono::milliseconds(1));
+		double sharded_ns = run(threads, [&](unsigned int)
+		{
+			for (size_t i = 0; i < n; i++) {
+				sharded.add_to_counter(1);
+			}
+		});
+		sampler.stop();
+
+		bool same = shared.load() == sharded.get_counter() && sharded.get_counter() == (foundation::acount_t)n * threads;
+		std::cout << threads << " threads: shared atomic " << atomic_ns << " ns/add"
+			<< ", acounter_sharded " << sharded_ns << " ns/add"
+			<< " (" << sampler.samples().size() << " samples)"
+			<< (same ? "" : " (COUNT MISMATCH)") << std::endl;
+	}
+}
+
+void bench::bench_instrumented(size_t n)
+{
+	using ops_t = ops<foundation::tp_single_thread, foundation::ap_arena>;
+	using node_handle = ops_t::node_handle;
+	using counter_t = foundation::acounter<4>;
+
+	foundation::node_arena<ops_t::mnode> arena;
+	foundation::arena_scope<ops_t::mnode> scope(arena);
+
+	std::vector<long> keys = make_keys(n, KEYS_RANDOM);
+	node_handle root = build_bst<ops_t>(keys);
+	std::cout << "bench_instrumented: " << n << " lookups" << std::endl;
+
+	// The search's two dimensions are the counter's 2 and 3, by either kind of map
+	const foundation::dim_t targets[] = { 2, 3 };
+	foundation::acounter_map<2> runtime_map(targets);
+	using static_map_t = foundation::acounter_static_map<2, 3>;
+
+	foundation::arecursion_null_counter none;
+	counter_t c1, c2;
+	foundation::acounter_view<2, 4> runtime_view(&runtime_map, &c1);
+	foundation::acounter_static_view<static_map_t, counter_t> static_view(&c2);
+
+	stopwatch sw;
+	size_t f0 = counted_lookups<ops_t>(root, keys, none);
+	double none_ms = sw.elapsed_ms();
+
+	sw.restart();
+	size_t f1 = counted_lookups<ops_t>(root, keys, runtime_view);
+	double runtime_ms = sw.elapsed_ms();
+
+	sw.restart();
+	size_t f2 = counted_lookups<ops_t>(root, keys, static_view);
+	double static_ms = sw.elapsed_ms();
+
+	bool same = f0 == f1 && f1 == f2 && c1.get_counter(3) == f1 && c1.snapshot() == c2.snapshot();
+	std::cout << c1.get_counter(2) << " steps: uninstrumented " << none_ms << " ms"
+		<< ", acounter_view " << runtime_ms << " ms"
+		<< ", acounter_static_view " << static_ms << " ms"
+		<< (same ? "" : " (COUNT MISMATCH)") << std::endl;
+}
+
+void bench::bench_recursion(size_t n)
+{
+	using builder_t = foundation::arecursion_tree_builder<>;
+
+	std::cout << "bench_recursion: " << n << " calls" << std::endl;
+
+	stopwatch sw;
+	long plain = profiled_sum<builder_t>(nullptr, 0, (long)n);
+	double plain_ms = sw.elapsed_ms();
+	std::cout << "uninstrumented: " << plain_ms << " ms" << std::endl;
+
+	const foundation::arecursion_mode modes[] = { foundation::AR_LEVELS, foundation::AR_TREE };
+	const char* names[] = { "AR_LEVELS", "AR_TREE" };
+	for (int m = 0; m < 2; m++)
+	{
+		size_t rss_before = resident_kb();
+		sw.restart();
+		long sum;
+		size_t levels, nodes;
+		double drop_ms;
+		{
+			builder_t b(nullptr, modes[m]);
+			sum = profiled_sum(&b, 0, (long)n);
+			levels = b.max_depth();
+			nodes = b.node_count();
+			size_t rss_after = resident_kb();
+			double build_ms = sw.elapsed_ms();
+
+			std::cout << names[m] << ": " << build_ms << " ms, " << levels << " levels, " << nodes << " nodes"
+				<< " (rss +" << (rss_after > rss_before ? rss_after - rss_before : 0) << " KB)";
+			sw.restart();
+		}
+		drop_ms = sw.elapsed_ms();
+		std::cout << ", teardown " << drop_ms << " ms" << (sum == plain ? "" : " (SUM MISMATCH)") << std::endl;
+	}
+
+	// Folded stacks merged while the recursion runs, with no tree kept
+	foundation::arecursion_folded folded;
+	sw.restart();
+	long sum;
+	{
+		builder_t b(nullptr, foundation::AR_LEVELS);
+		b.fold_into(&folded);
+		sum = profiled_sum(&b, 0, (long)n);
+	}
+	double fold_ms = sw.elapsed_ms();
+
+	std::ostringstream text;
+	sw.restart();
+	foundation::write_folded_stacks(text, folded, "profiled_sum");
+	double write_ms = sw.elapsed_ms();
+
+	std::cout << "AR_LEVELS, folded: " << fold_ms << " ms, " << folded.size() << " paths"
+		<< ", written in " << write_ms << " ms (" << text.str().size() << " bytes)"
+		<< (sum == plain ? "" : " (SUM MISMATCH)") << std::endl;
+}
+
+void bench::bench_instrument(size_t n)
+{
+	using ops_t = ops<foundation::tp_single_thread, foundation::ap_arena>;
+	using node_handle = ops_t::node_handle;
+	using counter_t = foundation::acounter<foundation::INS_DIMS>;
+	using counted_t = foundation::instrument_counter<counter_t>;
+	using namespace dstruct::ttraversal;
+
+	foundation::node_arena<ops_t::mnode> arena;
+	foundation::arena_scope<ops_t::mnode> scope(arena);
+
+	std::vector<long> keys = make_keys(n, KEYS_RANDOM);
+	node_handle root = build_bst<ops_t>(keys);
+	std::cout << "bench_instrument: " << n << " keys" << std::endl;
+
+	counter_t counter;
+	foundation::instrument_sink<counter_t> sink(counter);
+
+	// Every key looked up, then one full walk, under either policy
+	auto run = [&](auto policy) -> double
+	{
+		using instr_t = decltype(policy);
+
+		stopwatch sw;
+		size_t found = 0;
+		for (long k : keys) {
+			auto condition = [&](node_handle bn, int depth) -> ilabel
+			{
+				long nk = ops_t::get_key(bn);
+				return k == nk ? LABEL_INVALID : (k < nk ? LABEL_LEFT : LABEL_RIGHT);
+			};
+			linear_tr<decltype(condition), ops_t, instr_t> trav(root, condition);
+			while (trav.next());
+			found += ops_t::get_key(trav.node()) == k;
+		}
+
+		child_order_tr<ops_t, foundation::check_default, instr_t> walk(root);
+		while (walk.depth() >= 0) {
+			walk.next();
+		}
+		double ms = sw.elapsed_ms();
+		return found == keys.size() ? ms : -ms;
+	};
+
+	double none_ms = run(foundation::instrument_none());
+	double counted_ms = run(counted_t());
+
+	std::cout << "instrument_none " << none_ms << " ms, instrument_counter " << counted_ms << " ms" << std::endl;
+	sink.report(std::cout);
+}
+
+void bench::bench_perf(size_t n)
+{
+	using perf_counter_t = foundation::acounter<foundation::PERF_KINDS>;
+
+	std::vector<long> keys = make_keys(n, KEYS_RANDOM);
+	std::vector<long> probes = make_keys(n, KEYS_RANDOM, 54321);
+	std::cout << "bench_perf: " << n << " random keys" << std::endl;
+
+	foundation::perf_group group;
+	const bool opened = group.available();
+	if (!group.status().empty()) {
+		std::cout << (opened ? "" : "no hardware counts, ") << group.status() << std::endl;
+	}
+	const foundation::acounter_map<foundation::PERF_KINDS>& map = perf_counter_t::get_id_map();
+
+	// The same lookups and walk on each layout, per operation
+	auto measure = [&](const char* name, auto root, auto ops_tag)
+	{
+		using ops_t = decltype(ops_tag);
+
+		perf_counter_t lookups, walk;
+		stopwatch sw;
+		{
+			foundation::perf_scope<perf_counter_t> region(group, map, lookups);
+			lookup_all<ops_t>(root, probes);
+		}
+		double lookup_ms = sw.elapsed_ms();
+
+		sw.restart();
+		long sum;
+		{
+			foundation::perf_scope<perf_counter_t> region(group, map, walk);
+			sum = walk_sum<ops_t, dstruct::ttraversal::child_order_tr<ops_t> >(root);
+		}
+		double walk_ms = sw.elapsed_ms();
+
+		std::string label(name);
+		report_perf((label + " lookup").c_str(), group, lookups, probes.size(), lookup_ms);
+		report_perf((label + " walk").c_str(), group, walk, keys.size(), walk_ms);
+		return sum;
+	};
+
+	long sums[3];
+	{
+		using ops_t = ops<foundation::tp_single_thread>;
+		ops_t::node_handle root = build_bst<ops_t>(keys);
+		sums[0] = measure("heap", root, ops_t());
+		dstruct::tree_utils::destroy_tree<ops_t>(root);
+	}
+	{
+		using ops_t = ops<foundation::tp_single_thread, foundation::ap_arena>;
+		foundation::node_arena<ops_t::mnode> arena;
+		foundation::arena_scope<ops_t::mnode> scope(arena);
+		sums[1] = measure("arena", build_bst<ops_t>(keys), ops_t());
+	}
+	{
+		using ops_t = dstruct::compact_tree::ops<long>;
+		ops_t::pool pool(n);
+		ops_t::binding bind(pool);
+		sums[2] = measure("compact", build_bst<ops_t>(keys), ops_t());
+	}
+
+	if (opened && !group.available()) {
+		std::cout << "no hardware counts, " << group.status() << std::endl;
+	}
+	if (sums[0] != sums[1] || sums[1] != sums[2]) {
+		std::cout << "SUM MISMATCH" << std::endl;
+	}
+}
+
+void bench::bench_complexity(size_t n)
+{
+	using ops_t = ops<foundation::tp_single_thread, foundation::ap_arena>;
+	using node_handle = ops_t::node_handle;
+	using counter_t = foundation::acounter<foundation::INS_DIMS>;
+	using counted_t = foundation::instrument_counter<counter_t>;
+
+	std::cout << "bench_complexity: sizes up to " << n << std::endl;
+
+	// Steps are nodes visited by the traversers, through an instrument_sink
+	counter_t counter;
+	foundation::instrument_sink<counter_t> sink(counter);
+	auto nodes_visited = [&]() { return counter.get_counter(foundation::INS_NODES); };
+
+	struct workload
+	{
+		const char* m_label;
+		key_order m_order;
+		int m_what;  // 0 build, 1 lookups, 2 walk
+		foundation::acomplexity_class m_expected;
+	};
+	const workload workloads[] = {
+		{ "construct_at_end, random keys", KEYS_RANDOM, 0, foundation::AC_N_LOG_N },
+		{ "construct_at_end, sorted keys", KEYS_SORTED, 0, foundation::AC_N_LOG_N },
+		{ "linear_tr lookups, random keys", KEYS_RANDOM, 1, foundation::AC_N_LOG_N },
+		{ "child_order_tr walk, random keys", KEYS_RANDOM, 2, foundation::AC_N },
+	};
+
+	size_t regressions = 0;
+	for (const workload& w : workloads)
+	{
+		// Sorted keys make a chain, and a chain is quadratic to build: keep those sizes small
+		size_t top = w.m_order == KEYS_SORTED ? std::min<size_t>(n, 16000) : n;
+		size_t from = std::max<size_t>(top / 32, 1);
+
+		auto run = [&](size_t size, foundation::acomplexity_timer& timer) -> foundation::acount_t
+		{
+			foundation::node_arena<ops_t::mnode> arena;
+			foundation::arena_scope<ops_t::mnode> scope(arena);
+			std::vector<long> keys = make_keys(size, w.m_order);
+
+			if (w.m_what == 0) {
+				counter.clear_counter();
+				timer.start();
+				build_bst<ops_t, counted_t>(keys);
+				timer.stop();
+				return nodes_visited();
+			}
+
+			node_handle root = build_bst<ops_t>(keys);
+			counter.clear_counter();
+			timer.start();
+			if (w.m_what == 1) {
+				lookup_all<ops_t, counted_t>(root, keys);
+			}
+			else {
+				dstruct::ttraversal::child_order_tr<ops_t, foundation::check_default, counted_t> trav(root);
+				while (trav.depth() >= 0) {
+					trav.next();
+				}
+			}
+			timer.stop();
+			return nodes_visited();
+		};
+
+		std::vector<foundation::acomplexity_sample> samples = foundation::complexity_sweep(from, top, 2.0, run);
+		foundation::acomplexity_verdict verdict = foundation::judge_complexity(samples, w.m_expected);
+		foundation::report_complexity(std::cout, w.m_label, samples, verdict);
+		regressions += verdict.regressed();
+	}
+	std::cout << regressions << " regression(s)" << std::endl;
+}
+
+bool bench::run_benchmark(const char* name, size_t n)
+{
+	if (strcmp(name, "arena") == 0) {
+		bench_arena(n);
+		return true;
+	}
+	if (strcmp(name, "compact") == 0) {
+		bench_compact(n);
+		return true;
+	}
+	if (strcmp(name, "bulk") == 0) {
+		bench_bulk(n);
+		return true;
+	}
+	if (strcmp(name, "balanced") == 0) {
+		bench_balanced(n);
+		return true;
+	}
+	if (strcmp(name, "concurrent") == 0) {
+		bench_concurrent(n);
+		return true;
+	}
+	if (strcmp(name, "parallel") == 0) {
+		bench_parallel(n);
+		return true;
+	}
+	if (strcmp(name, "stackless") == 0) {
+		bench_stackless(n);
+		return true;
+	}
+	if (strcmp(name, "ranges") == 0) {
+		bench_ranges(n);
+		return true;
+	}
+	if (strcmp(name, "levels") == 0) {
+		bench_levels(n);
+		return true;
+	}
+	if (strcmp(name, "checks") == 0) {
+		bench_checks(n);
+		return true;
+	}
+	if (strcmp(name, "percentile") == 0) {
+		bench_percentile(n);
+		return true;
+	}
+	if (strcmp(name, "frozen") == 0) {
+		bench_frozen(n);
+		return true;
+	}
+	if (strcmp(name, "wide") == 0) {
+		bench_wide(n);
+		return true;
+	}
+	if (strcmp(name, "batch") == 0) {
+		bench_batch(n);
+		return true;
+	}
+	if (strcmp(name, "scan") == 0) {
+		bench_scan(n);
+		return true;
+	}
+	if (strcmp(name, "snapshot") == 0) {
+		bench_snapshot(n);
+		return true;
+	}
+	if (strcmp(name, "lisp") == 0) {
+		bench_lisp(n);
+		return true;
+	}
+	if (strcmp(name, "counters") == 0) {
+		bench_counters(n);
+		return true;
+	}
+	if (strcmp(name, "instrumented") == 0) {
+		bench_instrumented(n);
+		return true;
+	}
+	if (strcmp(name, "recursion") == 0) {
+		bench_recursion(n);
+		return true;
+	}
+	if (strcmp(name, "instrument") == 0) {
+		bench_instrument(n);
+		return true;
+	}
+	if (strcmp(name, "perf") == 0) {
+		bench_perf(n);
+		return true;
+	}
+	if (strcmp(name, "complexity") == 0) {
+		bench_complexity(n);
+		return true;
+	}
+	return false;
+}
@@ -0,0 +1,81 @@
+#ifndef _IA_BENCHMARKS_H_
+#define _IA_BENCHMARKS_H_
+
+#include <cstddef>
+
+namespace bench
+{
+	// Node allocation: new/delete against the slab arena
+	void bench_arena(size_t n);
+
+	// Memory per node and lookup time: 32-bit index nodes against pointer nodes
+	void bench_compact(size_t n);
+
+	// Balanced bulk load against key-by-key construct_at_end, on random and sorted keys
+	void bench_bulk(size_t n);
+
+	// Worst case for the plain BST: AVL insert against construct_at_end on sorted keys
+	void bench_balanced(size_t n);
+
+	// Lock-free readers searching a tp_multi_thread tree, with and without a writer inserting
+	void bench_concurrent(size_t n);
+
+	// A full-tree reduction: child_order_tr against parallel_reduce at 1, 2, 4... threads
+	void bench_parallel(size_t n);
+
+	// Walking a tree with an explicit stack (child_order_tr) against the parent edges (parent_order_tr)
+	void bench_stackless(size_t n);
+
+	// Summing a tree through the range adaptors against a hand-written child_order_tr loop
+	void bench_ranges(size_t n);
+
+	// Level-order walks, with and without prefetching the frontier, against child_order_tr
+	void bench_levels(size_t n);
+
+	// Traversal throughput under check_none, check_sequence and check_strict
+	void bench_checks(size_t n);
+
+	// Percentile queries: select on a size-augmented tree against counting along an in-order walk
+	void bench_percentile(size_t n);
+
+	// Lookups in a frozen tree (Eytzinger and vEB layouts) against the pointer tree, from 1000 keys up to n
+	void bench_frozen(size_t n);
+
+	// A B-tree with cache-line nodes against the binary BST: build by insertion, lookups, height
+	void bench_wide(size_t n);
+
+	// Lookups run a batch at a time (linear_search_batch) against one linear_tr after another
+	void bench_batch(size_t n);
+
+	// Range scans (key_range, key_scan chunks) against an in-order walk from the first key
+	void bench_scan(size_t n);
+
+	// Saving a tree as a snapshot and opening it mapped, against rebuilding it from its keys
+	void bench_snapshot(size_t n);
+
+	// Writing a tree as LISP text through print_node and through a text_buffer, and reading it back
+	void bench_lisp(size_t n);
+
+	// Counting from many threads: one shared atomic against acounter_sharded, with a sampler running
+	void bench_counters(size_t n);
+
+	// Lookups that count their steps: no counter, a view through a runtime map, a view through a static map
+	void bench_instrumented(size_t n);
+
+	// Profiling a recursion of n calls with arecursion_tree_builder: levels only, the whole tree, folded stacks
+	void bench_recursion(size_t n);
+
+	// Lookups and a walk under instrument_none and instrument_counter, with the per-operation report
+	void bench_instrument(size_t n);
+
+	// Hardware counts (perf events) per lookup and per node walked, for heap, arena and compact nodes
+	void bench_perf(size_t n);
+
+	// Complexity fits of construct_at_end (random and sorted keys), lookups and a walk, swept up to n
+	void bench_complexity(size_t n);
+
+	// Run a benchmark by name; false if there is no such benchmark
+	bool run_benchmark(const char* name, size_t n);
+}
+
+#endif
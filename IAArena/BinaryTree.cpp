@@ -1,19 +1,17 @@
 
 #include <iostream>
 #include "BinaryTree.h"
+#include "BalancedTree.h"
+#include "AugmentedTree.h"
 
-template<typename ThreadPolicy>
-void dstruct::bin_tree_sample::ops<ThreadPolicy>::print_node(std::ostream& os, node<ThreadPolicy>* n)
-{
-	os << n->m_key;
-}
-
-template<typename ThreadPolicy>
+template<typename ThreadPolicy, typename AllocPolicy>
 void dstruct::bin_tree_sample::add_to_bst(long key, dstruct::bin_tree_sample::node<ThreadPolicy>*& in_out_root,
 	dstruct::bin_tree_sample::node<ThreadPolicy>*& out_node)
 {
+	using mnode = node<ThreadPolicy>;
+
 	// Need to add a node and find its parent.
-	out_node = new node();
+	out_node = ops<ThreadPolicy, AllocPolicy>::create_free_node();
 	out_node->m_edges[0] = out_node->m_edges[1] = nullptr;
 	out_node->m_key = key;
 
@@ -23,14 +21,14 @@ void dstruct::bin_tree_sample::add_to_bst(long key, dstruct::bin_tree_sample::no
 	}
 
 	// Otherwise find the parent
-	node* parent = in_out_root;
+	mnode* parent = in_out_root;
 	bool findpl = true;
 
 	ichild dir = CHILD_FINAL;
 	while (true) {
 		dir = key <= parent->m_key ? CHILD_LEFT : CHILD_RIGHT;
 
-		node* next_parent = parent->m_edges[dir];
+		mnode* next_parent = parent->m_edges[dir];
 		findpl = next_parent != nullptr;
 
 		if (findpl) {
@@ -45,4 +43,19 @@ void dstruct::bin_tree_sample::add_to_bst(long key, dstruct::bin_tree_sample::no
 	// done
 }
 
-template struct dstruct::bin_tree_sample::ops<foundation::tp_single_thread>;
\ No newline at end of file
+template struct dstruct::bin_tree_sample::ops<foundation::tp_single_thread>;
+template struct dstruct::bin_tree_sample::ops<foundation::tp_single_thread, foundation::ap_arena>;
+template struct dstruct::bin_tree_sample::ops<foundation::tp_multi_thread>;
+template struct dstruct::bin_tree_sample::ops<foundation::tp_single_thread, foundation::ap_heap,
+	dstruct::avl_tree::node<foundation::tp_single_thread> >;
+template struct dstruct::bin_tree_sample::ops<foundation::tp_single_thread, foundation::ap_arena,
+	dstruct::avl_tree::node<foundation::tp_single_thread> >;
+template struct dstruct::bin_tree_sample::ops<foundation::tp_single_thread, foundation::ap_heap,
+	dstruct::aug_tree::node<foundation::tp_single_thread> >;
+template struct dstruct::bin_tree_sample::ops<foundation::tp_single_thread, foundation::ap_arena,
+	dstruct::aug_tree::node<foundation::tp_single_thread> >;
+
+template void dstruct::bin_tree_sample::add_to_bst<foundation::tp_single_thread>(long,
+	dstruct::bin_tree_sample::node<foundation::tp_single_thread>*&, dstruct::bin_tree_sample::node<foundation::tp_single_thread>*&);
+template void dstruct::bin_tree_sample::add_to_bst<foundation::tp_single_thread, foundation::ap_arena>(long,
+	dstruct::bin_tree_sample::node<foundation::tp_single_thread>*&, dstruct::bin_tree_sample::node<foundation::tp_single_thread>*&);
@@ -1,11 +1,14 @@
-#ifndef _IA_BINARY_TREE_H_F
+#ifndef _IA_BINARY_TREE_H_
 #define _IA_BINARY_TREE_H_
 
-#include <iosfwd>
+#include <ostream>
 #include <atomic>
 #include "FError.h"
 #include "TraversalIface.h"
 #include "ThreadPolicy.h"
+#include "CheckPolicy.h"
+#include "NodeAllocator.h"
+#include "Prefetch.h"
 
 namespace dstruct
 {
@@ -30,8 +33,9 @@ namespace dstruct
 		struct node
 		{
 			using sequence_t = typename foundation::atomique<ThreadPolicy,unsigned long>::type;
+			using edge_t = typename foundation::atomique<ThreadPolicy, node*>::type;
 			long m_key;
-			node* m_edges[3];  // three -- left-child, right-child, parent
+			edge_t m_edges[3];  // three -- left-child, right-child, parent
 			sequence_t m_sequence;
 
 			node()
@@ -42,17 +46,31 @@ namespace dstruct
 			}
 		};
 
-		template<typename ThreadPolicy = foundation::tp_single_thread>
+		// AllocPolicy decides where create_free_node gets its nodes (see NodeAllocator.h).
+		// Node may be any struct laid out like node (m_key, m_edges, m_sequence) with extra fields.
+		// Check decides what is verified, here and in the traversers (see CheckPolicy.h).
+		template<typename ThreadPolicy = foundation::tp_single_thread,
+			typename AllocPolicy = foundation::ap_heap,
+			typename Node = node<ThreadPolicy>,
+			typename Check = foundation::check_default>
 		struct ops
 		{
-			using mnode = node<ThreadPolicy>;
+			using mnode = Node;
+			using alloc_policy = AllocPolicy;
+			using check_policy = Check;
 			using node_handle = mnode*;
 			using node_index = ichild;
 			using node_label = ilabel;
-			using sequence = typename mnode::sequence_t;
+			using key_type = long;
+			using sequence = typename foundation::atomique_value<typename mnode::sequence_t>::type;
+
+			// Under tp_multi_thread readers validate what they read against the node's seqlock
+			static const bool sm_concurrent = ThreadPolicy::sm_concurrent;
 
 			static const ilabel sm_parent_lbl = LABEL_PARENT;
 			static const ilabel sm_invalid_lbl = LABEL_INVALID;
+			static const ilabel sm_left_lbl = LABEL_LEFT;  // for BST-specific code
+			static const ilabel sm_right_lbl = LABEL_RIGHT;
 
 			static inline void check_label(ilabel lbl, const char* context)
 			{
@@ -68,6 +86,13 @@ namespace dstruct
 			static inline bool is_index_pre(mnode*, ichild idx) { return idx == CHILD_PRE; }
 			static inline sequence get_seq(mnode* n) { return n->m_sequence; }
 
+			// Optimistic reads: anything read from n between these two is good if read_validate holds
+			static inline sequence read_begin(mnode* n) { return ThreadPolicy::read_begin(n->m_sequence); }
+			static inline bool read_validate(mnode* n, sequence s) { return ThreadPolicy::read_validate(n->m_sequence, s); }
+
+			static inline long get_key(mnode* n) { return n->m_key; }
+			static inline void set_key(mnode* n, long k) { n->m_key = k; }
+
 			static inline bool is_index_first(mnode* n, ichild idx) {
 				if (n->m_edges[CHILD_LEFT]) {
 					return idx == CHILD_LEFT;
@@ -118,17 +143,18 @@ namespace dstruct
 				case CHILD_PRE: return CHILD_LEFT;
 				case CHILD_LEFT: return CHILD_RIGHT;
 				case CHILD_RIGHT: return CHILD_FINAL;
+				case CHILD_FINAL: break;  // nothing comes after it
 				}
 				return CHILD_FINAL;
 			}
 			
 			static inline void increment_index(mnode* n, ichild& idx)
 			{
-#ifdef _STRICT_CHECKS
-				if (idx >= CHILD_FINAL) {
-					throw foundation::foundation_exception("bintree ops increment index-- index too large.");
+				if (Check::sm_strict) {
+					if (idx >= CHILD_FINAL) {
+						throw foundation::foundation_exception("bintree ops increment index-- index too large.");
+					}
 				}
-#endif
 				// (1) Get the next value
 				idx = get_next_index(idx);
 
@@ -138,12 +164,39 @@ namespace dstruct
 				}
 			}
 
+			static inline ichild get_prev_index(ichild c)
+			{
+				switch (c) {
+				case CHILD_FINAL: return CHILD_RIGHT;
+				case CHILD_RIGHT: return CHILD_LEFT;
+				case CHILD_LEFT: return CHILD_PRE;
+				case CHILD_PRE: break;  // nothing comes before it
+				}
+				return CHILD_PRE;
+			}
+
+			// The way back: the previous child there is, or CHILD_PRE.  From CHILD_FINAL, the last child.
+			static inline void decrement_index(mnode* n, ichild& idx)
+			{
+				if (Check::sm_strict) {
+					if (idx <= CHILD_PRE) {
+						throw foundation::foundation_exception("bintree ops decrement index-- index too small.");
+					}
+				}
+				idx = get_prev_index(idx);
+
+				while (idx != CHILD_PRE && n->m_edges[idx] == nullptr)
+				{
+					idx = get_prev_index(idx);
+				}
+			}
+
 			// This function is used when we need to peek a mnode without getting it
 			static inline EExists peek_node_labeled(mnode* n, ilabel label)
 			{
-#ifdef _STRICT_CHECKS
-				check_label(label, "peek_node_labeled");
-#endif
+				if (Check::sm_strict) {
+					check_label(label, "peek_node_labeled");
+				}
 				return n->m_edges[label] != nullptr ? EXISTS : UNEXISTS;
 			}
 
@@ -151,32 +204,44 @@ namespace dstruct
 			static inline mnode* get_node_labeled(mnode* n, ilabel lbl)
 			{
 				// TODO: Use perfect forwarding to wrap these checks
-#ifdef _STRICT_CHECKS
-				check_label(lbl, "get_node_labeled");
-#endif
+				if (Check::sm_strict) {
+					check_label(lbl, "get_node_labeled");
+				}
 				return n->m_edges[lbl];
 			}
 
 			static inline mnode* get_node_at_index(mnode* n, ichild idx)
 			{
-#ifdef _STRICT_CHECKS
-				if (idx != CHILD_LEFT && idx != CHILD_RIGHT) {
-					throw foundation::foundation_exception("index invalid.", "bintree_ops::get_node_at_index");
+				if (Check::sm_strict) {
+					if (idx != CHILD_LEFT && idx != CHILD_RIGHT) {
+						throw foundation::foundation_exception("index invalid.", "bintree_ops::get_node_at_index");
+					}
 				}
-#endif
 				return n->m_edges[idx];
 			}
 
 			static inline mnode* create_free_node()
 			{
-				return new mnode();
+				return AllocPolicy::template create<mnode>();
+			}
+
+			// Give back a node that is no longer attached to anything
+			static inline void recycle_node(mnode* n)
+			{
+				AllocPolicy::template recycle<mnode>(n);
+			}
+
+			// Hint that the next n nodes should come from one block
+			static inline void reserve_nodes(size_t n)
+			{
+				AllocPolicy::template reserve<mnode>(n);
 			}
 
 			static inline mnode* detach_node(mnode* n, ilabel lbl)
 			{
-#ifdef _STRICT_CHECKS
-				check_label(lbl, "detach_node");
-#endif
+				if (Check::sm_strict) {
+					check_label(lbl, "detach_node");
+				}
 
 				// Determine who is the child and who is the parent
 				mnode* p = nullptr;
@@ -205,30 +270,32 @@ namespace dstruct
 					lbl_detach = lbl;
 				}
 
-#ifdef _STRICT_CHECKS
-				// Neither p nor c can be null
-				if (p == nullptr) {
-					throw foundation::foundation_exception("detaching nonexistent parent node", "bintree_ops::detach_node");
-				}
+				if (Check::sm_strict) {
+					// Neither p nor c can be null
+					if (p == nullptr) {
+						throw foundation::foundation_exception("detaching nonexistent parent node", "bintree_ops::detach_node");
+					}
 
-				if (c == nullptr) {
-					throw foundation::foundation_exception("detaching nonexistent child node", "bintree_ops::detach_node");
+					if (c == nullptr) {
+						throw foundation::foundation_exception("detaching nonexistent child node", "bintree_ops::detach_node");
+					}
 				}
-#endif
 
 				/* We have a problem.  Detaching a node affects two nodes.
 				How can the sequence numbers be kept up to date at once?  They can't.
-				So we cheat and increment them before we do anything.
-				There is still of course a possibility, though eternally slim,
-				that the wrong value will be registered if anyone tries to read the node.
-				Fail-fast ought to be the rule.
+				So we open both of them for writing before we do anything, and close them after.
+				Under tp_multi_thread this is a seqlock, and a reader that overlaps us retries.
+				Single-threaded, it is a counter, and fail-fast ought to be the rule.
 				*/
-				p->m_sequence++;
-				c->m_sequence++;
+				ThreadPolicy::write_begin(p->m_sequence);
+				ThreadPolicy::write_begin(c->m_sequence);
 
 				// Detach
 				p->m_edges[lbl_detach] = nullptr;
 				c->m_edges[LABEL_PARENT] = nullptr;
+
+				ThreadPolicy::write_end(c->m_sequence);
+				ThreadPolicy::write_end(p->m_sequence);
 	
 				return r_node;
 			}
@@ -236,9 +303,9 @@ namespace dstruct
 			static inline void attach_node(mnode* to, ilabel lbl, mnode* n)
 			{
 
-#ifdef _STRICT_CHECKS
-				check_label(lbl, "attach_node");
-#endif
+				if (Check::sm_strict) {
+					check_label(lbl, "attach_node");
+				}
 				// Assign relationships
 				mnode* p = nullptr;
 				mnode* c = nullptr;
@@ -256,20 +323,20 @@ namespace dstruct
 				}
 
 				// Child cannot have any parents
-#ifdef _STRICT_CHECKS
-				if (c->m_edges[LABEL_PARENT]) 
-				{
-					throw foundation::foundation_exception("attaching an attached node",
-						"binary_tree_ops::attach_node");
+				if (Check::sm_strict) {
+					if (c->m_edges[LABEL_PARENT]) 
+					{
+						throw foundation::foundation_exception("attaching an attached node",
+							"binary_tree_ops::attach_node");
+					}
 				}
-#endif
 				// Try to deduce lbl_insert if it is indeterminate
 				if (p->m_edges[LABEL_LEFT]) {
 					if (p->m_edges[LABEL_RIGHT]) {
-#ifdef _STRICT_CHECKS
-						throw foundation::foundation_exception("nowhere to attach node",
-							"binary_tree_ops::attach_node");
-#endif
+						if (Check::sm_strict) {
+							throw foundation::foundation_exception("nowhere to attach node",
+								"binary_tree_ops::attach_node");
+						}
 					}
 					else {
 						if (lbl_insert == LABEL_INVALID)
@@ -287,12 +354,27 @@ namespace dstruct
 				}
 				
 				// Sequence numbers: as above
-				p->m_sequence++;
-				c->m_sequence++;  // as is proper
+				ThreadPolicy::write_begin(p->m_sequence);
+				ThreadPolicy::write_begin(c->m_sequence);  // as is proper
 
-				// Attach
-				p->m_edges[lbl_insert] = c;
+				// Attach.  c must be complete by now: this store publishes it
 				c->m_edges[LABEL_PARENT] = p;
+				p->m_edges[lbl_insert] = c;
+
+				ThreadPolicy::write_end(c->m_sequence);
+				ThreadPolicy::write_end(p->m_sequence);
+			}
+
+			// Start loading a node that will be needed soon
+			static inline void prefetch_node(mnode* n)
+			{
+				foundation::prefetch(n);
+			}
+
+			// The index of child c within its parent p
+			static inline ichild get_child_index(mnode* p, mnode* c)
+			{
+				return p->m_edges[LABEL_LEFT] == c ? CHILD_LEFT : CHILD_RIGHT;
 			}
 
 			// Must be defined
@@ -319,11 +401,14 @@ namespace dstruct
 			{
 				to = from;
 			}
-			static void print_node(std::ostream& os, mnode* n);
+			static void print_node(std::ostream& os, mnode* n)
+			{
+				os << n->m_key;
+			}
 		};
 
 		// Build this up as a BST
-		template<class ThreadPolicy>
+		template<class ThreadPolicy, class AllocPolicy = foundation::ap_heap>
 		void add_to_bst(long key, node<ThreadPolicy>*& in_out_root, node<ThreadPolicy>*& out_node);
 
 	}
@@ -0,0 +1,43 @@
+#ifndef _IA_CHECK_POLICY_H_
+#define _IA_CHECK_POLICY_H_
+
+#include "FError.h"
+
+namespace foundation
+{
+	/* A check policy says how much a tree's ops and traversers verify as they go.
+		check_none		nothing: no sequence numbers are read, no arguments are looked at
+		check_sequence	traversers fail fast when a node they are walking is changed under them
+		check_strict	that, plus the structural checks in the ops (labels, indices, attaching
+						an attached node...) and in the traversers (parent edges that lead back)
+
+		The policy is a type, so each tree picks its own and what it does not ask for is not
+		compiled in.  check_default keeps the old behaviour: strict in a _DEBUG build, sequence
+		checks otherwise. */
+
+	struct check_none
+	{
+		static const bool sm_sequence = false;
+		static const bool sm_strict = false;
+	};
+
+	struct check_sequence
+	{
+		static const bool sm_sequence = true;
+		static const bool sm_strict = false;
+	};
+
+	struct check_strict
+	{
+		static const bool sm_sequence = true;
+		static const bool sm_strict = true;
+	};
+
+#ifdef _STRICT_CHECKS
+	using check_default = check_strict;
+#else
+	using check_default = check_sequence;
+#endif
+}
+
+#endif
@@ -0,0 +1,6 @@
+
+#include <iostream>
+#include "CompactTree.h"
+
+template struct dstruct::compact_tree::ops<long>;
+template struct dstruct::compact_tree::ops<int>;
@@ -0,0 +1,467 @@
+#ifndef _IA_COMPACT_TREE_H_
+#define _IA_COMPACT_TREE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+#include "FError.h"
+#include "TraversalIface.h"
+#include "ThreadPolicy.h"
+#include "CheckPolicy.h"
+#include "ContextBinding.h"
+#include "Prefetch.h"
+#include "BinaryTree.h"
+
+namespace dstruct
+{
+	/* The same binary tree as bin_tree_sample, but the nodes live in one contiguous array
+	   and refer to each other by 32-bit indices rather than pointers.  A node with a long key
+	   takes 24 bytes instead of 40, and handles are 4 bytes, so traversal stacks shrink too.
+
+	   The array belongs to a node_pool.  Since the ops are static, they find the pool through
+	   a context_binding: bind the pool on the thread before touching the tree. */
+
+	namespace compact_tree
+	{
+		using bin_tree_sample::ichild;
+		using bin_tree_sample::ilabel;
+		using bin_tree_sample::CHILD_PRE;
+		using bin_tree_sample::CHILD_LEFT;
+		using bin_tree_sample::CHILD_RIGHT;
+		using bin_tree_sample::CHILD_FINAL;
+		using bin_tree_sample::LABEL_INVALID;
+		using bin_tree_sample::LABEL_LEFT;
+		using bin_tree_sample::LABEL_RIGHT;
+		using bin_tree_sample::LABEL_PARENT;
+
+		using cindex = std::uint32_t;
+		static const cindex NIL = 0;  // slot 0 of every pool is never handed out
+
+		// A node handle is an index that behaves like a pointer: it compares with nullptr and tests as bool
+		struct handle
+		{
+			cindex m_idx;
+
+			handle() :m_idx(NIL) { }
+			handle(std::nullptr_t) :m_idx(NIL) { }
+			explicit handle(cindex idx) :m_idx(idx) { }
+
+			explicit operator bool() const { return m_idx != NIL; }
+
+			friend bool operator == (handle l, handle r) { return l.m_idx == r.m_idx; }
+			friend bool operator != (handle l, handle r) { return l.m_idx != r.m_idx; }
+		};
+
+		template<typename Key = long, typename ThreadPolicy = foundation::tp_single_thread>
+		struct node
+		{
+			using sequence_t = typename foundation::atomique<ThreadPolicy, std::uint32_t>::type;
+			Key m_key;
+			cindex m_edges[3];  // left-child, right-child, parent
+			sequence_t m_sequence;
+
+			node()
+				:m_key(0),
+				m_sequence(0)
+			{
+				m_edges[LABEL_LEFT] = m_edges[LABEL_RIGHT] = m_edges[LABEL_PARENT] = NIL;
+			}
+		};
+
+		// The contiguous array of nodes and the list of recycled slots
+		template<typename Node>
+		class node_pool
+		{
+		public:
+			explicit node_pool(size_t reserve_nodes = 0)
+				:m_reserved(0)
+			{
+				m_nodes.reserve(reserve_nodes + 1);
+				m_nodes.emplace_back();  // NIL
+			}
+
+			node_pool(const node_pool&) = delete;
+			node_pool& operator = (const node_pool&) = delete;
+
+			inline cindex allocate()
+			{
+				if (!m_reserved && !m_free.empty()) {
+					cindex idx = m_free.back();
+					m_free.pop_back();
+					m_nodes[idx] = Node();
+					return idx;
+				}
+
+				if (m_nodes.size() > (size_t)UINT32_MAX) {
+					throw foundation::foundation_exception("pool exhausted", "compact_tree::node_pool::allocate");
+				}
+
+				if (m_reserved) {
+					m_reserved--;  // reserve() made the room
+				}
+				m_nodes.emplace_back();
+				return (cindex)(m_nodes.size() - 1);
+			}
+
+			inline void recycle(cindex idx) { m_free.push_back(idx); }
+
+			inline Node& at(cindex idx) { return m_nodes[idx]; }
+
+			// Make room for n more nodes at the end, and hand out the next n from there, not from the recycled slots
+			void reserve(size_t n)
+			{
+				m_nodes.reserve(m_nodes.size() + n);
+				m_reserved = n;
+			}
+
+			// Drop every tree in the pool at once
+			void clear()
+			{
+				m_nodes.resize(1);
+				m_free.clear();
+				m_reserved = 0;
+			}
+
+			size_t size() const { return m_nodes.size() - 1 - m_free.size(); }
+		private:
+			std::vector<Node> m_nodes;
+			std::vector<cindex> m_free;
+			size_t m_reserved;  // nodes still to come from the end, whatever is on the free list
+		};
+
+		template<typename Key = long, typename ThreadPolicy = foundation::tp_single_thread,
+			typename Check = foundation::check_default>
+		struct ops
+		{
+			using mnode = node<Key, ThreadPolicy>;
+			using check_policy = Check;
+			using node_handle = handle;
+			using node_index = ichild;
+			using node_label = ilabel;
+			using key_type = Key;
+			using sequence = typename foundation::atomique_value<typename mnode::sequence_t>::type;
+			using pool = node_pool<mnode>;
+			using binding = foundation::context_binding<pool>;
+
+			// The pool may move when it grows, so a compact tree is never read while it is written
+			static const bool sm_concurrent = false;
+
+			static const ilabel sm_parent_lbl = LABEL_PARENT;
+			static const ilabel sm_invalid_lbl = LABEL_INVALID;
+			static const ilabel sm_left_lbl = LABEL_LEFT;  // for BST-specific code
+			static const ilabel sm_right_lbl = LABEL_RIGHT;
+
+			static inline void check_label(ilabel lbl, const char* context)
+			{
+				if (lbl != LABEL_LEFT && lbl != LABEL_RIGHT && lbl != LABEL_PARENT)
+				{
+					std::string exc_c("compact_tree_ops::");
+					exc_c.append(context);
+					throw foundation::foundation_exception("label not valid", exc_c.c_str());
+				}
+			}
+
+			// The node behind a handle, in the pool bound on this thread
+			static inline mnode& at(handle h)
+			{
+				if (Check::sm_strict) {
+					if (binding::current() == nullptr) {
+						throw foundation::foundation_exception("no pool bound on this thread", "compact_tree_ops::at");
+					}
+				}
+				return binding::current()->at(h.m_idx);
+			}
+
+			static inline handle edge(handle h, int e) { return handle(at(h).m_edges[e]); }
+
+			static inline bool is_null(handle n) { return n.m_idx == NIL; }
+			static inline bool is_index_pre(handle, ichild idx) { return idx == CHILD_PRE; }
+			static inline sequence get_seq(handle n) { return at(n).m_sequence; }
+
+			static inline sequence read_begin(handle n) { return at(n).m_sequence; }
+			static inline bool read_validate(handle, sequence) { return true; }
+
+			static inline Key get_key(handle n) { return at(n).m_key; }
+			static inline void set_key(handle n, Key k) { at(n).m_key = k; }
+
+			static inline bool is_index_first(handle n, ichild idx) {
+				const mnode& nd = at(n);
+				if (nd.m_edges[CHILD_LEFT] != NIL) {
+					return idx == CHILD_LEFT;
+				}
+				else if (nd.m_edges[CHILD_RIGHT] != NIL) {
+					return idx == CHILD_RIGHT;
+				}
+				// No first child in a childless tree
+				return false;
+			}
+
+			static inline bool is_index_post(handle n, ichild idx) {
+				const mnode& nd = at(n);
+				if (nd.m_edges[CHILD_RIGHT] != NIL) {
+					return idx == CHILD_RIGHT;
+				}
+				else if (nd.m_edges[CHILD_LEFT] != NIL) {
+					return idx == CHILD_LEFT;
+				}
+				return idx == CHILD_PRE;
+			}
+
+			static inline bool is_index_final(handle, ichild idx)
+			{
+				return idx == CHILD_FINAL;
+			}
+
+			static inline bool is_leaf(handle n)
+			{
+				const mnode& nd = at(n);
+				return nd.m_edges[CHILD_LEFT] == NIL
+					&& nd.m_edges[CHILD_RIGHT] == NIL;
+			}
+
+			static inline int tree_depth(handle n) { return 0; }
+
+			static inline void init_child_index(handle n, ichild& idx)
+			{
+				idx = CHILD_PRE;
+			}
+
+			static inline ichild get_next_index(ichild c)
+			{
+				switch (c) {
+				case CHILD_PRE: return CHILD_LEFT;
+				case CHILD_LEFT: return CHILD_RIGHT;
+				default: return CHILD_FINAL;
+				}
+			}
+
+			static inline void increment_index(handle n, ichild& idx)
+			{
+				if (Check::sm_strict) {
+					if (idx >= CHILD_FINAL) {
+						throw foundation::foundation_exception("compact ops increment index-- index too large.");
+					}
+				}
+				const mnode& nd = at(n);
+				idx = get_next_index(idx);
+
+				while (idx != CHILD_FINAL && nd.m_edges[idx] == NIL)
+				{
+					idx = get_next_index(idx);
+				}
+			}
+
+			static inline ichild get_prev_index(ichild c)
+			{
+				switch (c) {
+				case CHILD_FINAL: return CHILD_RIGHT;
+				case CHILD_RIGHT: return CHILD_LEFT;
+				default: return CHILD_PRE;
+				}
+			}
+
+			// The previous child there is, or CHILD_PRE.  From CHILD_FINAL, the last child.
+			static inline void decrement_index(handle n, ichild& idx)
+			{
+				if (Check::sm_strict) {
+					if (idx <= CHILD_PRE) {
+						throw foundation::foundation_exception("compact ops decrement index-- index too small.");
+					}
+				}
+				const mnode& nd = at(n);
+				idx = get_prev_index(idx);
+
+				while (idx != CHILD_PRE && nd.m_edges[idx] == NIL)
+				{
+					idx = get_prev_index(idx);
+				}
+			}
+
+			static inline EExists peek_node_labeled(handle n, ilabel label)
+			{
+				if (Check::sm_strict) {
+					check_label(label, "peek_node_labeled");
+				}
+				return at(n).m_edges[label] != NIL ? EXISTS : UNEXISTS;
+			}
+
+			static inline handle get_node_labeled(handle n, ilabel lbl)
+			{
+				if (Check::sm_strict) {
+					check_label(lbl, "get_node_labeled");
+				}
+				return edge(n, lbl);
+			}
+
+			static inline handle get_node_at_index(handle n, ichild idx)
+			{
+				if (Check::sm_strict) {
+					if (idx != CHILD_LEFT && idx != CHILD_RIGHT) {
+						throw foundation::foundation_exception("index invalid.", "compact_tree_ops::get_node_at_index");
+					}
+				}
+				return edge(n, idx);
+			}
+
+			static inline handle create_free_node()
+			{
+				return handle(binding::current()->allocate());
+			}
+
+			static inline void recycle_node(handle n)
+			{
+				binding::current()->recycle(n.m_idx);
+			}
+
+			static inline void reserve_nodes(size_t n)
+			{
+				binding::current()->reserve(n);
+			}
+
+			static inline handle detach_node(handle n, ilabel lbl)
+			{
+				if (Check::sm_strict) {
+					check_label(lbl, "detach_node");
+				}
+				cindex p = NIL;
+				cindex c = NIL;
+				ilabel lbl_detach = LABEL_INVALID;
+				cindex r_node = NIL;
+				if (lbl == LABEL_PARENT)
+				{
+					r_node = p = at(n).m_edges[LABEL_PARENT];
+					c = n.m_idx;
+					lbl_detach = at(handle(p)).m_edges[LABEL_LEFT] == c ? LABEL_LEFT : LABEL_RIGHT;
+				}
+				else
+				{
+					r_node = c = at(n).m_edges[lbl];
+					p = n.m_idx;
+					lbl_detach = lbl;
+				}
+
+				if (Check::sm_strict) {
+					if (p == NIL) {
+						throw foundation::foundation_exception("detaching nonexistent parent node", "compact_tree_ops::detach_node");
+					}
+
+					if (c == NIL) {
+						throw foundation::foundation_exception("detaching nonexistent child node", "compact_tree_ops::detach_node");
+					}
+				}
+				// Sequence numbers: see bin_tree_sample::ops::detach_node
+				mnode& pn = at(handle(p));
+				mnode& cn = at(handle(c));
+				pn.m_sequence++;
+				cn.m_sequence++;
+
+				pn.m_edges[lbl_detach] = NIL;
+				cn.m_edges[LABEL_PARENT] = NIL;
+
+				return handle(r_node);
+			}
+
+			static inline void attach_node(handle to, ilabel lbl, handle n)
+			{
+				if (Check::sm_strict) {
+					check_label(lbl, "attach_node");
+				}
+				handle p;
+				handle c;
+				ilabel lbl_insert = LABEL_INVALID;
+
+				if (lbl == LABEL_PARENT) {
+					p = n;
+					c = to;
+				}
+				else
+				{
+					p = to;
+					c = n;
+					lbl_insert = lbl;
+				}
+
+				mnode& pn = at(p);
+				mnode& cn = at(c);
+				if (Check::sm_strict) {
+					if (cn.m_edges[LABEL_PARENT] != NIL)
+					{
+						throw foundation::foundation_exception("attaching an attached node",
+							"compact_tree_ops::attach_node");
+					}
+				}
+				// Deduce lbl_insert if it is indeterminate, as the pointer ops do
+				if (pn.m_edges[LABEL_LEFT] != NIL) {
+					if (pn.m_edges[LABEL_RIGHT] != NIL) {
+						if (Check::sm_strict) {
+							throw foundation::foundation_exception("nowhere to attach node",
+								"compact_tree_ops::attach_node");
+						}
+					}
+					else if (lbl_insert == LABEL_INVALID) {
+						lbl_insert = LABEL_RIGHT;
+					}
+				}
+				else if (lbl_insert == LABEL_INVALID) {
+					if (pn.m_edges[LABEL_RIGHT] == NIL) {
+						throw foundation::foundation_exception("cannot deduce child label",
+							"compact_tree_ops::attach_node");
+					}
+					else {
+						lbl_insert = LABEL_LEFT;
+					}
+				}
+
+				pn.m_sequence++;
+				cn.m_sequence++;
+
+				pn.m_edges[lbl_insert] = c.m_idx;
+				cn.m_edges[LABEL_PARENT] = p.m_idx;
+			}
+
+			// Start loading a node that will be needed soon
+			static inline void prefetch_node(handle n)
+			{
+				if (!is_null(n)) {
+					foundation::prefetch(&at(n));
+				}
+			}
+
+			// The index of child c within its parent p
+			static inline ichild get_child_index(handle p, handle c)
+			{
+				return at(p).m_edges[LABEL_LEFT] == c.m_idx ? CHILD_LEFT : CHILD_RIGHT;
+			}
+
+			static inline ilabel get_index_label(handle n, ichild idx)
+			{
+				if (idx == CHILD_LEFT) {
+					return LABEL_LEFT;
+				}
+				else if (idx == CHILD_RIGHT) {
+					return LABEL_RIGHT;
+				}
+				else {
+					return LABEL_INVALID;
+				}
+			}
+
+			static void copy_index(ichild& to, ichild& from)
+			{
+				to = from;
+			}
+
+			static void move_index(ichild& to, ichild& from)
+			{
+				to = from;
+			}
+			static void print_node(std::ostream& os, handle n)
+			{
+				os << at(n).m_key;
+			}
+		};
+	}
+}
+
+#endif
@@ -0,0 +1,378 @@
+#ifndef _IA_COMPLEXITY_H_
+#define _IA_COMPLEXITY_H_
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <iomanip>
+#include <ostream>
+#include <utility>
+#include <vector>
+#include "FError.h"
+#include "TAnalytics.h"
+
+namespace foundation
+{
+	/* Empirical complexity.
+		An algorithm is run over a geometric sweep of input sizes, and its step counts and times
+		are compared with the usual models, each an afunction of the input size.
+
+		The class is chosen by growth, not by how well a curve lies on the points: the slope of
+		log y against log n is measured, and the model whose own log-log slope over the same
+		sizes is nearest wins.  Over a sweep of a few doublings n and n log n differ in slope by
+		only about 0.1, and a one-parameter c * f(n) fit is swayed by the lower-order terms and
+		the noise more than by that; the slope is not.  A class is only taken as decided if it is
+		nearer than the runner-up by sm_min_gap of the distance between their slopes; otherwise
+		the sweep cannot tell the two apart.  Each model is also fitted as y = a + c * f(n), by
+		least squares, for the report.
+
+		Given the model the algorithm ought to follow, a worse class is a regression, and is
+		flagged: a construct_at_end that goes quadratic on sorted keys, say. */
+
+	enum acomplexity_class {
+		AC_1,
+		AC_LOG_N,
+		AC_N,
+		AC_N_LOG_N,
+		AC_N_SQUARED,
+		AC_CLASSES
+	};
+
+	inline const char* complexity_name(acomplexity_class c)
+	{
+		static const char* names[AC_CLASSES] = { "O(1)", "O(log n)", "O(n)", "O(n log n)", "O(n^2)" };
+		return c < AC_CLASSES ? names[c] : "?";
+	}
+
+	// The input of a model: the input size
+	class asize_vector : public mvector<double>
+	{
+	public:
+		explicit asize_vector(double n)
+			:m_n(n)
+		{ }
+
+		double operator [] (dim_t dim) const override
+		{
+#ifdef _STRICT_CHECKS
+			if (dim != 0) {
+				throw foundation_exception("asize_vector -- index out of bounds.");
+			}
+#endif
+			return m_n;
+		}
+	private:
+		double m_n;
+	};
+
+	// f(n) for one complexity class
+	class acomplexity_model : public afunction<double, 1>
+	{
+	public:
+		explicit acomplexity_model(acomplexity_class c)
+			:m_class(c)
+		{ }
+
+		bool eval(const mvector<double>* vecm, af_result& result) override
+		{
+			double n = (*vecm)[0];
+			double lg = n > 1.0 ? std::log2(n) : 0.0;
+
+			result.m_type = F_FLOAT;
+			switch (m_class) {
+			case AC_1: result.m_float = 1.0; break;
+			case AC_LOG_N: result.m_float = lg; break;
+			case AC_N: result.m_float = n; break;
+			case AC_N_LOG_N: result.m_float = n * lg; break;
+			case AC_N_SQUARED: result.m_float = n * n; break;
+			default: return false;
+			}
+			return true;
+		}
+
+		acomplexity_class get_class() const { return m_class; }
+	private:
+		acomplexity_class m_class;
+	};
+
+	// One size in a sweep
+	struct acomplexity_sample
+	{
+		size_t m_n;
+		acount_t m_steps;
+		double m_ms;
+	};
+
+	// How one model fits
+	struct acomplexity_fit
+	{
+		acomplexity_class m_class;
+		double m_slope;  // of log f(n) against log n, over the sizes fitted
+		double m_distance;  // from the slope measured on the points
+		double m_intercept;  // a in a + c * f(n)
+		double m_coefficient;  // c in a + c * f(n)
+		double m_rms;  // root mean square of the residuals, over the mean of y: 0 is a perfect fit
+		double m_r2;  // coefficient of determination
+	};
+
+	// The models against some points: the nearest in slope first
+	struct acomplexity_fits
+	{
+		// Of the distance between the two best slopes: a slope a third of the way from one class to the next is still the first
+		static constexpr double sm_min_gap = 0.3;
+
+		double m_slope;  // of log y against log n
+		std::vector<acomplexity_fit> m_fits;
+
+		const acomplexity_fit& best() const { return m_fits.front(); }
+
+		// The best is clearly nearer than the runner-up
+		bool decided() const
+		{
+			if (m_fits.size() < 2) {
+				return true;
+			}
+			const acomplexity_fit& a = m_fits[0];
+			const acomplexity_fit& b = m_fits[1];
+			return b.m_distance - a.m_distance >= sm_min_gap * std::fabs(b.m_slope - a.m_slope);
+		}
+
+		// The simplest class the points could follow: the best, or the simpler of the two best if undecided
+		acomplexity_class lowest() const
+		{
+			return decided() ? m_fits[0].m_class : std::min(m_fits[0].m_class, m_fits[1].m_class);
+		}
+	};
+
+	// Least squares of y = a + b * x; false if x does not vary
+	inline bool fit_line(const std::vector<double>& x, const std::vector<double>& y, double& a, double& b)
+	{
+		double mx = 0.0;
+		double my = 0.0;
+		for (size_t i = 0; i < x.size(); i++) {
+			mx += x[i];
+			my += y[i];
+		}
+		mx /= (double)x.size();
+		my /= (double)y.size();
+
+		double sxx = 0.0;
+		double sxy = 0.0;
+		for (size_t i = 0; i < x.size(); i++) {
+			sxx += (x[i] - mx) * (x[i] - mx);
+			sxy += (x[i] - mx) * (y[i] - my);
+		}
+		if (!(sxx > 0.0)) {
+			a = my;
+			b = 0.0;
+			return false;
+		}
+		b = sxy / sxx;
+		a = my - b * mx;
+		return true;
+	}
+
+	/* Fit y against every model.  Each point is (n, y).  Models that are zero on the points
+		(log n at n = 1) are left out of the slopes; models zero on all of them are skipped.
+		Points with y = 0 are left out of the measured slope; if fewer than two sizes remain,
+		nothing grows, and the slope is 0.  Empty without points. */
+	inline acomplexity_fits fit_complexity(const std::vector<std::pair<double, double> >& points)
+	{
+		acomplexity_fits result;
+		result.m_slope = 0.0;
+		if (points.empty()) {
+			return result;
+		}
+
+		std::vector<double> log_n, log_y;
+		for (const auto& p : points) {
+			if (p.first > 0.0 && p.second > 0.0) {
+				log_n.push_back(std::log(p.first));
+				log_y.push_back(std::log(p.second));
+			}
+		}
+		double unused;
+		if (log_n.size() < 2 || !fit_line(log_n, log_y, unused, result.m_slope)) {
+			result.m_slope = 0.0;
+		}
+
+		double mean = 0.0;
+		for (const auto& p : points) {
+			mean += p.second;
+		}
+		mean /= (double)points.size();
+
+		double ss_tot = 0.0;
+		for (const auto& p : points) {
+			ss_tot += (p.second - mean) * (p.second - mean);
+		}
+
+		std::vector<double> f(points.size());
+		std::vector<double> y(points.size());
+		for (int c = 0; c < AC_CLASSES; c++) {
+			acomplexity_model model((acomplexity_class)c);
+			af_result r;
+
+			std::vector<double> log_f, log_fn;
+			for (size_t i = 0; i < points.size(); i++) {
+				asize_vector n(points[i].first);
+				model.eval(&n, r);
+				f[i] = r.m_float;
+				y[i] = points[i].second;
+				if (f[i] > 0.0 && points[i].first > 0.0) {
+					log_fn.push_back(std::log(points[i].first));
+					log_f.push_back(std::log(f[i]));
+				}
+			}
+			if (log_f.empty()) {
+				continue;
+			}
+
+			acomplexity_fit fit;
+			fit.m_class = (acomplexity_class)c;
+			if (log_f.size() < 2 || !fit_line(log_fn, log_f, unused, fit.m_slope)) {
+				fit.m_slope = 0.0;
+			}
+			fit.m_distance = std::fabs(result.m_slope - fit.m_slope);
+
+			// A constant f leaves nothing for c to do beside a: all of it goes in c
+			if (!fit_line(f, y, fit.m_intercept, fit.m_coefficient)) {
+				fit.m_coefficient = f[0] != 0.0 ? fit.m_intercept / f[0] : 0.0;
+				fit.m_intercept = 0.0;
+			}
+
+			double ss_res = 0.0;
+			for (size_t i = 0; i < points.size(); i++) {
+				double e = y[i] - (fit.m_intercept + fit.m_coefficient * f[i]);
+				ss_res += e * e;
+			}
+			fit.m_rms = mean != 0.0 ? std::sqrt(ss_res / (double)points.size()) / std::fabs(mean) : 0.0;
+			fit.m_r2 = ss_tot > 0.0 ? 1.0 - ss_res / ss_tot : 1.0;
+			result.m_fits.push_back(fit);
+		}
+
+		// Nearest first; on a tie the simpler model
+		std::stable_sort(result.m_fits.begin(), result.m_fits.end(),
+			[](const acomplexity_fit& a, const acomplexity_fit& b) { return a.m_distance < b.m_distance; });
+		return result;
+	}
+
+	/* The time of one run.  A run that sets things up first (keys, a tree to search) starts and
+		stops it around the part being measured, as often as it likes; one that never starts it
+		is timed whole. */
+	class acomplexity_timer
+	{
+	public:
+		acomplexity_timer()
+			:m_ms(0.0),
+			m_used(false)
+		{ }
+
+		void start()
+		{
+			m_used = true;
+			m_start = std::chrono::steady_clock::now();
+		}
+
+		void stop()
+		{
+			m_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_start).count();
+		}
+
+		bool used() const { return m_used; }
+		double elapsed_ms() const { return m_ms; }
+	private:
+		std::chrono::steady_clock::time_point m_start;
+		double m_ms;
+		bool m_used;
+	};
+
+	/* Run run(n, timer) for n = from, from * factor, ... up to to, and time each.  run returns the
+		steps it took, counted however the algorithm counts them (an acounter, an instrument_sink...).
+		The time is the best of repeats. */
+	template<typename Run>
+	std::vector<acomplexity_sample> complexity_sweep(size_t from, size_t to, double factor, Run run, int repeats = 1)
+	{
+		if (from == 0 || factor <= 1.0) {
+			throw foundation_exception("complexity_sweep -- sizes must start above 0 and grow.");
+		}
+
+		std::vector<acomplexity_sample> samples;
+		for (double size = (double)from; size <= (double)to * (1.0 + 1e-9); size *= factor) {
+			size_t n = (size_t)std::llround(size);
+			acomplexity_sample s{n, 0, 0.0};
+			for (int r = 0; r < (repeats > 0 ? repeats : 1); r++) {
+				acomplexity_timer timer;
+				auto start = std::chrono::steady_clock::now();
+				acount_t steps = run(n, timer);
+				double ms = timer.used() ? timer.elapsed_ms()
+					: std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+				if (r == 0 || ms < s.m_ms) {
+					s.m_ms = ms;
+				}
+				s.m_steps = steps;
+			}
+			samples.push_back(s);
+		}
+		return samples;
+	}
+
+	// What a sweep fits, in steps and in time, against what it was expected to
+	struct acomplexity_verdict
+	{
+		acomplexity_fits m_steps;
+		acomplexity_fits m_time;
+		acomplexity_class m_expected;
+
+		/* A worse class than expected, in the steps: they are what the algorithm does, the time is
+			noisier.  Undecided between two classes, it is a regression only if both are worse. */
+		bool regressed() const { return m_steps.lowest() > m_expected; }
+	};
+
+	inline acomplexity_verdict judge_complexity(const std::vector<acomplexity_sample>& samples, acomplexity_class expected)
+	{
+		std::vector<std::pair<double, double> > steps, time;
+		for (const acomplexity_sample& s : samples) {
+			steps.emplace_back((double)s.m_n, (double)s.m_steps);
+			time.emplace_back((double)s.m_n, s.m_ms);
+		}
+
+		acomplexity_verdict v{ fit_complexity(steps), fit_complexity(time), expected };
+		if (v.m_steps.m_fits.empty() || v.m_time.m_fits.empty()) {
+			throw foundation_exception("judge_complexity -- nothing to fit.");
+		}
+		return v;
+	}
+
+	// The class of some fits, or the two it cannot tell apart; with the slope and the best fit's numbers
+	inline void report_fits(std::ostream& os, const acomplexity_fits& fits)
+	{
+		const acomplexity_fit& best = fits.best();
+		os << complexity_name(best.m_class);
+		if (!fits.decided()) {
+			os << " or " << complexity_name(fits.m_fits[1].m_class);
+		}
+		os << " (slope " << fits.m_slope << " against " << best.m_slope << ", rms " << best.m_rms << ", r2 " << best.m_r2 << ")";
+	}
+
+	// The sweep, the fits, and a REGRESSION line if there is one
+	inline void report_complexity(std::ostream& os, const char* label, const std::vector<acomplexity_sample>& samples, const acomplexity_verdict& v)
+	{
+		os << label << std::endl;
+		for (const acomplexity_sample& s : samples) {
+			os << std::setw(12) << s.m_n << std::setw(16) << s.m_steps << " steps" << std::setw(12) << s.m_ms << " ms" << std::endl;
+		}
+		os << "steps ";
+		report_fits(os, v.m_steps);
+		os << ", time ";
+		report_fits(os, v.m_time);
+		os << ", expected " << complexity_name(v.m_expected) << std::endl;
+		if (v.regressed()) {
+			os << "REGRESSION: " << label << " fits " << complexity_name(v.m_steps.lowest())
+				<< ", expected " << complexity_name(v.m_expected) << std::endl;
+		}
+	}
+}
+
+#endif
@@ -1,6 +1,9 @@
 #ifndef _IA_CONSTRUCTION_H_
 #define _IA_CONSTRUCTION_H_
 
+#include <algorithm>
+#include <deque>
+#include <iterator>
 #include <vector>
 #include "FError.h"
 #include "TreeUtils.h"
@@ -38,8 +41,14 @@ namespace dstruct
 			using TO = typename Tr::tree_ops_t;
 			using node_handle = typename TO::node_handle;
 
+			// The node is complete before it is attached, since attaching may publish it to readers
 			node_handle new_node = TO::create_free_node();
+			constructor(new_node);
+
 			if (TO::is_null(n)) {
+				// Still an operation, with nothing to walk
+				typename ttraversal::instrument_policy_of<Tr>::type::op empty_tree;
+				(void)empty_tree;
 				n = new_node;
 			}
 			else {
@@ -48,11 +57,97 @@ namespace dstruct
 				// Go to the end and attach at the arrow
 				while (traverser.next());
 
-				TO::attach_node(traverser.node(0), traverser.get_arrow(), new_node);
+				node_handle parent = traverser.node(0);
+				if (TO::is_null(parent)) {
+					TO::recycle_node(new_node);
+					throw foundation::foundation_exception("the traverser ended off the tree", "construct_at_end");
+				}
+				TO::attach_node(parent, traverser.get_arrow(), new_node);
 				// No need to call refresh_arrow, as we are done
 			}
+		}
 
-			constructor(new_node);
+		/* Bulk construction of a perfectly balanced BST from a batch of keys.
+			The keys are sorted (unless they already are), and each node takes the median of its
+			key range, so the build is O(n) past the sort and no search is ever made.
+
+			The nodes are created in the order given below and the allocator is asked to reserve
+			them in one block first, so that they end up contiguous and in that order. */
+
+		enum bulk_order {
+			BULK_DFS,  // pre-order: a node is followed by its left subtree
+			BULK_BFS   // level order: the upper levels are packed together
+		};
+
+		template<typename TO, typename Iter, typename Cons>
+		typename TO::node_handle construct_balanced(Iter first, Iter last, Cons& constructor, bulk_order order = BULK_DFS)
+		{
+			using node_handle = typename TO::node_handle;
+			using node_label = typename TO::node_label;
+			using key_t = typename std::iterator_traits<Iter>::value_type;
+
+			// A key range waiting for its node
+			struct pending
+			{
+				size_t m_lo;
+				size_t m_hi;  // one past the end
+				node_handle m_parent;
+				node_label m_label;
+			};
+
+			std::vector<key_t> keys(first, last);
+			if (!std::is_sorted(keys.begin(), keys.end())) {
+				std::sort(keys.begin(), keys.end());
+			}
+
+			if (keys.empty()) {
+				return nullptr;
+			}
+
+			TO::reserve_nodes(keys.size());
+
+			// BFS consumes from the front, DFS from the back; a deque gives back what BFS has consumed
+			std::deque<pending> work;
+			work.push_back(pending{ 0, keys.size(), nullptr, TO::sm_invalid_lbl });
+
+			node_handle root = nullptr;
+			while (!work.empty())
+			{
+				pending cur;
+				if (order == BULK_BFS) {
+					cur = work.front();
+					work.pop_front();
+				}
+				else {
+					cur = work.back();
+					work.pop_back();
+				}
+
+				size_t mid = cur.m_lo + (cur.m_hi - cur.m_lo) / 2;
+				node_handle nn = TO::create_free_node();
+				constructor(nn, keys[mid]);
+
+				if (TO::is_null(cur.m_parent)) {
+					root = nn;
+				}
+				else {
+					TO::attach_node(cur.m_parent, cur.m_label, nn);
+				}
+
+				// DFS pops the left range first, BFS takes them in order
+				pending left{ cur.m_lo, mid, nn, TO::sm_left_lbl };
+				pending right{ mid + 1, cur.m_hi, nn, TO::sm_right_lbl };
+				if (order == BULK_BFS) {
+					if (left.m_lo < left.m_hi) work.push_back(left);
+					if (right.m_lo < right.m_hi) work.push_back(right);
+				}
+				else {
+					if (right.m_lo < right.m_hi) work.push_back(right);
+					if (left.m_lo < left.m_hi) work.push_back(left);
+				}
+			}
+
+			return root;
 		}
 	}
 }
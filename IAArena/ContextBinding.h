@@ -0,0 +1,39 @@
+#ifndef _IA_CONTEXT_BINDING_H_
+#define _IA_CONTEXT_BINDING_H_
+
+namespace foundation
+{
+	/* Ops structs are all-static, so any state they need (an arena, a node pool, a mapped file)
+	   has to be found without a this pointer.  A context_binding makes an object the current
+	   context of its type on the calling thread for as long as the binding lives.
+	   Bindings nest: destroying one restores whatever was current before it. */
+
+	template<typename T>
+	class context_binding
+	{
+	public:
+		explicit context_binding(T& ctx)
+			:m_prev(sm_current)
+		{
+			sm_current = &ctx;
+		}
+
+		~context_binding()
+		{
+			sm_current = m_prev;
+		}
+
+		context_binding(const context_binding&) = delete;
+		context_binding& operator = (const context_binding&) = delete;
+
+		static inline T* current() { return sm_current; }
+	private:
+		T* m_prev;
+		static thread_local T* sm_current;
+	};
+
+	template<typename T>
+	thread_local T* context_binding<T>::sm_current = nullptr;
+}
+
+#endif
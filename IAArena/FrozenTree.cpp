@@ -0,0 +1,6 @@
+
+#include <iostream>
+#include "FrozenTree.h"
+
+template struct dstruct::frozen::ops<long>;
+template struct dstruct::frozen::ops<int>;
@@ -0,0 +1,565 @@
+#ifndef _IA_FROZEN_TREE_H_
+#define _IA_FROZEN_TREE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#include "FError.h"
+#include "TraversalIface.h"
+#include "CheckPolicy.h"
+#include "ContextBinding.h"
+#include "Prefetch.h"
+#include "BinaryTree.h"
+#include "CompactTree.h"
+#include "TraversalRange.h"
+
+namespace dstruct
+{
+	/* A frozen tree: the keys of a finished BST, copied into one array with no edges at all.
+		The shape is the complete binary tree on those keys, numbered breadth-first from 1
+		(node i has children 2i and 2i+1), and the numbering says where everything is.
+
+		Two layouts of that array:
+		LAYOUT_EYTZINGER	slot i holds node i.  The top of the tree is packed at the front, and the
+							descendants of a node three levels down (four, for 4-byte keys) are one
+							cache line, which the search prefetches while it works its way there.
+		LAYOUT_VEB			van Emde Boas: the tree is cut at half its height, the top half is laid out
+							(recursively) first and then each bottom tree after it.  Every subtree
+							of any size sits in a block of its own, so a search touches O(log_B n)
+							blocks whatever the cache line or page size B.  The array is sized for
+							the perfect tree, so the slots of a missing last level are left empty.
+
+		lower_bound is branch-free: the loop runs once per level whatever the keys are, and the
+		answer is read off the path taken.  lower_bound_batch runs several searches in step, four at
+		a time per AVX2 register when the keys are 64-bit and the build has AVX2, so that their
+		cache misses overlap.
+
+		The ops adapter (frozen::ops) lets the traversers, the ranges and the printers read a frozen
+		tree like any other, through a context_binding as compact_tree does.  It is read-only. */
+
+	namespace frozen
+	{
+		using bin_tree_sample::ichild;
+		using bin_tree_sample::ilabel;
+		using bin_tree_sample::CHILD_PRE;
+		using bin_tree_sample::CHILD_LEFT;
+		using bin_tree_sample::CHILD_RIGHT;
+		using bin_tree_sample::CHILD_FINAL;
+		using bin_tree_sample::LABEL_INVALID;
+		using bin_tree_sample::LABEL_LEFT;
+		using bin_tree_sample::LABEL_RIGHT;
+		using bin_tree_sample::LABEL_PARENT;
+
+		// Node i of the complete tree, 0 for none
+		using handle = compact_tree::handle;
+
+		enum frozen_layout {
+			LAYOUT_EYTZINGER,
+			LAYOUT_VEB
+		};
+
+		// Trailing 1 bits of v
+		inline unsigned int trailing_ones(std::uint64_t v)
+		{
+			v = ~v;
+			if (v == 0) {
+				return 64;
+			}
+#if defined(_MSC_VER)
+			unsigned long idx;
+			_BitScanForward64(&idx, v);
+			return (unsigned int)idx;
+#else
+			return (unsigned int)__builtin_ctzll(v);
+#endif
+		}
+
+		// Levels in a complete tree of n nodes
+		inline int levels_for(size_t n)
+		{
+			int h = 0;
+			for (; n; n >>= 1) {
+				h++;
+			}
+			return h;
+		}
+
+		template<typename Key = long>
+		class frozen_tree
+		{
+		public:
+			using key_type = Key;
+
+			frozen_tree()
+				:m_size(0),
+				m_height(0),
+				m_layout(LAYOUT_EYTZINGER),
+				m_slots(nullptr),
+				m_cuts()
+			{ }
+
+			frozen_tree(const frozen_tree&) = delete;
+			frozen_tree& operator = (const frozen_tree&) = delete;
+
+			frozen_tree(frozen_tree&& other)
+				:frozen_tree()
+			{
+				*this = std::move(other);
+			}
+
+			frozen_tree& operator = (frozen_tree&& other)
+			{
+				m_store.swap(other.m_store);
+				std::swap(m_size, other.m_size);
+				std::swap(m_height, other.m_height);
+				std::swap(m_layout, other.m_layout);
+				std::swap(m_slots, other.m_slots);
+				for (int d = 0; d <= sm_max_levels; d++) {
+					std::swap(m_cuts[d], other.m_cuts[d]);
+				}
+				return *this;
+			}
+
+			// Take the keys of a sorted range
+			template<typename Iter>
+			void assign_sorted(Iter first, Iter last, frozen_layout layout)
+			{
+				std::vector<Key> keys(first, last);
+				m_size = keys.size();
+				m_height = levels_for(m_size);
+				m_layout = layout;
+				if ((size_t)m_height >= sm_max_levels || m_size > 0xffffffffu) {
+					throw foundation::foundation_exception("too many keys", "frozen_tree::assign_sorted");
+				}
+
+				// Slot 0 is never a node; Eytzinger searches read it in place of a missing one
+				size_t slots = layout == LAYOUT_EYTZINGER ? m_size + 1 : ((size_t)1 << m_height);
+				const size_t line = 64 / sizeof(Key) > 0 ? 64 / sizeof(Key) : 1;
+				m_store.assign(slots + line, Key());
+
+				// Align slot 0 to a cache line, so that the descendants the Eytzinger search
+				// prefetches share one
+				size_t misalign = ((std::uintptr_t)m_store.data() % 64) / sizeof(Key);
+				m_slots = m_store.data() + (misalign ? line - misalign : 0);
+
+				for (veb_cut& c : m_cuts) {
+					c = veb_cut();
+				}
+				if (layout == LAYOUT_VEB) {
+					veb_tables(1, m_height);
+				}
+
+				size_t next = 0;
+				fill_in_order(1, keys, next);
+			}
+
+			size_t size() const { return m_size; }
+			int height() const { return m_height; }
+			frozen_layout layout() const { return m_layout; }
+
+			// Navigation, for the ops adapter
+			handle root() const { return handle(m_size ? 1u : 0u); }
+			handle child(handle h, int right) const
+			{
+				size_t c = 2 * (size_t)h.m_idx + right;
+				return handle(c <= m_size ? (compact_tree::cindex)c : 0u);
+			}
+			handle parent(handle h) const { return handle(h.m_idx >> 1); }
+			const Key& key(handle h) const { return m_slots[slot_of(h.m_idx)]; }
+
+			// The first key not less than x, or null
+			const Key* lower_bound(const Key& x) const
+			{
+				return m_layout == LAYOUT_EYTZINGER ? eytzinger_lower_bound(x) : veb_lower_bound(x);
+			}
+
+			bool contains(const Key& x) const
+			{
+				const Key* k = lower_bound(x);
+				return k != nullptr && !(x < *k);
+			}
+
+			// lower_bound for count keys at once
+			void lower_bound_batch(const Key* xs, size_t count, const Key** out) const
+			{
+				size_t i = 0;
+				if (m_layout == LAYOUT_EYTZINGER) {
+					i = eytzinger_batch(xs, count, out);
+				}
+				for (; i < count; i++) {
+					out[i] = lower_bound(xs[i]);
+				}
+			}
+		private:
+			static const int sm_max_levels = 40;
+			static const size_t sm_lanes = 8;
+
+			// Where node i lives
+			size_t slot_of(size_t i) const
+			{
+				if (m_layout == LAYOUT_EYTZINGER) {
+					return i;
+				}
+
+				// Walk the vEB positions down from the root to i's depth
+				int d = levels_for(i);
+				size_t pos[sm_max_levels + 1];
+				pos[1] = 0;
+				for (int k = 2; k <= d; k++) {
+					pos[k] = m_cuts[k].position(pos, i >> (d - k));
+				}
+				return pos[d] + 1;  // the vEB positions start at 0, the slots at 1
+			}
+
+			void fill_in_order(size_t i, const std::vector<Key>& keys, size_t& next)
+			{
+				if (i > m_size) {
+					return;
+				}
+				fill_in_order(2 * i, keys, next);
+				m_slots[slot_of(i)] = keys[next++];
+				fill_in_order(2 * i + 1, keys, next);
+			}
+
+			/* The vEB cut of a subtree of height h whose root is at depth top: the roots of its bottom
+				trees are at depth top + h/2.  For each depth d that is such a root we keep the size of
+				the top tree above it, the height of each bottom tree, and the depth of the top's root.
+				Then a node's position follows from that of its top's root (Brodal, Fagerberg & Jacob). */
+			void veb_tables(int top, int h)
+			{
+				if (h <= 1) {
+					return;
+				}
+				int top_h = h / 2;
+				int bottom_h = h - top_h;
+				int d = top + top_h;
+				m_cuts[d].m_top_size = ((size_t)1 << top_h) - 1;
+				m_cuts[d].m_bottom_height = bottom_h;
+				m_cuts[d].m_top_depth = top;
+				veb_tables(top, top_h);
+				veb_tables(d, bottom_h);
+			}
+
+			/* Go down a level per step: right if the key there is less than x, left otherwise.
+				Past the last node, the path bits say it all: the answer is where we last went left,
+				which is i with its trailing right turns, and that left turn, shifted off. */
+			const Key* eytzinger_lower_bound(const Key& x) const
+			{
+				if (m_size == 0) {
+					return nullptr;
+				}
+
+				const Key* a = m_slots;
+				const size_t line = 64 / sizeof(Key) > 0 ? 64 / sizeof(Key) : 1;
+				size_t i = 1;
+				for (int level = 1; level < m_height; level++) {  // these levels are full
+					foundation::prefetch(a + i * line);
+					i = 2 * i + (a[i] < x);
+				}
+				// The last level may be short: a missing node counts as a right turn
+				size_t live = i <= m_size ? i : 0;
+				i = 2 * i + ((i > m_size) | (a[live] < x));
+
+				i >>= trailing_ones(i) + 1;
+				return i ? a + i : nullptr;
+			}
+
+			const Key* veb_lower_bound(const Key& x) const
+			{
+				if (m_size == 0) {
+					return nullptr;
+				}
+
+				// The array has room for the perfect tree, so a missing node can be read, and ignored
+				const Key* a = m_slots + 1;
+				size_t pos[sm_max_levels + 2];
+				size_t i = 1;
+				pos[0] = pos[1] = 0;
+				for (int d = 1; d <= m_height; d++) {
+					i = 2 * i + ((i > m_size) | (a[pos[d]] < x));
+					pos[d + 1] = m_cuts[d + 1].position(pos, i);  // past the bottom, a harmless 0
+				}
+
+				i >>= trailing_ones(i) + 1;
+				return i ? m_slots + pos[levels_for(i)] + 1 : nullptr;
+			}
+
+			// As eytzinger_lower_bound, several at a time.  Returns how many it did.
+			size_t eytzinger_batch(const Key* xs, size_t count, const Key** out) const
+			{
+				if (m_size == 0) {
+					return 0;
+				}
+
+				const Key* a = m_slots;
+				size_t done = 0;
+#if defined(__AVX2__)
+				if (std::is_integral<Key>::value && std::is_signed<Key>::value && sizeof(Key) == 8) {
+					// Two registers of four, so that eight loads are in flight
+					const __m256i n = _mm256_set1_epi64x((long long)m_size);
+					const __m256i zero = _mm256_setzero_si256();
+					for (; done + 8 <= count; done += 8) {
+						__m256i x[2], i[2];
+						for (int r = 0; r < 2; r++) {
+							x[r] = _mm256_loadu_si256((const __m256i*)(xs + done + 4 * r));
+							i[r] = _mm256_set1_epi64x(1);
+						}
+						for (int level = 1; level <= m_height; level++) {
+							for (int r = 0; r < 2; r++) {
+								__m256i missing = _mm256_cmpgt_epi64(i[r], n);
+								__m256i live = _mm256_blendv_epi8(i[r], zero, missing);
+								__m256i v = _mm256_i64gather_epi64((const long long*)a, live, 8);
+								__m256i right = _mm256_or_si256(missing, _mm256_cmpgt_epi64(x[r], v));  // -1 for right
+								i[r] = _mm256_sub_epi64(_mm256_add_epi64(i[r], i[r]), right);
+							}
+						}
+
+						alignas(32) std::uint64_t lanes[8];
+						_mm256_store_si256((__m256i*)lanes, i[0]);
+						_mm256_store_si256((__m256i*)(lanes + 4), i[1]);
+						for (int l = 0; l < 8; l++) {
+							std::uint64_t r = lanes[l] >> (trailing_ones(lanes[l]) + 1);
+							out[done + l] = r ? a + r : nullptr;
+						}
+					}
+				}
+#endif
+				// Interleaved scalar searches, sm_lanes at a time
+				for (; done + sm_lanes <= count; done += sm_lanes) {
+					size_t i[sm_lanes];
+					for (size_t l = 0; l < sm_lanes; l++) {
+						i[l] = 1;
+					}
+					for (int level = 1; level <= m_height; level++) {
+						for (size_t l = 0; l < sm_lanes; l++) {
+							size_t live = i[l] <= m_size ? i[l] : 0;
+							i[l] = 2 * i[l] + ((i[l] > m_size) | (a[live] < xs[done + l]));
+						}
+					}
+					for (size_t l = 0; l < sm_lanes; l++) {
+						size_t r = i[l] >> (trailing_ones(i[l]) + 1);
+						out[done + l] = r ? a + r : nullptr;
+					}
+				}
+				return done;
+			}
+
+			std::vector<Key> m_store;
+			size_t m_size;
+			int m_height;
+			frozen_layout m_layout;
+			Key* m_slots;  // within m_store, cache aligned
+
+			// vEB cut tables, by depth (the root is at depth 1)
+			struct veb_cut
+			{
+				size_t m_top_size;  // nodes in the top tree; also the mask for a node's bottom tree
+				size_t m_bottom_height;
+				size_t m_top_depth;
+
+				// The position of node i, a root of a bottom tree at this depth
+				inline size_t position(const size_t* pos, size_t i) const
+				{
+					size_t nth = i & m_top_size;  // which of the top's bottom trees
+					return pos[m_top_depth] + m_top_size + (nth << m_bottom_height) - nth;
+				}
+			};
+			veb_cut m_cuts[sm_max_levels + 1];
+		};
+
+		// Freeze a finished BST: its keys, in order, into a frozen_tree
+		template<typename TO>
+		frozen_tree<typename TO::key_type> freeze(typename TO::node_handle root, frozen_layout layout = LAYOUT_EYTZINGER)
+		{
+			std::vector<typename TO::key_type> keys;
+			for (typename TO::node_handle n : ttraversal::inorder_range<TO>(root)) {
+				keys.push_back(TO::get_key(n));
+			}
+
+			frozen_tree<typename TO::key_type> frozen;
+			frozen.assign_sorted(keys.begin(), keys.end(), layout);
+			return frozen;
+		}
+
+		// Read-only tree ops over the frozen tree bound on this thread
+		template<typename Key = long, typename Check = foundation::check_default>
+		struct ops
+		{
+			using tree = frozen_tree<Key>;
+			using binding = foundation::context_binding<const tree>;
+			using check_policy = Check;
+			using node_handle = handle;
+			using node_index = ichild;
+			using node_label = ilabel;
+			using key_type = Key;
+			using sequence = unsigned int;
+
+			// Nothing changes, so there is nothing to validate
+			static const bool sm_concurrent = false;
+
+			static const ilabel sm_parent_lbl = LABEL_PARENT;
+			static const ilabel sm_invalid_lbl = LABEL_INVALID;
+			static const ilabel sm_left_lbl = LABEL_LEFT;
+			static const ilabel sm_right_lbl = LABEL_RIGHT;
+
+			static inline void check_label(ilabel lbl, const char* context)
+			{
+				if (lbl != LABEL_LEFT && lbl != LABEL_RIGHT && lbl != LABEL_PARENT)
+				{
+					std::string exc_c("frozen_ops::");
+					exc_c.append(context);
+					throw foundation::foundation_exception("label not valid", exc_c.c_str());
+				}
+			}
+
+			static inline const tree& bound()
+			{
+				if (Check::sm_strict) {
+					if (binding::current() == nullptr) {
+						throw foundation::foundation_exception("no frozen tree bound on this thread", "frozen_ops::bound");
+					}
+				}
+				return *binding::current();
+			}
+
+			static inline void read_only(const char* context)
+			{
+				throw foundation::foundation_exception("a frozen tree is read-only", context);
+			}
+
+			static inline handle root() { return bound().root(); }
+
+			static inline bool is_null(handle n) { return n.m_idx == 0; }
+			static inline bool is_index_pre(handle, ichild idx) { return idx == CHILD_PRE; }
+			static inline sequence get_seq(handle) { return 0; }
+			static inline sequence read_begin(handle) { return 0; }
+			static inline bool read_validate(handle, sequence) { return true; }
+
+			static inline Key get_key(handle n) { return bound().key(n); }
+			static inline void set_key(handle, Key) { read_only("frozen_ops::set_key"); }
+
+			static inline bool has_child(handle n, int right) { return !is_null(bound().child(n, right)); }
+
+			static inline bool is_index_first(handle n, ichild idx)
+			{
+				// A complete tree has no right child without a left one
+				return has_child(n, 0) && idx == CHILD_LEFT;
+			}
+
+			static inline bool is_index_post(handle n, ichild idx)
+			{
+				if (has_child(n, 1)) {
+					return idx == CHILD_RIGHT;
+				}
+				return has_child(n, 0) ? idx == CHILD_LEFT : idx == CHILD_PRE;
+			}
+
+			static inline bool is_index_final(handle, ichild idx) { return idx == CHILD_FINAL; }
+			static inline bool is_leaf(handle n) { return !has_child(n, 0); }
+			static inline int tree_depth(handle) { return bound().height(); }
+
+			static inline void init_child_index(handle, ichild& idx) { idx = CHILD_PRE; }
+
+			static inline ichild get_next_index(ichild c)
+			{
+				return bin_tree_sample::ops<>::get_next_index(c);
+			}
+
+			static inline ichild get_prev_index(ichild c)
+			{
+				return bin_tree_sample::ops<>::get_prev_index(c);
+			}
+
+			static inline void increment_index(handle n, ichild& idx)
+			{
+				if (Check::sm_strict) {
+					if (idx >= CHILD_FINAL) {
+						throw foundation::foundation_exception("frozen ops increment index-- index too large.");
+					}
+				}
+				idx = get_next_index(idx);
+				while (idx != CHILD_FINAL && !has_child(n, idx)) {
+					idx = get_next_index(idx);
+				}
+			}
+
+			static inline void decrement_index(handle n, ichild& idx)
+			{
+				if (Check::sm_strict) {
+					if (idx <= CHILD_PRE) {
+						throw foundation::foundation_exception("frozen ops decrement index-- index too small.");
+					}
+				}
+				idx = get_prev_index(idx);
+				while (idx != CHILD_PRE && !has_child(n, idx)) {
+					idx = get_prev_index(idx);
+				}
+			}
+
+			static inline EExists peek_node_labeled(handle n, ilabel label)
+			{
+				return is_null(get_node_labeled(n, label)) ? UNEXISTS : EXISTS;
+			}
+
+			static inline handle get_node_labeled(handle n, ilabel lbl)
+			{
+				if (Check::sm_strict) {
+					check_label(lbl, "get_node_labeled");
+				}
+				return lbl == LABEL_PARENT ? bound().parent(n) : bound().child(n, lbl);
+			}
+
+			static inline handle get_node_at_index(handle n, ichild idx)
+			{
+				if (Check::sm_strict) {
+					if (idx != CHILD_LEFT && idx != CHILD_RIGHT) {
+						throw foundation::foundation_exception("index invalid.", "frozen_ops::get_node_at_index");
+					}
+				}
+				return bound().child(n, idx);
+			}
+
+			static inline handle create_free_node() { read_only("frozen_ops::create_free_node"); return handle(); }
+			static inline void recycle_node(handle) { read_only("frozen_ops::recycle_node"); }
+			static inline void reserve_nodes(size_t) { }
+			static inline handle detach_node(handle, ilabel) { read_only("frozen_ops::detach_node"); return handle(); }
+			static inline void attach_node(handle, ilabel, handle) { read_only("frozen_ops::attach_node"); }
+
+			static inline void prefetch_node(handle n)
+			{
+				if (!is_null(n)) {
+					foundation::prefetch(&bound().key(n));
+				}
+			}
+
+			static inline ichild get_child_index(handle p, handle c)
+			{
+				return c.m_idx == 2 * p.m_idx ? CHILD_LEFT : CHILD_RIGHT;
+			}
+
+			static inline ilabel get_index_label(handle, ichild idx)
+			{
+				return bin_tree_sample::ops<>::get_index_label(nullptr, idx);
+			}
+
+			static void copy_index(ichild& to, ichild& from) { to = from; }
+			static void move_index(ichild& to, ichild& from) { to = from; }
+			static void print_node(std::ostream& os, handle n)
+			{
+				os << get_key(n);
+			}
+		};
+	}
+}
+
+#endif
@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include <string>
 #include "BinaryTree.h"
+#include "Benchmarks.h"
 #include "Construction.h"
 #include "IOUtils.h"
 
@@ -32,7 +33,6 @@ void bst_test()
 	using node = node<foundation::tp_single_thread>;
 
 	node* root = nullptr;
-	node* cur = nullptr;
 	for (long k : keys) {
 		auto condition = [&](node* bn, int depth) -> ilabel
 		{
@@ -64,6 +64,16 @@ void bst_test()
 
 int main(int argc, char* argv[])
 {
+	// IAArena <benchmark> [size] runs a benchmark instead
+	if (argc > 1) {
+		size_t n = argc > 2 ? (size_t)atol(argv[2]) : 1000000;
+		if (!bench::run_benchmark(argv[1], n)) {
+			std::cout << "Unknown benchmark " << argv[1] << std::endl;
+			return 1;
+		}
+		return 0;
+	}
+
 	// Test 1: build a bst
 	bst_test();
 	
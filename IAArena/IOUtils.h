@@ -10,12 +10,13 @@ namespace print
 
 	namespace tree {
 		
-		// Use a traverser to print out a tree in "TreeView" format
-		template<typename TO>
+		// Use a traverser to print out a tree in "TreeView" format.
+		// Any traverser with child_order_tr's events will do (parent_order_tr, for deep trees).
+		template<typename TO, typename Tr = dstruct::ttraversal::child_order_tr<TO> >
 		void print_tree_view(std::ostream& os, typename TO::node_handle root,
 			const char* depth_marker = "\t", const char* node_break = "\n")
 		{
-			dstruct::ttraversal::child_order_tr<TO> trav(root);
+			Tr trav(root);
 
 			bool proceed = trav.depth () >= 0;
 			while (proceed)
@@ -38,52 +39,80 @@ namespace print
 			}
 		}
 
-		// Use a traverser to print out a tree in LISP format
-		template<typename TO>
-		void print_lisp_tree(std::ostream& os, typename TO::node_handle root)
+		/* The LISP format.  A leaf is its key; any other node is its key and its children:
+
+				tree := key | "(" key " (" slot (" " slot)* "))"
+				slot := tree | "()"
+
+			so a root 2 over the leaves 1 and 3 is (2 (1 3)).  "()" keeps the place of a child that
+			is missing before one that is not, so a lone right child is still on the right.
+			read_lisp_tree (LispIO.h) reads it back.
+
+			The text comes out through a sink with put(char), put(const char*) and node(n), so the
+			same walk serves the ostream printer below and the buffered writer in LispIO.h. */
+		template<typename TO, typename Tr, typename Sink>
+		void emit_lisp_tree(Sink& out, typename TO::node_handle root)
 		{
-			dstruct::ttraversal::child_order_tr<TO> trav(root);
+			Tr trav(root);
 
 			while (trav.depth() >= 0)
 			{
-				// The separator we print depends on our position
 				auto cur_node_index = trav.location(0);
 				auto cur_node = trav.node(0);
-
-				decltype(cur_node_index) pindex;
-				auto pnode = trav.depth() > 0 ? trav.node(1) : nullptr;
-
-				if (pnode) {
-					pindex = trav.location(1);
-				}
-
 				bool leaf = TO::is_leaf(cur_node);
-				bool pre = TO::is_index_pre(cur_node, cur_node_index);
-				bool post = TO::is_index_post(cur_node, cur_node_index);  // possibly both
-				bool left_paren = !leaf || (pnode && TO::is_index_first(pnode, pindex));
-				bool right_paren = !leaf || (pnode && TO::is_index_post(pnode, pindex));
 
-				//os << "leaf " << leaf << " lparen " << left_paren << " rparen " << right_paren << std::endl;
-				if (pre) {
-					if (left_paren) {
-						os << " (";
+				if (TO::is_index_pre(cur_node, cur_node_index)) {
+					if (trav.depth() > 0) {
+						auto pnode = trav.node(1);
+						auto pindex = trav.location(1);
+
+						// The children's labels count up from 0; a label skipped is a child missing
+						int gap = (int)TO::get_index_label(pnode, pindex);
+						if (TO::is_index_first(pnode, pindex)) {
+							out.put(" (");
+						}
+						else {
+							auto prev = pindex;
+							TO::decrement_index(pnode, prev);
+							gap -= (int)TO::get_index_label(pnode, prev) + 1;
+							out.put(' ');
+						}
+						for (; gap > 0; --gap) {
+							out.put("() ");
+						}
 					}
-					else {
-						os << " ";
+					if (!leaf) {
+						out.put('(');
 					}
-				}
-				// Print only once, on pre
-				if (pre) {
-					TO::print_node(os, trav.node());
+					out.node(cur_node);
 				}
 
-				if (post && right_paren) {
-					os << ")";
+				// The children's parenthesis and the node's own
+				if (!leaf && TO::is_index_post(cur_node, cur_node_index)) {
+					out.put("))");
 				}
 
 				trav.next();
 			}
 		}
+
+		template<typename TO>
+		struct ostream_sink
+		{
+			std::ostream& m_os;
+
+			void put(char c) { m_os << c; }
+			void put(const char* s) { m_os << s; }
+			void node(typename TO::node_handle n) { TO::print_node(m_os, n); }
+		};
+
+		// Use a traverser to print out a tree in LISP format, one node at a time through print_node
+		template<typename TO, typename Tr = dstruct::ttraversal::child_order_tr<TO> >
+		void print_lisp_tree(std::ostream& os, typename TO::node_handle root)
+		{
+			ostream_sink<TO> out{os};
+			emit_lisp_tree<TO, Tr>(out, root);
+		}
 	}
 }
 #endif
\ No newline at end of file
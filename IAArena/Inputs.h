@@ -1,16 +1,21 @@
 #ifndef _IA_INPUTS_H_
 #define _IA_INPUTS_H_
 
+#include <cstdint>
+
 namespace foundation
 {
 	using dim_t = unsigned int;
 
+	// Counts are 64-bit: a long run goes past 4G events on a single dimension
+	using acount_t = std::uint64_t;
+
 	template<class Measure>
 	class mvector
 	{
 	public:
-		virtual Measure operator [] (dim_t dim) = 0;
-		~mvector();
+		virtual Measure operator [] (dim_t dim) const = 0;
+		virtual ~mvector() { }
 	};
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,229 @@
+#ifndef _IA_INSTRUMENT_POLICY_H_
+#define _IA_INSTRUMENT_POLICY_H_
+
+#include <iomanip>
+#include <ostream>
+#include "ContextBinding.h"
+#include "Inputs.h"
+
+namespace foundation
+{
+	/* An instrumentation policy says whether a traverser (linear_tr, child_order_tr, and
+		construct_at_end through its traverser) reports the work it does.
+		instrument_none			nothing: the hooks are empty and the per-operation state is an
+								empty base, so an uninstrumented traverser is the same code as before
+		instrument_counter<C>	each traverser is one operation, and when it goes, what it did is
+								handed to the instrument_sink<C> open on the thread, if there is one
+
+		Like the check policy, it is a type, and what is not asked for is not compiled in. */
+
+	// What an operation counts, one counter dimension each
+	enum instrument_dim {
+		INS_OPS,  // operations: 1 for each traverser, 0 for a copy of one
+		INS_NODES,  // nodes visited
+		INS_MAX_DEPTH,  // the deepest the operation went; summed over operations
+		INS_ARROWS,  // arrow changes: the label followed differs from the one before it
+		INS_CHECKS,  // fail-fast checks made (check_sequence and up)
+		INS_GROWTHS,  // the traverser's stack grew
+		INS_RETRIES,  // reads done again because a writer got in the way (concurrent trees)
+		INS_DIMS
+	};
+
+	struct instrument_none
+	{
+		static const bool sm_enabled = false;
+
+		struct op
+		{
+			inline void on_visit(int) { }
+			inline void on_arrow(int) { }
+			inline void on_check() const { }  // from the traversers' const accessors
+			inline void on_growth() { }
+			inline void on_retry() { }
+		};
+	};
+
+	/* Where operations go: the sums into Counter, which has (or maps, as an acounter_view does)
+		the INS_DIMS dimensions, and each value into a histogram of its dimension for the report.
+		A sink is current on the thread that makes it for as long as it lives; sinks nest. */
+	template<typename Counter>
+	class instrument_sink
+	{
+	public:
+		explicit instrument_sink(Counter& counter)
+			:m_counter(counter),
+			m_binding(*this)
+		{
+			clear();
+		}
+
+		instrument_sink(const instrument_sink&) = delete;
+		instrument_sink& operator = (const instrument_sink&) = delete;
+
+		void record(const acount_t (&values)[INS_DIMS])
+		{
+			if (values[INS_OPS] == 0 && values[INS_NODES] == 0) {
+				return;  // a copy that did nothing
+			}
+			for (dim_t d = 0; d < INS_DIMS; d++) {
+				acount_t v = values[d];
+				if (v) {
+					m_counter.add_to_counter(v, d);
+				}
+				if (values[INS_OPS]) {
+					m_histogram[d][bucket(v)]++;
+					m_max[d] = v > m_max[d] ? v : m_max[d];
+					m_total[d] += v;
+				}
+			}
+		}
+
+		void clear()
+		{
+			for (dim_t d = 0; d < INS_DIMS; d++) {
+				for (acount_t& h : m_histogram[d]) {
+					h = 0;
+				}
+				m_max[d] = 0;
+				m_total[d] = 0;
+			}
+		}
+
+		acount_t operations() const { return m_total[INS_OPS]; }
+
+		/* Value p (in 0..1) of the way up dimension d over the operations recorded.  The
+			histograms have power-of-two buckets, so this is the top of the bucket it falls in. */
+		acount_t percentile(dim_t d, double p) const
+		{
+			acount_t ops = operations();
+			if (ops == 0) {
+				return 0;
+			}
+			acount_t rank = (acount_t)(p * (double)(ops - 1)) + 1;
+			acount_t seen = 0;
+			for (int b = 0; b < sm_buckets; b++) {
+				seen += m_histogram[d][b];
+				if (seen >= rank) {
+					acount_t top = b == 0 ? 0 : (b >= 64 ? ~(acount_t)0 : ((acount_t)1 << b) - 1);
+					return top < m_max[d] ? top : m_max[d];
+				}
+			}
+			return m_max[d];
+		}
+
+		// Per operation: the total, mean and percentiles of each dimension
+		void report(std::ostream& os) const
+		{
+			static const char* names[INS_DIMS] = { "ops", "nodes", "max depth", "arrow changes", "fail-fast checks", "stack growths", "retries" };
+
+			acount_t ops = operations();
+			os << ops << " operations" << std::endl;
+			os << std::left << std::setw(18) << "per operation" << std::right
+				<< std::setw(14) << "total" << std::setw(12) << "mean"
+				<< std::setw(10) << "p50" << std::setw(10) << "p90" << std::setw(10) << "p99"
+				<< std::setw(12) << "max" << std::endl;
+			for (dim_t d = INS_NODES; d < INS_DIMS; d++) {
+				os << std::left << std::setw(18) << names[d] << std::right
+					<< std::setw(14) << m_total[d]
+					<< std::setw(12) << std::fixed << std::setprecision(2) << (ops ? (double)m_total[d] / (double)ops : 0.0)
+					<< std::setw(10) << percentile(d, 0.5)
+					<< std::setw(10) << percentile(d, 0.9)
+					<< std::setw(10) << percentile(d, 0.99)
+					<< std::setw(12) << m_max[d] << std::endl;
+			}
+			os.unsetf(std::ios::floatfield);
+		}
+
+		static inline instrument_sink* current() { return context_binding<instrument_sink>::current(); }
+	private:
+		static const int sm_buckets = 65;
+
+		// 0 for 0, then b for values in [2^(b-1), 2^b)
+		static int bucket(acount_t v)
+		{
+			int b = 0;
+			while (v) {
+				v >>= 1;
+				b++;
+			}
+			return b;
+		}
+
+		Counter& m_counter;
+		acount_t m_histogram[INS_DIMS][sm_buckets];
+		acount_t m_max[INS_DIMS];
+		acount_t m_total[INS_DIMS];
+		context_binding<instrument_sink> m_binding;
+	};
+
+	template<typename Counter>
+	struct instrument_counter
+	{
+		static const bool sm_enabled = true;
+
+		/* One operation's counts, kept in the traverser and recorded when it goes.
+			A copy of a traverser counts what is done through it, but not as another operation. */
+		class op
+		{
+		public:
+			op()
+			{
+				clear();
+				m_values[INS_OPS] = 1;
+			}
+
+			op(const op&)
+			{
+				clear();
+			}
+
+			op& operator = (const op&)
+			{
+				return *this;  // each keeps its own counts
+			}
+
+			~op()
+			{
+				instrument_sink<Counter>* sink = instrument_sink<Counter>::current();
+				if (sink) {
+					sink->record(m_values);
+				}
+			}
+
+			inline void on_visit(int depth)
+			{
+				m_values[INS_NODES]++;
+				if ((acount_t)depth > m_values[INS_MAX_DEPTH]) {
+					m_values[INS_MAX_DEPTH] = (acount_t)depth;
+				}
+			}
+
+			inline void on_arrow(int arrow)
+			{
+				if (arrow != m_last_arrow) {
+					m_values[INS_ARROWS]++;
+					m_last_arrow = arrow;
+				}
+			}
+
+			inline void on_check() const { m_values[INS_CHECKS]++; }
+			inline void on_growth() { m_values[INS_GROWTHS]++; }
+			inline void on_retry() { m_values[INS_RETRIES]++; }
+		private:
+			void clear()
+			{
+				for (acount_t& v : m_values) {
+					v = 0;
+				}
+				m_last_arrow = sm_no_arrow;
+			}
+
+			static const int sm_no_arrow = -0x7fffffff;
+
+			mutable acount_t m_values[INS_DIMS];
+			int m_last_arrow;
+		};
+	};
+}
+
+#endif
@@ -0,0 +1,331 @@
+#ifndef _IA_LISP_IO_H_
+#define _IA_LISP_IO_H_
+
+#include <cstddef>
+#include <cstring>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "FError.h"
+#include "Traversal.h"
+#include "TreeUtils.h"
+#include "IOUtils.h"
+
+namespace print
+{
+	/* Trees in the LISP format (see emit_lisp_tree in IOUtils.h), in bulk.
+		The writer formats keys straight into a large buffer that goes to the stream a block at
+		a time; the reader takes the stream a block at a time and builds the tree as it goes,
+		with an explicit stack, so neither costs a stream call per node and a tree of any depth
+		is read.  Both are for trees with integer keys and get_key/set_key. */
+
+	namespace tree
+	{
+		// Text for an ostream, gathered into blocks
+		class text_buffer
+		{
+		public:
+			explicit text_buffer(std::ostream& os, size_t capacity = 1 << 20)
+				:m_os(os),
+				m_buf(capacity > 64 ? capacity : 64),
+				m_pos(m_buf.data()),
+				m_end(m_buf.data() + m_buf.size())
+			{ }
+
+			~text_buffer()
+			{
+				flush();
+			}
+
+			text_buffer(const text_buffer&) = delete;
+			text_buffer& operator = (const text_buffer&) = delete;
+
+			inline void put(char c)
+			{
+				if (m_pos == m_end) {
+					flush();
+				}
+				*m_pos++ = c;
+			}
+
+			inline void put(const char* s)
+			{
+				for (; *s; ++s) {
+					put(*s);
+				}
+			}
+
+			// Two digits at a time, from the right
+			inline void put_int(long long v)
+			{
+				static const char pairs[] =
+					"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+					"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+					"8081828384858687888990919293949596979899";
+
+				if (m_end - m_pos < 24) {
+					flush();
+				}
+				char tmp[24];
+				char* e = tmp + sizeof(tmp);
+				char* p = e;
+				unsigned long long u = v < 0 ? 0ULL - (unsigned long long)v : (unsigned long long)v;
+				while (u >= 100) {
+					const char* d = pairs + 2 * (u % 100);
+					u /= 100;
+					*--p = d[1];
+					*--p = d[0];
+				}
+				if (u >= 10) {
+					*--p = pairs[2 * u + 1];
+					*--p = pairs[2 * u];
+				}
+				else {
+					*--p = (char)('0' + u);
+				}
+				if (v < 0) {
+					*--p = '-';
+				}
+				std::memcpy(m_pos, p, e - p);
+				m_pos += e - p;
+			}
+
+			void flush()
+			{
+				if (m_pos != m_buf.data()) {
+					m_os.write(m_buf.data(), m_pos - m_buf.data());
+					m_pos = m_buf.data();
+				}
+			}
+		private:
+			std::ostream& m_os;
+			std::vector<char> m_buf;
+			char* m_pos;
+			char* m_end;
+		};
+
+		template<typename TO>
+		struct key_sink
+		{
+			text_buffer& m_buf;
+
+			void put(char c) { m_buf.put(c); }
+			void put(const char* s) { m_buf.put(s); }
+			void node(typename TO::node_handle n) { m_buf.put_int((long long)TO::get_key(n)); }
+		};
+
+		// The LISP text of a tree, keys and all, into out
+		template<typename TO, typename Tr = dstruct::ttraversal::child_order_tr<TO> >
+		void write_lisp_tree(text_buffer& out, typename TO::node_handle root)
+		{
+			key_sink<TO> sink{out};
+			emit_lisp_tree<TO, Tr>(sink, root);
+		}
+
+		// An istream read a block at a time, split into the tokens of the LISP format
+		class lisp_reader
+		{
+		public:
+			explicit lisp_reader(std::istream& is, size_t capacity = 1 << 20)
+				:m_is(is),
+				m_buf(capacity > 64 ? capacity : 64),
+				m_pos(m_buf.data()),
+				m_end(m_buf.data()),
+				m_offset(0)
+			{ }
+
+			lisp_reader(const lisp_reader&) = delete;
+			lisp_reader& operator = (const lisp_reader&) = delete;
+
+			// The next character that is not white space, left unread; -1 at the end of the stream
+			inline int peek()
+			{
+				for (;;) {
+					for (; m_pos != m_end; ++m_pos) {
+						char c = *m_pos;
+						if (c != ' ' && c != '\n' && c != '\t' && c != '\r') {
+							return (unsigned char)c;
+						}
+					}
+					if (!refill()) {
+						return -1;
+					}
+				}
+			}
+
+			// Take the character peek() returned
+			inline void skip() { ++m_pos; }
+
+			// An integer, optionally negative, where peek() is; anything put_int writes, LLONG_MIN too
+			long long read_int()
+			{
+				bool negative = peek() == '-';
+				if (negative) {
+					skip();
+				}
+
+				// The magnitude may reach 2^63 for a negative key
+				const unsigned long long limit = (unsigned long long)std::numeric_limits<long long>::max() + (negative ? 1 : 0);
+				unsigned long long u = 0;
+				int digits = 0;
+				while (m_pos != m_end || refill()) {
+					unsigned d = (unsigned)(*m_pos - '0');
+					if (d > 9) {
+						break;
+					}
+					if (u > (limit - d) / 10) {
+						fail("key out of range");
+					}
+					u = u * 10 + d;
+					++m_pos;
+					++digits;
+				}
+				if (digits == 0) {
+					fail("expected a key");
+				}
+				return negative && u > 0 ? -(long long)(u - 1) - 1 : (long long)u;
+			}
+
+			// Bytes taken from the stream so far
+			unsigned long long offset() const { return m_offset + (unsigned long long)(m_pos - m_buf.data()); }
+
+			void fail(const char* what) const
+			{
+				std::string msg(what);
+				msg.append(" at byte ").append(std::to_string(offset()));
+				throw foundation::foundation_exception(msg.c_str(), "lisp_reader");
+			}
+		private:
+			bool refill()
+			{
+				m_offset += (unsigned long long)(m_end - m_buf.data());
+				m_is.read(m_buf.data(), (std::streamsize)m_buf.size());
+				size_t got = (size_t)m_is.gcount();
+				m_pos = m_buf.data();
+				m_end = m_buf.data() + got;
+				return got > 0;
+			}
+
+			std::istream& m_is;
+			std::vector<char> m_buf;
+			const char* m_pos;
+			const char* m_end;
+			unsigned long long m_offset;  // of the start of the buffer
+		};
+
+		/* Build the tree written in the LISP text in, with TO's nodes; null for empty text.
+			Each node is attached to its parent as it is read, under the label of its place among
+			the children.  Malformed text throws, and what was built so far is destroyed. */
+		template<typename TO>
+		typename TO::node_handle read_lisp_tree(lisp_reader& in)
+		{
+			using node_handle = typename TO::node_handle;
+			using node_index = typename TO::node_index;
+			using node_label = typename TO::node_label;
+			using key_type = typename TO::key_type;
+
+			struct open_node
+			{
+				node_handle m_node;
+				int m_slot;  // of the next child
+			};
+
+			node_handle root = nullptr;
+			if (in.peek() == -1) {
+				return root;
+			}
+
+			std::vector<open_node> stack;
+			try {
+				do {
+					int c = in.peek();
+					if (c == ')') {
+						// The end of the children, and of their node
+						if (stack.empty() || stack.back().m_slot == 0) {
+							in.fail("unexpected )");
+						}
+						in.skip();
+						if (in.peek() != ')') {
+							in.fail("expected ) to close a node");
+						}
+						in.skip();
+						stack.pop_back();
+						continue;
+					}
+
+					bool inner = false;
+					if (c == '(') {
+						in.skip();
+						if (in.peek() == ')') {
+							if (stack.empty()) {
+								in.fail("() is not a tree");
+							}
+							in.skip();
+							stack.back().m_slot++;  // a child missing
+							continue;
+						}
+						inner = true;
+					}
+					else if (c == -1) {
+						in.fail("unexpected end of text");
+					}
+
+					long long value = in.read_int();
+					if (value < (long long)std::numeric_limits<key_type>::min() || value > (long long)std::numeric_limits<key_type>::max()) {
+						in.fail("key out of range");
+					}
+					key_type key = (key_type)value;
+					node_label lbl = TO::sm_invalid_lbl;
+					if (!stack.empty()) {
+						open_node& p = stack.back();
+						lbl = TO::get_index_label(p.m_node, static_cast<node_index>(p.m_slot));
+						if (lbl == TO::sm_invalid_lbl) {
+							in.fail("too many children");
+						}
+						p.m_slot++;
+					}
+					else if (!TO::is_null(root)) {
+						in.fail("more than one tree");
+					}
+
+					node_handle n = TO::create_free_node();
+					TO::set_key(n, key);
+					if (stack.empty()) {
+						root = n;
+					}
+					else {
+						TO::attach_node(stack.back().m_node, lbl, n);
+					}
+
+					if (inner) {
+						if (in.peek() != '(') {
+							in.fail("expected ( before the children");
+						}
+						in.skip();
+						stack.push_back(open_node{n, 0});
+					}
+				} while (!stack.empty());
+
+				if (in.peek() != -1) {
+					in.fail("text after the tree");
+				}
+			}
+			catch (...) {
+				dstruct::tree_utils::destroy_tree<TO>(root);
+				throw;
+			}
+			return root;
+		}
+
+		template<typename TO>
+		typename TO::node_handle read_lisp_tree(std::istream& is)
+		{
+			lisp_reader in(is);
+			return read_lisp_tree<TO>(in);
+		}
+	}
+}
+
+#endif
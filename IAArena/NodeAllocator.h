@@ -0,0 +1,345 @@
+#ifndef _IA_NODE_ALLOCATOR_H_
+#define _IA_NODE_ALLOCATOR_H_
+
+#include <cstddef>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+#include <type_traits>
+#include "FError.h"
+#include "ContextBinding.h"
+
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+namespace foundation
+{
+	/* Raw memory aligned to align bytes, which must be a power of two.  Plain new only
+	   promises alignof(max_align_t) before C++17, and a node aligned to a cache line needs more. */
+	inline void* aligned_allocate(size_t bytes, size_t align)
+	{
+		if (align < sizeof(void*)) {
+			align = sizeof(void*);
+		}
+#if defined(_WIN32)
+		void* p = _aligned_malloc(bytes, align);
+#else
+		void* p = nullptr;
+		if (posix_memalign(&p, align, bytes) != 0) {
+			p = nullptr;
+		}
+#endif
+		if (p == nullptr) {
+			throw std::bad_alloc();
+		}
+		return p;
+	}
+
+	inline void aligned_release(void* p)
+	{
+#if defined(_WIN32)
+		_aligned_free(p);
+#else
+		free(p);
+#endif
+	}
+
+	// True if new T may hand out memory less aligned than T asks for
+	template<typename T>
+	struct is_over_aligned
+	{
+		static const bool value = alignof(T) > alignof(std::max_align_t);
+	};
+
+	/* Allocation policies for tree nodes.
+	   A policy supplies create<T>(), which hands out a default-constructed T, and recycle<T>(T*),
+	   which takes one back.  The ops structs forward create_free_node and recycle_node to it,
+	   so the same construction code runs on the heap or in an arena. */
+
+	// The plain heap: one new and one delete per node
+	struct ap_heap
+	{
+		template<typename T>
+		static inline T* create()
+		{
+			return create<T>(std::integral_constant<bool, is_over_aligned<T>::value>());
+		}
+
+		template<typename T>
+		static inline void recycle(T* p)
+		{
+			recycle(p, std::integral_constant<bool, is_over_aligned<T>::value>());
+		}
+
+		template<typename T>
+		static inline void reserve(size_t) { }
+	private:
+		// Over-aligned types never reach plain new and delete, which would not honour alignas before C++17
+		template<typename T>
+		static inline T* create(std::true_type)
+		{
+			return new (aligned_allocate(sizeof(T), alignof(T))) T();
+		}
+
+		template<typename T>
+		static inline T* create(std::false_type)
+		{
+			return new T();
+		}
+
+		template<typename T>
+		static inline void recycle(T* p, std::true_type)
+		{
+			p->~T();
+			aligned_release(p);
+		}
+
+		template<typename T>
+		static inline void recycle(T* p, std::false_type)
+		{
+			delete p;
+		}
+	};
+
+	template<typename T>
+	class arena_cursor;
+
+	/* A slab arena.  The arena hands out runs of raw slots (whole slabs, or the unused tail
+	   of a slab some thread gave back) under a lock.  Carving nodes out of a run and reusing
+	   recycled nodes is done by an arena_cursor (an arena_scope, for ap_arena), one per
+	   thread, without any locking.
+
+	   Dropping the arena frees every slab at once without visiting the nodes, so the
+	   nodes must not need destruction. */
+	template<typename T>
+	class node_arena
+	{
+	private:
+		union slot
+		{
+			slot* m_next;  // while the slot is on a free list
+			typename std::aligned_storage<sizeof(T), alignof(T)>::type m_storage;
+		};
+
+		friend class arena_cursor<T>;
+	public:
+		static_assert(std::is_trivially_destructible<T>::value,
+			"node_arena -- nodes are dropped without being destroyed");
+
+		explicit node_arena(size_t slab_nodes = 1 << 16)
+			:m_slab_nodes(slab_nodes > 0 ? slab_nodes : 1),
+			m_free(nullptr)
+		{ }
+
+		~node_arena()
+		{
+			release();
+		}
+
+		node_arena(const node_arena&) = delete;
+		node_arena& operator = (const node_arena&) = delete;
+
+		// Drop every node at once.  No scope may be open on the arena.
+		void release()
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			for (slot* s : m_slabs) {
+				aligned_release(s);
+			}
+			m_slabs.clear();
+			m_spare.clear();
+			m_free = nullptr;
+		}
+
+		size_t slab_count() const { return m_slabs.size(); }
+	private:
+		// Slabs are raw memory aligned like T: a slot needs no construction, and new[] would not honour alignas before C++17
+		static slot* allocate_slab(size_t count)
+		{
+			return static_cast<slot*>(aligned_allocate(sizeof(slot) * count, alignof(slot)));
+		}
+
+		// Give a scope a run of fresh slots and a free list, if any was handed back
+		void take_run(slot*& begin, slot*& end, slot*& free_head)
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			free_head = m_free;
+			m_free = nullptr;
+
+			if (!m_spare.empty()) {
+				begin = m_spare.back().first;
+				end = m_spare.back().second;
+				m_spare.pop_back();
+				return;
+			}
+
+			slot* slab = allocate_slab(m_slab_nodes);
+			m_slabs.push_back(slab);
+			begin = slab;
+			end = slab + m_slab_nodes;
+		}
+
+		// Trade a scope's run for a fresh slab of at least min_nodes, keeping the old run as a spare
+		void take_slab(slot*& begin, slot*& end, size_t min_nodes)
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			if (begin != end) {
+				m_spare.emplace_back(begin, end);
+			}
+
+			size_t count = min_nodes > m_slab_nodes ? min_nodes : m_slab_nodes;
+			slot* slab = allocate_slab(count);
+			m_slabs.push_back(slab);
+			begin = slab;
+			end = slab + count;
+		}
+
+		// A scope is closing: keep its unused run and its recycled nodes for the next one
+		void give_back(slot* begin, slot* end, slot* free_head)
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			if (begin != end) {
+				m_spare.emplace_back(begin, end);
+			}
+
+			while (free_head) {
+				slot* nx = free_head->m_next;
+				free_head->m_next = m_free;
+				m_free = free_head;
+				free_head = nx;
+			}
+		}
+
+		size_t m_slab_nodes;
+		std::mutex m_lock;
+		std::vector<slot*> m_slabs;
+		std::vector<std::pair<slot*, slot*> > m_spare;
+		slot* m_free;
+	};
+
+	/* One owner's window onto an arena: it carves nodes out of a run, and recycled nodes go
+	   to its own free list, all without locking.  Both are handed back to the arena when the
+	   cursor goes.  A cursor is not bound to anything; code that allocates for itself, and
+	   not through ap_arena, keeps one and calls allocate(). */
+	template<typename T>
+	class arena_cursor
+	{
+	private:
+		using slot = typename node_arena<T>::slot;
+	public:
+		explicit arena_cursor(node_arena<T>& arena)
+			:m_arena(arena),
+			m_next(nullptr),
+			m_end(nullptr),
+			m_free(nullptr),
+			m_reserved(0)
+		{ }
+
+		~arena_cursor()
+		{
+			m_arena.give_back(m_next, m_end, m_free);
+		}
+
+		arena_cursor(const arena_cursor&) = delete;
+		arena_cursor& operator = (const arena_cursor&) = delete;
+
+		inline T* allocate()
+		{
+			if (m_reserved) {
+				m_reserved--;  // reserve() made the room
+				return new (m_next++) T();
+			}
+
+			if (m_free) {
+				slot* s = m_free;
+				m_free = s->m_next;
+				return new (s) T();
+			}
+
+			if (m_next == m_end) {
+				slot* extra_free = nullptr;
+				m_arena.take_run(m_next, m_end, extra_free);
+				m_free = extra_free;
+			}
+			return new (m_next++) T();
+		}
+
+		inline void recycle(T* p)
+		{
+			slot* s = reinterpret_cast<slot*>(p);
+			s->m_next = m_free;
+			m_free = s;
+		}
+
+		// Make room for n contiguous nodes, and hand out the next n from it, not from the recycled ones
+		void reserve(size_t n)
+		{
+			if ((size_t)(m_end - m_next) < n) {
+				m_arena.take_slab(m_next, m_end, n);
+			}
+			m_reserved = n;
+		}
+	private:
+		node_arena<T>& m_arena;
+		slot* m_next;
+		slot* m_end;
+		slot* m_free;
+		size_t m_reserved;  // nodes still to come from the run, whatever is on the free list
+	};
+
+	/* A thread's window onto an arena: a cursor that, while it lives, is where ap_arena
+	   allocates on this thread.  Scopes bind as contexts do, so on one thread they close
+	   in the reverse order of their opening. */
+	template<typename T>
+	class arena_scope : public arena_cursor<T>
+	{
+	public:
+		explicit arena_scope(node_arena<T>& arena)
+			:arena_cursor<T>(arena),
+			m_binding(*this)
+		{ }
+
+		static inline arena_scope* current() { return context_binding<arena_scope>::current(); }
+	private:
+		context_binding<arena_scope> m_binding;
+	};
+
+	/* Allocate from the arena_scope open on the calling thread.  Having no scope open is a
+	   mistake in any build, and is always checked: one well-predicted branch per node. */
+	struct ap_arena
+	{
+		template<typename T>
+		static inline T* create()
+		{
+			arena_scope<T>* scope = arena_scope<T>::current();
+			if (scope == nullptr) {
+				throw foundation_exception("no arena_scope open on this thread", "ap_arena::create");
+			}
+			return scope->allocate();
+		}
+
+		template<typename T>
+		static inline void recycle(T* p)
+		{
+			arena_scope<T>* scope = arena_scope<T>::current();
+			if (scope == nullptr) {
+				throw foundation_exception("no arena_scope open on this thread", "ap_arena::recycle");
+			}
+			scope->recycle(p);
+		}
+
+		template<typename T>
+		static inline void reserve(size_t n)
+		{
+			arena_scope<T>* scope = arena_scope<T>::current();
+			if (scope) {
+				scope->reserve(n);
+			}
+		}
+	};
+}
+
+#endif
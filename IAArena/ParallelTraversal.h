@@ -0,0 +1,142 @@
+#ifndef _IA_PARALLEL_TRAVERSAL_H_
+#define _IA_PARALLEL_TRAVERSAL_H_
+
+#include <memory>
+#include <vector>
+#include "FError.h"
+#include "ContextBinding.h"
+#include "Traversal.h"
+#include "WorkStealingPool.h"
+
+namespace dstruct
+{
+	namespace ttraversal
+	{
+		/* Parallel full-tree passes.
+			The top of the tree, down to a split depth, is walked on the calling thread.
+			Every node at the split depth roots a subtree, and each subtree is one task for the
+			work-stealing pool, walked there with an ordinary child_order_tr.
+			Each task folds its nodes into an accumulator of its own; at the end the accumulators
+			are combined in tree order, so the result does not depend on how the work was stolen. */
+
+		template<typename...>
+		struct pt_void { using type = void; };
+
+		// Ops that reach their tree through a context_binding (compact_tree and the like) expose it
+		// as TO::binding.  Whatever is bound on the calling thread is bound on the workers too.
+		template<typename TO, typename = void>
+		class pt_context
+		{
+		public:
+			class scope
+			{
+			public:
+				explicit scope(const pt_context&) { }
+			};
+		};
+
+		template<typename TO>
+		class pt_context<TO, typename pt_void<typename TO::binding>::type>
+		{
+		private:
+			using binding_t = typename TO::binding;
+		public:
+			pt_context()
+				:m_ctx(binding_t::current())
+			{ }
+
+			class scope
+			{
+			public:
+				explicit scope(const pt_context& c)
+				{
+					if (c.m_ctx) {
+						m_binding.reset(new binding_t(*c.m_ctx));
+					}
+				}
+			private:
+				std::unique_ptr<binding_t> m_binding;
+			};
+		private:
+			decltype(binding_t::current()) m_ctx;
+		};
+
+		/* Visit every node once and reduce.
+			visit(Acc&, node_handle, int depth) is called for each node, parents before children.
+			combine(Acc& into, const Acc& from) merges two accumulators.
+			split_depth < 0 splits at the first level with at least 8 subtrees per worker. */
+		template<typename TO, typename Acc, typename Visit, typename Combine>
+		Acc parallel_reduce(foundation::ws_pool& pool, typename TO::node_handle root, int split_depth,
+			const Acc& init, Visit visit, Combine combine)
+		{
+			using node_handle = typename TO::node_handle;
+			using node_index = typename TO::node_index;
+
+			Acc top(init);
+			if (TO::is_null(root)) {
+				return top;
+			}
+
+			// Walk the top levels here, a level at a time, until we have the split frontier
+			std::vector<node_handle> frontier(1, root);
+			std::vector<node_handle> next_level;
+			size_t want = 8 * (size_t)pool.size();
+			int depth = 0;
+			while (!frontier.empty()
+				&& (split_depth >= 0 ? depth < split_depth : frontier.size() < want))
+			{
+				next_level.clear();
+				for (node_handle n : frontier) {
+					visit(top, n, depth);
+
+					node_index idx;
+					TO::init_child_index(n, idx);
+					TO::increment_index(n, idx);
+					while (!TO::is_index_final(n, idx)) {
+						next_level.push_back(TO::get_node_at_index(n, idx));
+						TO::increment_index(n, idx);
+					}
+				}
+				frontier.swap(next_level);
+				depth++;
+			}
+
+			// One task per subtree
+			std::vector<Acc> partial(frontier.size(), init);
+			pt_context<TO> ctx;
+			const int base_depth = depth;
+			pool.run(frontier.size(), [&](size_t task, unsigned int) {
+				typename pt_context<TO>::scope bound(ctx);
+
+				Acc acc(init);  // local, so that workers do not share cache lines
+				child_order_tr<TO> trav(frontier[task]);
+				bool proceed = trav.depth() >= 0;
+				while (proceed) {
+					node_handle n = trav.node(0);
+					if (TO::is_index_pre(n, trav.location(0))) {
+						visit(acc, n, base_depth + trav.depth());
+					}
+					proceed = trav.next();
+				}
+				partial[task] = std::move(acc);
+			});
+
+			for (const Acc& p : partial) {
+				combine(top, p);
+			}
+			return top;
+		}
+
+		// The same, for a visitor with nothing to reduce
+		template<typename TO, typename Visit>
+		void parallel_for_each(foundation::ws_pool& pool, typename TO::node_handle root, int split_depth, Visit visit)
+		{
+			struct nothing { };
+			parallel_reduce<TO>(pool, root, split_depth, nothing(),
+				[&](nothing&, typename TO::node_handle n, int depth) { visit(n, depth); },
+				[](nothing&, const nothing&) { });
+		}
+	}
+}
+
+#endif
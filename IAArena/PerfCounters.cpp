@@ -0,0 +1,161 @@
+
+#include <cerrno>
+#include <cstring>
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include "PerfCounters.h"
+
+#if defined(__linux__)
+namespace
+{
+	struct event_spec
+	{
+		std::uint32_t m_type;
+		std::uint64_t m_config;
+	};
+
+	const event_spec sm_events[foundation::PERF_KINDS] = {
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+		{ PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+	};
+
+	int open_event(const event_spec& e, int group_fd)
+	{
+		perf_event_attr attr;
+		std::memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = e.m_type;
+		attr.config = e.m_config;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		attr.disabled = group_fd < 0 ? 1 : 0;  // the leader starts the group
+
+		// This thread, on any CPU
+		return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+	}
+}
+
+foundation::perf_group::perf_group()
+	:m_leader(-1),
+	m_open(0)
+{
+	int first_error = 0;
+	for (int k = 0; k < PERF_KINDS; k++) {
+		m_fds[k] = open_event(sm_events[k], m_leader);
+		if (m_fds[k] < 0) {
+			if (first_error == 0) {
+				first_error = errno;
+			}
+			if (!m_status.empty()) {
+				m_status.append(", ");
+			}
+			m_status.append(kind_name((perf_kind)k));
+			continue;
+		}
+		if (m_leader < 0) {
+			m_leader = m_fds[k];
+		}
+		m_open++;
+	}
+
+	if (m_leader < 0) {
+		m_status = std::string("perf_event_open: ") + std::strerror(first_error);
+		return;
+	}
+	if (!m_status.empty()) {
+		m_status = "not counted: " + m_status;
+	}
+
+	ioctl(m_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(m_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+foundation::perf_group::~perf_group()
+{
+	// Members first, then the leader
+	for (int k = PERF_KINDS - 1; k >= 0; k--) {
+		if (m_fds[k] >= 0 && m_fds[k] != m_leader) {
+			close(m_fds[k]);
+		}
+	}
+	if (m_leader >= 0) {
+		close(m_leader);
+	}
+}
+
+bool foundation::perf_group::read(perf_reading& r)
+{
+	for (acount_t& v : r.m_values) {
+		v = 0;
+	}
+	r.m_enabled = 0;
+	r.m_running = 0;
+	if (!available()) {
+		return false;
+	}
+
+	// nr, time_enabled, time_running, then { value, id } for each event in the group
+	std::uint64_t buf[3 + 2 * PERF_KINDS];
+	ssize_t got = ::read(m_leader, buf, sizeof(buf));
+	if (got < (ssize_t)(3 * sizeof(std::uint64_t))) {
+		return false;
+	}
+
+	std::uint64_t nr = buf[0];
+	if (buf[2] == 0) {
+		// Enabled but never scheduled: whatever holds the counters will go on holding them
+		m_open = 0;
+		m_status = "the group has not run on the PMU (are its counters taken?)";
+		return false;
+	}
+	r.m_enabled = buf[1];
+	r.m_running = buf[2];
+
+	// The events come in the order they joined, which is the order of the open ones in m_fds
+	std::uint64_t i = 0;
+	for (int k = 0; k < PERF_KINDS && i < nr; k++) {
+		if (m_fds[k] >= 0) {
+			r.m_values[k] = (acount_t)buf[3 + 2 * i];
+			i++;
+		}
+	}
+	return true;
+}
+#else
+foundation::perf_group::perf_group()
+	:m_leader(-1),
+	m_open(0),
+	m_status("perf events are only counted on Linux")
+{
+	for (int& fd : m_fds) {
+		fd = -1;
+	}
+}
+
+foundation::perf_group::~perf_group()
+{ }
+
+bool foundation::perf_group::read(perf_reading& r)
+{
+	for (acount_t& v : r.m_values) {
+		v = 0;
+	}
+	r.m_enabled = 0;
+	r.m_running = 0;
+	return false;
+}
+#endif
+
+const char* foundation::perf_group::kind_name(perf_kind k)
+{
+	static const char* names[PERF_KINDS] = { "cycles", "instructions", "L1D misses", "LLC misses", "branch misses" };
+	return k < PERF_KINDS ? names[k] : "?";
+}
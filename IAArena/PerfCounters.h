@@ -0,0 +1,115 @@
+#ifndef _IA_PERF_COUNTERS_H_
+#define _IA_PERF_COUNTERS_H_
+
+#include <cstdint>
+#include <string>
+#include "FError.h"
+#include "TAnalytics.h"
+
+namespace foundation
+{
+	/* Hardware counters for the analytics counters: the CPU's own count of cycles, instructions,
+		cache misses and branch misses over a region of code, added into acounter dimensions.
+
+		A perf_group opens the events as one Linux perf_event group, so they are scheduled onto
+		the PMU together and their counts cover the same stretch of time.  It counts the thread
+		that opened it, in user space only (which perf_event_paranoid up to 2 allows).  An event
+		the CPU or the hypervisor does not have is left out; if none can be opened (another OS,
+		a container without perf_event_open, paranoid 3) the group is unavailable, says why, and
+		reads as all zeroes, so instrumented code runs the same either way.
+
+		A perf_scope reads the group when it opens and when it closes, and adds the difference
+		to a counter, through an acounter_map from the perf_kind dimensions to the counter's.
+		If the PMU had more events than counters and multiplexed them, the difference is scaled
+		up by how long the group was enabled over how long it ran, both over the scope alone.
+		A group that has never run (its counters all taken, by a pinned event or the NMI
+		watchdog) is unavailable from then on, and says so. */
+
+	enum perf_kind {
+		PERF_CYCLES,
+		PERF_INSTRUCTIONS,
+		PERF_L1D_MISSES,  // L1 data cache read misses
+		PERF_LLC_MISSES,  // last level cache misses
+		PERF_BRANCH_MISSES,
+		PERF_KINDS
+	};
+
+	// What the group has counted since it was opened, unscaled
+	struct perf_reading
+	{
+		acount_t m_values[PERF_KINDS];  // 0 for the missing kinds
+		std::uint64_t m_enabled;  // ns the group was enabled
+		std::uint64_t m_running;  // ns it was on the PMU; less than m_enabled if it was multiplexed
+	};
+
+	class perf_group
+	{
+	public:
+		perf_group();
+		~perf_group();
+
+		perf_group(const perf_group&) = delete;
+		perf_group& operator = (const perf_group&) = delete;
+
+		bool available() const { return m_open > 0; }
+		bool has(perf_kind k) const { return m_fds[k] >= 0; }
+
+		// Why the group is unavailable, or which events are missing; empty if all are there
+		const std::string& status() const { return m_status; }
+
+		/* The counts so far.  False, with the reading all zeroes, if the group is unavailable,
+			cannot be read, or has not run at all, which makes it unavailable. */
+		bool read(perf_reading& r);
+
+		static const char* kind_name(perf_kind k);
+	private:
+		int m_fds[PERF_KINDS];
+		int m_leader;
+		int m_open;
+		std::string m_status;
+	};
+
+	template<typename Counter>
+	class perf_scope
+	{
+	public:
+		perf_scope(perf_group& group, const acounter_map<PERF_KINDS>& map, Counter& counter)
+			:m_group(group),
+			m_map(map),
+			m_counter(counter)
+		{
+			m_started = m_group.read(m_start);
+		}
+
+		~perf_scope()
+		{
+			perf_reading end;
+			if (!m_started || !m_group.read(end)) {
+				return;
+			}
+
+			std::uint64_t enabled = end.m_enabled - m_start.m_enabled;
+			std::uint64_t running = end.m_running - m_start.m_running;
+			if (running == 0) {
+				return;  // not on the PMU for any of the scope
+			}
+			double scale = running < enabled ? (double)enabled / (double)running : 1.0;
+			for (dim_t k = 0; k < PERF_KINDS; k++) {
+				if (end.m_values[k] > m_start.m_values[k]) {
+					m_counter.add_to_counter((acount_t)((double)(end.m_values[k] - m_start.m_values[k]) * scale), m_map.lookup(k));
+				}
+			}
+		}
+
+		perf_scope(const perf_scope&) = delete;
+		perf_scope& operator = (const perf_scope&) = delete;
+	private:
+		perf_group& m_group;
+		const acounter_map<PERF_KINDS>& m_map;
+		Counter& m_counter;
+		perf_reading m_start;
+		bool m_started;
+	};
+}
+
+#endif
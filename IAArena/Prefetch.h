@@ -0,0 +1,23 @@
+#ifndef _IA_PREFETCH_H_
+#define _IA_PREFETCH_H_
+
+#if defined(_MSC_VER)
+#include <xmmintrin.h>
+#endif
+
+namespace foundation
+{
+	// Ask for the cache line at p, for reading.  Only a hint: p may be anything, even null.
+	inline void prefetch(const void* p)
+	{
+#if defined(_MSC_VER)
+		_mm_prefetch(static_cast<const char*>(p), _MM_HINT_T0);
+#elif defined(__GNUC__)
+		__builtin_prefetch(p);
+#else
+		(void)p;
+#endif
+	}
+}
+
+#endif
@@ -0,0 +1,153 @@
+
+#include <cstring>
+#include <iostream>
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "Snapshot.h"
+
+namespace
+{
+	const char sm_magic[8] = {'I', 'A', 'T', 'R', 'E', 'E', '\r', '\n'};
+
+	inline std::uint64_t rotl(std::uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+	inline std::uint64_t mix(std::uint64_t h, std::uint64_t w)
+	{
+		h ^= rotl(w * 0x87c37b91114253d5ULL, 31) * 0x4cf5ad432745937fULL;
+		return rotl(h, 27) * 5 + 0x52dce729;
+	}
+}
+
+std::uint64_t dstruct::snapshot::checksum(const void* data, size_t bytes)
+{
+	const unsigned char* p = static_cast<const unsigned char*>(data);
+	std::uint64_t h = 0x9e3779b97f4a7c15ULL ^ bytes;
+
+	size_t words = bytes / 8;
+	for (size_t i = 0; i < words; ++i) {
+		std::uint64_t w;
+		std::memcpy(&w, p + 8 * i, 8);
+		h = mix(h, w);
+	}
+	if (bytes % 8) {
+		std::uint64_t w = 0;
+		std::memcpy(&w, p + 8 * words, bytes % 8);
+		h = mix(h, w);
+	}
+
+	// Spread the last words into every bit
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return h;
+}
+
+void dstruct::snapshot::set_magic(file_header& h)
+{
+	std::memcpy(h.m_magic, sm_magic, sizeof(sm_magic));
+}
+
+bool dstruct::snapshot::has_magic(const file_header& h)
+{
+	// The version is part of it: in the other byte order it reads as a huge number
+	return std::memcmp(h.m_magic, sm_magic, sizeof(sm_magic)) == 0 && h.m_version <= 0xffff;
+}
+
+dstruct::snapshot::mapped_file::mapped_file()
+	:m_data(nullptr),
+	m_size(0)
+#if defined(_WIN32)
+	, m_file(INVALID_HANDLE_VALUE),
+	m_mapping(nullptr)
+#endif
+{ }
+
+dstruct::snapshot::mapped_file::~mapped_file()
+{
+	close();
+}
+
+void dstruct::snapshot::mapped_file::open(const char* path)
+{
+	close();
+#if defined(_WIN32)
+	m_file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE) {
+		throw foundation::foundation_exception("cannot open file", "mapped_file::open");
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_file, &size)) {
+		close();
+		throw foundation::foundation_exception("cannot size file", "mapped_file::open");
+	}
+	m_size = (size_t)size.QuadPart;
+	if (m_size == 0) {
+		return;  // nothing to map
+	}
+	m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_mapping == nullptr) {
+		close();
+		throw foundation::foundation_exception("cannot map file", "mapped_file::open");
+	}
+	m_data = static_cast<const unsigned char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+	if (m_data == nullptr) {
+		close();
+		throw foundation::foundation_exception("cannot map file", "mapped_file::open");
+	}
+#else
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0) {
+		throw foundation::foundation_exception("cannot open file", "mapped_file::open");
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		::close(fd);
+		throw foundation::foundation_exception("cannot size file", "mapped_file::open");
+	}
+	m_size = (size_t)st.st_size;
+	if (m_size == 0) {
+		::close(fd);
+		return;  // nothing to map
+	}
+	void* p = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);  // the mapping keeps the file
+	if (p == MAP_FAILED) {
+		m_size = 0;
+		throw foundation::foundation_exception("cannot map file", "mapped_file::open");
+	}
+	m_data = static_cast<const unsigned char*>(p);
+#endif
+}
+
+void dstruct::snapshot::mapped_file::close()
+{
+#if defined(_WIN32)
+	if (m_data) {
+		UnmapViewOfFile(m_data);
+	}
+	if (m_mapping) {
+		CloseHandle(m_mapping);
+	}
+	if (m_file != INVALID_HANDLE_VALUE) {
+		CloseHandle(m_file);
+	}
+	m_mapping = nullptr;
+	m_file = INVALID_HANDLE_VALUE;
+#else
+	if (m_data) {
+		munmap(const_cast<unsigned char*>(m_data), m_size);
+	}
+#endif
+	m_data = nullptr;
+	m_size = 0;
+}
+
+template struct dstruct::snapshot::ops<long>;
+template struct dstruct::snapshot::ops<int>;
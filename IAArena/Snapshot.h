@@ -0,0 +1,493 @@
+#ifndef _IA_SNAPSHOT_H_
+#define _IA_SNAPSHOT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "FError.h"
+#include "TraversalIface.h"
+#include "CheckPolicy.h"
+#include "ContextBinding.h"
+#include "Prefetch.h"
+#include "BinaryTree.h"
+#include "CompactTree.h"
+#include "Traversal.h"
+
+namespace dstruct
+{
+	/* Snapshots: a binary tree saved to a file that is read back by mapping it, with no
+		pass over the nodes to rebuild anything.
+
+		The file is a header and then an array of records, one per node, in preorder.  A record
+		is the key and three 32-bit record numbers (left, right, parent), 0 for none; record 0
+		is a blank, so a record number is a compact_tree::handle as it stands.  Nothing in the
+		file is a pointer, so it can be mapped anywhere.  The header carries the sizes the
+		reader has to agree on and a checksum of the records.
+
+		Numbers are in the byte order of the machine that wrote them: a snapshot read on a machine
+		of the other order fails the magic check.
+
+		snapshot_file maps the file; snapshot::ops reads the tree bound on the thread, read-only,
+		as frozen::ops does, so the traversers, ranges and printers work on it directly. */
+
+	namespace snapshot
+	{
+		using bin_tree_sample::ichild;
+		using bin_tree_sample::ilabel;
+		using bin_tree_sample::CHILD_PRE;
+		using bin_tree_sample::CHILD_LEFT;
+		using bin_tree_sample::CHILD_RIGHT;
+		using bin_tree_sample::CHILD_FINAL;
+		using bin_tree_sample::LABEL_INVALID;
+		using bin_tree_sample::LABEL_LEFT;
+		using bin_tree_sample::LABEL_RIGHT;
+		using bin_tree_sample::LABEL_PARENT;
+
+		using handle = compact_tree::handle;
+		using cindex = compact_tree::cindex;
+
+		static const std::uint32_t SNAPSHOT_VERSION = 1;
+		static const size_t SNAPSHOT_RECORDS_AT = 64;  // the records start a cache line into the file
+
+		struct file_header
+		{
+			char m_magic[8];  // "IATREE\r\n": a text-mode copy changes it
+			std::uint32_t m_version;
+			std::uint32_t m_key_size;
+			std::uint32_t m_record_size;
+			cindex m_root;  // 0 for an empty tree
+			std::uint64_t m_count;  // nodes; the records are 0..m_count
+			std::uint32_t m_height;
+			std::uint32_t m_reserved;
+			std::uint64_t m_checksum;  // of the records, record 0 included
+		};
+
+		static_assert(sizeof(file_header) <= SNAPSHOT_RECORDS_AT, "snapshot -- the header fits before the records");
+
+		template<typename Key>
+		struct record
+		{
+			Key m_key;
+			cindex m_edges[3];  // left-child, right-child, parent
+		};
+
+		// 64 bits of hash over a block of memory, eight bytes a step
+		std::uint64_t checksum(const void* data, size_t bytes);
+
+		void set_magic(file_header& h);
+		bool has_magic(const file_header& h);
+
+		// A whole file mapped read-only.  Unmapped when the object goes.
+		class mapped_file
+		{
+		public:
+			mapped_file();
+			~mapped_file();
+
+			mapped_file(const mapped_file&) = delete;
+			mapped_file& operator = (const mapped_file&) = delete;
+
+			void open(const char* path);
+			void close();
+
+			const unsigned char* data() const { return m_data; }
+			size_t size() const { return m_size; }
+		private:
+			const unsigned char* m_data;
+			size_t m_size;
+#if defined(_WIN32)
+			void* m_file;
+			void* m_mapping;
+#endif
+		};
+
+		/* Save the tree under root (any binary tree ops with get_key) to path.
+			The records are numbered in preorder as child_order_tr reaches them, so a left child is
+			the record after its parent, and a search going left reads on in the same page. */
+		template<typename TO>
+		void save(typename TO::node_handle root, const char* path)
+		{
+			using Key = typename TO::key_type;
+			using node_handle = typename TO::node_handle;
+
+			std::vector<record<Key> > records(1);
+			std::memset(&records[0], 0, sizeof(record<Key>));
+
+			std::vector<cindex> at_depth;  // the record number of the node on the path at each depth
+			std::vector<node_handle> path_nodes;
+			std::uint32_t height = 0;
+
+			ttraversal::child_order_tr<TO> trav(root);
+			while (trav.depth() >= 0) {
+				int d = trav.depth();
+				node_handle n = trav.node(0);
+				if (TO::is_index_pre(n, trav.location(0))) {
+					if (records.size() > (size_t)UINT32_MAX) {
+						throw foundation::foundation_exception("too many nodes for a snapshot", "snapshot::save");
+					}
+					cindex me = (cindex)records.size();
+					records.emplace_back();
+					record<Key>& r = records.back();
+					std::memset(&r, 0, sizeof(r));
+					r.m_key = TO::get_key(n);
+
+					if ((int)at_depth.size() <= d) {
+						at_depth.resize(d + 1);
+						path_nodes.resize(d + 1);
+					}
+					at_depth[d] = me;
+					path_nodes[d] = n;
+					if (d > 0) {
+						r.m_edges[LABEL_PARENT] = at_depth[d - 1];
+						records[at_depth[d - 1]].m_edges[TO::get_child_index(path_nodes[d - 1], n)] = me;
+					}
+					height = (std::uint32_t)d + 1 > height ? (std::uint32_t)d + 1 : height;
+				}
+				trav.next();
+			}
+
+			file_header h;
+			std::memset(&h, 0, sizeof(h));
+			set_magic(h);
+			h.m_version = SNAPSHOT_VERSION;
+			h.m_key_size = sizeof(Key);
+			h.m_record_size = sizeof(record<Key>);
+			h.m_root = records.size() > 1 ? 1 : 0;
+			h.m_count = records.size() - 1;
+			h.m_height = height;
+			h.m_checksum = checksum(records.data(), records.size() * sizeof(record<Key>));
+
+			std::FILE* f = std::fopen(path, "wb");
+			if (f == nullptr) {
+				throw foundation::foundation_exception("cannot create file", "snapshot::save");
+			}
+			unsigned char head[SNAPSHOT_RECORDS_AT] = {};
+			std::memcpy(head, &h, sizeof(h));
+			bool ok = std::fwrite(head, 1, sizeof(head), f) == sizeof(head)
+				&& std::fwrite(records.data(), sizeof(record<Key>), records.size(), f) == records.size();
+			ok = std::fclose(f) == 0 && ok;
+			if (!ok) {
+				throw foundation::foundation_exception("cannot write file", "snapshot::save");
+			}
+		}
+
+		/* A saved tree, mapped.  Opening checks the header and, unless asked not to, the checksum
+			and that the records are one tree: every edge names a record in the file, every child's
+			parent edge leads back to it, the root has no parent, and every record is reached from
+			the root.  The height is measured in the same pass, not taken from the header.
+			verify=false skips the pass over the records, and is for trusted files only: the edges
+			of a damaged file are followed as they are, out of the mapping or round a loop if that
+			is where they lead.  The header's height is still held to the node count, as the
+			traversers size their stacks by it. */
+		template<typename Key>
+		class snapshot_file
+		{
+		public:
+			using key_type = Key;
+
+			snapshot_file()
+				:m_records(nullptr),
+				m_count(0),
+				m_root(0),
+				m_height(0)
+			{ }
+
+			snapshot_file(const char* path, bool verify = true)
+				:snapshot_file()
+			{
+				open(path, verify);
+			}
+
+			void open(const char* path, bool verify = true)
+			{
+				m_file.open(path);
+
+				file_header h;
+				if (m_file.size() < SNAPSHOT_RECORDS_AT) {
+					fail("file too short for a snapshot");
+				}
+				std::memcpy(&h, m_file.data(), sizeof(h));
+				if (!has_magic(h)) {
+					fail("not a snapshot, or written with the other byte order");
+				}
+				if (h.m_version != SNAPSHOT_VERSION) {
+					fail("snapshot version not supported");
+				}
+				if (h.m_key_size != sizeof(Key) || h.m_record_size != sizeof(record<Key>)) {
+					fail("snapshot written with another key type");
+				}
+				size_t bytes = (size_t)(h.m_count + 1) * sizeof(record<Key>);
+				if (h.m_count > (std::uint64_t)UINT32_MAX || m_file.size() - SNAPSHOT_RECORDS_AT < bytes
+					|| h.m_root > h.m_count || h.m_height > h.m_count) {
+					fail("snapshot truncated or damaged");
+				}
+
+				m_records = reinterpret_cast<const record<Key>*>(m_file.data() + SNAPSHOT_RECORDS_AT);
+				if (verify) {
+					if (checksum(m_records, bytes) != h.m_checksum) {
+						fail("snapshot checksum does not match");
+					}
+					// A checksum can match damage it was computed over; an edge must not lead out of the records
+					for (std::uint64_t i = 0; i <= h.m_count; i++) {
+						const cindex* e = m_records[i].m_edges;
+						if (e[LABEL_LEFT] > h.m_count || e[LABEL_RIGHT] > h.m_count || e[LABEL_PARENT] > h.m_count) {
+							fail("snapshot edge out of range");
+						}
+					}
+
+					// Each child names its parent, so no record has two ways in; with none into the root, nothing loops
+					if ((h.m_root == 0) != (h.m_count == 0) || m_records[h.m_root].m_edges[LABEL_PARENT] != 0) {
+						fail("snapshot root damaged");
+					}
+					for (std::uint64_t i = 1; i <= h.m_count; i++) {
+						const cindex* e = m_records[i].m_edges;
+						if ((e[LABEL_LEFT] != 0 && m_records[e[LABEL_LEFT]].m_edges[LABEL_PARENT] != i)
+							|| (e[LABEL_RIGHT] != 0 && m_records[e[LABEL_RIGHT]].m_edges[LABEL_PARENT] != i)
+							|| (e[LABEL_LEFT] != 0 && e[LABEL_LEFT] == e[LABEL_RIGHT])) {
+							fail("snapshot parent and child edges disagree");
+						}
+					}
+
+					std::uint64_t reached = 0;
+					h.m_height = measure_height(h.m_root, reached);
+					if (reached != h.m_count) {
+						fail("snapshot records not all in the tree");
+					}
+				}
+
+				m_count = (size_t)h.m_count;
+				m_root = h.m_root;
+				m_height = (int)h.m_height;
+			}
+
+			size_t size() const { return m_count; }
+			int height() const { return m_height; }
+			handle root() const { return handle(m_root); }
+
+			const Key& key(handle n) const { return m_records[n.m_idx].m_key; }
+			handle child(handle n, int right) const { return handle(m_records[n.m_idx].m_edges[right]); }
+			handle parent(handle n) const { return handle(m_records[n.m_idx].m_edges[LABEL_PARENT]); }
+			const record<Key>& at(handle n) const { return m_records[n.m_idx]; }
+		private:
+			// The height of the tree under root, and how many records it has; the edges must already be checked
+			std::uint32_t measure_height(cindex root, std::uint64_t& reached) const
+			{
+				struct at_depth
+				{
+					cindex m_idx;
+					std::uint32_t m_depth;
+				};
+
+				std::uint32_t height = 0;
+				std::vector<at_depth> stack;
+				if (root != 0) {
+					stack.push_back(at_depth{ root, 1 });
+				}
+				while (!stack.empty()) {
+					at_depth cur = stack.back();
+					stack.pop_back();
+					reached++;
+					height = cur.m_depth > height ? cur.m_depth : height;
+					const cindex* e = m_records[cur.m_idx].m_edges;
+					if (e[LABEL_RIGHT] != 0) {
+						stack.push_back(at_depth{ e[LABEL_RIGHT], cur.m_depth + 1 });
+					}
+					if (e[LABEL_LEFT] != 0) {
+						stack.push_back(at_depth{ e[LABEL_LEFT], cur.m_depth + 1 });
+					}
+				}
+				return height;
+			}
+
+			void fail(const char* what)
+			{
+				m_file.close();
+				m_records = nullptr;
+				throw foundation::foundation_exception(what, "snapshot_file::open");
+			}
+
+			mapped_file m_file;
+			const record<Key>* m_records;
+			size_t m_count;
+			cindex m_root;
+			int m_height;
+		};
+
+		// Read-only tree ops over the snapshot bound on this thread
+		template<typename Key = long, typename Check = foundation::check_default>
+		struct ops
+		{
+			using tree = snapshot_file<Key>;
+			using binding = foundation::context_binding<const tree>;
+			using check_policy = Check;
+			using node_handle = handle;
+			using node_index = ichild;
+			using node_label = ilabel;
+			using key_type = Key;
+			using sequence = unsigned int;
+
+			// Nothing changes, so there is nothing to validate
+			static const bool sm_concurrent = false;
+
+			static const ilabel sm_parent_lbl = LABEL_PARENT;
+			static const ilabel sm_invalid_lbl = LABEL_INVALID;
+			static const ilabel sm_left_lbl = LABEL_LEFT;
+			static const ilabel sm_right_lbl = LABEL_RIGHT;
+
+			static inline void check_label(ilabel lbl, const char* context)
+			{
+				if (lbl != LABEL_LEFT && lbl != LABEL_RIGHT && lbl != LABEL_PARENT)
+				{
+					std::string exc_c("snapshot_ops::");
+					exc_c.append(context);
+					throw foundation::foundation_exception("label not valid", exc_c.c_str());
+				}
+			}
+
+			static inline const tree& bound()
+			{
+				if (Check::sm_strict) {
+					if (binding::current() == nullptr) {
+						throw foundation::foundation_exception("no snapshot bound on this thread", "snapshot_ops::bound");
+					}
+				}
+				return *binding::current();
+			}
+
+			static inline void read_only(const char* context)
+			{
+				throw foundation::foundation_exception("a snapshot is read-only", context);
+			}
+
+			static inline handle root() { return bound().root(); }
+
+			static inline bool is_null(handle n) { return n.m_idx == 0; }
+			static inline bool is_index_pre(handle, ichild idx) { return idx == CHILD_PRE; }
+			static inline sequence get_seq(handle) { return 0; }
+			static inline sequence read_begin(handle) { return 0; }
+			static inline bool read_validate(handle, sequence) { return true; }
+
+			static inline Key get_key(handle n) { return bound().key(n); }
+			static inline void set_key(handle, Key) { read_only("snapshot_ops::set_key"); }
+
+			static inline bool has_child(handle n, int right) { return !is_null(bound().child(n, right)); }
+
+			static inline bool is_index_first(handle n, ichild idx)
+			{
+				if (has_child(n, 0)) {
+					return idx == CHILD_LEFT;
+				}
+				return has_child(n, 1) && idx == CHILD_RIGHT;
+			}
+
+			static inline bool is_index_post(handle n, ichild idx)
+			{
+				if (has_child(n, 1)) {
+					return idx == CHILD_RIGHT;
+				}
+				return has_child(n, 0) ? idx == CHILD_LEFT : idx == CHILD_PRE;
+			}
+
+			static inline bool is_index_final(handle, ichild idx) { return idx == CHILD_FINAL; }
+			static inline bool is_leaf(handle n) { return !has_child(n, 0) && !has_child(n, 1); }
+			static inline int tree_depth(handle) { return bound().height(); }
+
+			static inline void init_child_index(handle, ichild& idx) { idx = CHILD_PRE; }
+
+			static inline ichild get_next_index(ichild c)
+			{
+				return bin_tree_sample::ops<>::get_next_index(c);
+			}
+
+			static inline ichild get_prev_index(ichild c)
+			{
+				return bin_tree_sample::ops<>::get_prev_index(c);
+			}
+
+			static inline void increment_index(handle n, ichild& idx)
+			{
+				if (Check::sm_strict) {
+					if (idx >= CHILD_FINAL) {
+						throw foundation::foundation_exception("snapshot ops increment index-- index too large.");
+					}
+				}
+				idx = get_next_index(idx);
+				while (idx != CHILD_FINAL && !has_child(n, idx)) {
+					idx = get_next_index(idx);
+				}
+			}
+
+			static inline void decrement_index(handle n, ichild& idx)
+			{
+				if (Check::sm_strict) {
+					if (idx <= CHILD_PRE) {
+						throw foundation::foundation_exception("snapshot ops decrement index-- index too small.");
+					}
+				}
+				idx = get_prev_index(idx);
+				while (idx != CHILD_PRE && !has_child(n, idx)) {
+					idx = get_prev_index(idx);
+				}
+			}
+
+			static inline EExists peek_node_labeled(handle n, ilabel label)
+			{
+				return is_null(get_node_labeled(n, label)) ? UNEXISTS : EXISTS;
+			}
+
+			static inline handle get_node_labeled(handle n, ilabel lbl)
+			{
+				if (Check::sm_strict) {
+					check_label(lbl, "get_node_labeled");
+				}
+				return lbl == LABEL_PARENT ? bound().parent(n) : bound().child(n, lbl);
+			}
+
+			static inline handle get_node_at_index(handle n, ichild idx)
+			{
+				if (Check::sm_strict) {
+					if (idx != CHILD_LEFT && idx != CHILD_RIGHT) {
+						throw foundation::foundation_exception("index invalid.", "snapshot_ops::get_node_at_index");
+					}
+				}
+				return bound().child(n, idx);
+			}
+
+			static inline handle create_free_node() { read_only("snapshot_ops::create_free_node"); return handle(); }
+			static inline void recycle_node(handle) { read_only("snapshot_ops::recycle_node"); }
+			static inline void reserve_nodes(size_t) { }
+			static inline handle detach_node(handle, ilabel) { read_only("snapshot_ops::detach_node"); return handle(); }
+			static inline void attach_node(handle, ilabel, handle) { read_only("snapshot_ops::attach_node"); }
+
+			static inline void prefetch_node(handle n)
+			{
+				if (!is_null(n)) {
+					foundation::prefetch(&bound().at(n));
+				}
+			}
+
+			static inline ichild get_child_index(handle p, handle c)
+			{
+				return bound().child(p, 0) == c ? CHILD_LEFT : CHILD_RIGHT;
+			}
+
+			static inline ilabel get_index_label(handle, ichild idx)
+			{
+				return bin_tree_sample::ops<>::get_index_label(nullptr, idx);
+			}
+
+			static void copy_index(ichild& to, ichild& from) { to = from; }
+			static void move_index(ichild& to, ichild& from) { to = from; }
+			static void print_node(std::ostream& os, handle n)
+			{
+				os << get_key(n);
+			}
+		};
+	}
+}
+
+#endif
@@ -1,10 +1,25 @@
 #ifndef _IA_TANALYTICS_H_
 #define _IA_TANALYTICS_H_
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
 #include <vector>
 #include <type_traits>
+#include <utility>
 #include "FError.h"
 #include "Inputs.h"
+#include "NodeAllocator.h"
 
 namespace foundation
 {
@@ -30,16 +45,18 @@ namespace foundation
 	};
 
 	template<typename Measure, dim_t Dims>
-	class afunction : public abase
+	class afunction : public abase<Measure, Dims>
 	{
 	public:
+		virtual ~afunction() { }
+
 		virtual bool eval(const mvector<Measure>* vecm, af_result& result) = 0;
 	};
 
 	/* Each algorithm gets an analytics counter for its inputs.
 	   The trick is to provide an interface to some subset of its dimensions, with a mapping.
 	   We can do this relatively easily, using the same principles as std::bind.
-	  
+
 	   But the mapping should be constructed beforehand, rather than during execution. */
 
 	template<dim_t Dims>
@@ -55,7 +72,13 @@ namespace foundation
 			}
 		}
 
-		acounter_map(const acounter_template& rhs)
+		// From the target of each of my dimensions
+		explicit acounter_map(const dim_t (&mapping)[Dims])
+		{
+			memcpy(m_mapping, mapping, sizeof(m_mapping));
+		}
+
+		acounter_map(const acounter_map& rhs)
 		{
 			memcpy(m_mapping, rhs.m_mapping, sizeof(m_mapping));  // that's all
 		}
@@ -65,7 +88,7 @@ namespace foundation
 		{
 			if (Dims > Dimz)
 			{
-				throw foundation_exception("Creating acounter_map -- cannot create partial map.")
+				throw foundation_exception("Creating acounter_map -- cannot create partial map.");
 			}
 
 			for (dim_t d = 0; d < Dims; d++)
@@ -74,16 +97,16 @@ namespace foundation
 				dim_t target = map[2 * d + 1];
 
 				if (loc >= Dims) {
-					throw foundation_exception("Creating acounter_map -- my index is out of bounds.")
+					throw foundation_exception("Creating acounter_map -- my index is out of bounds.");
 				}
-				
+
 				if (target >= Dimz) {
-					throw foundation_exception("Creating acounter_map -- source map index is out of bounds.")
+					throw foundation_exception("Creating acounter_map -- source map index is out of bounds.");
 				}
-				
+
 				/* Now, compose the mapping.  We do this by looking up the final value of target.
 			      Note: we need to retrieve it, since we have no special access! */
-				m_mapping[loc] = bmap.lookup(target); 
+				m_mapping[loc] = bmap.lookup(target);
 			}
 		}
 
@@ -91,7 +114,7 @@ namespace foundation
 		{
 #ifdef _STRICT_CHECKS
 			if (s >= Dims) {
-				throw new foundation_exception("acounter_map::lookup -- index out of bounds.");
+				throw foundation_exception("acounter_map::lookup -- index out of bounds.");
 			}
 #endif
 			return m_mapping[s];
@@ -102,12 +125,14 @@ namespace foundation
 		dim_t m_mapping[Dims];
 	};
 
-	/* We have two kinds of counters: a real, full one used for the entire algorithm, 
+	/* We have two kinds of counters: a real, full one used for the entire algorithm,
 	and a pair formed by a wrapper with a mapping. */
 	template<dim_t Dims>
 	class acounter_base
 	{
 	public:
+		static const dim_t sm_dims = Dims;
+
 		static const acounter_map<Dims>& get_id_map()
 		{
 			return sm_map_identity;
@@ -117,13 +142,14 @@ namespace foundation
 	};
 
 	template<dim_t Dims>
-	acounter_map<Dims> acounter_base::sm_map_identity;
+	acounter_map<Dims> acounter_base<Dims>::sm_map_identity;
 
+	// The plain counter: one thread only
 	template<dim_t Dims>
 	class acounter : public acounter_base<Dims> {
 	public:
 
-		using acounter_base::get_id_map;
+		using acounter_base<Dims>::get_id_map;
 
 		acounter()
 		{
@@ -131,115 +157,537 @@ namespace foundation
 		}
 
 		void clear_counter() {
-			for (unsigned int& m : m_counters) { m = 0; }
+			for (acount_t& m : m_counters) { m = 0; }
 		}
 
 		void clear_counter_dim(dim_t d)
 		{
 #ifdef _STRICT_CHECKS
-			if (s >= Dims) {
-				throw new foundation_exception("acounter::clear_counter_dim -- index out of bounds.");
+			if (d >= Dims) {
+				throw foundation_exception("acounter::clear_counter_dim -- index out of bounds.");
 			}
 #endif
 			m_counters[d] = 0;
 		}
 
-		void add_to_counter(unsigned int delta, dim_t d = 0)
+		void add_to_counter(acount_t delta, dim_t d = 0)
 		{
 #ifdef _STRICT_CHECKS
-			if (s >= Dims) {
-				throw new foundation_exception("acounter::add_to_counter -- index out of bounds.");
+			if (d >= Dims) {
+				throw foundation_exception("acounter::add_to_counter -- index out of bounds.");
 			}
 #endif
 			m_counters[d] += delta;
 		}
+
+		acount_t get_counter(dim_t d = 0) const
+		{
+			return m_counters[d];
+		}
+
+		std::array<acount_t, Dims> snapshot() const
+		{
+			std::array<acount_t, Dims> out;
+			for (dim_t d = 0; d < Dims; d++) {
+				out[d] = m_counters[d];
+			}
+			return out;
+		}
+	private:
+		acount_t  m_counters[Dims];
+	};
+
+	/* Small numbers for the threads that are alive, so a counter can give each its own slot.
+	   A thread takes the lowest free number the first time it asks, and gives it back when it
+	   ends; the next thread to start takes it over, counts and all. */
+	class athread_slots
+	{
+	public:
+		static unsigned int current()
+		{
+			static thread_local holder sm_holder;
+			return sm_holder.m_slot;
+		}
+	private:
+		struct registry
+		{
+			std::mutex m_lock;
+			std::vector<unsigned int> m_free;
+			unsigned int m_next = 0;
+		};
+
+		static registry& get_registry()
+		{
+			static registry sm_registry;
+			return sm_registry;
+		}
+
+		struct holder
+		{
+			unsigned int m_slot;
+
+			holder()
+			{
+				registry& r = get_registry();
+				std::lock_guard<std::mutex> lock(r.m_lock);
+				if (r.m_free.empty()) {
+					m_slot = r.m_next++;
+				}
+				else {
+					// The lowest one, to keep the numbers dense
+					auto lowest = std::min_element(r.m_free.begin(), r.m_free.end());
+					m_slot = *lowest;
+					r.m_free.erase(lowest);
+				}
+			}
+
+			~holder()
+			{
+				registry& r = get_registry();
+				std::lock_guard<std::mutex> lock(r.m_lock);
+				r.m_free.push_back(m_slot);
+			}
+		};
+	};
+
+	/* A counter for many threads.
+	   Each thread counts in a shard of its own, a cache line (or more) of 64-bit counters that
+	   no other thread writes, so an increment is a plain load, add and store: no lock prefix and
+	   no line bouncing between cores.  The counters are relaxed atomics only so that readers may
+	   look at them while the owner counts.  A snapshot adds up the shards.
+
+	   Shards are made the first time a thread counts.  Threads beyond the first Shards share one
+	   more shard, with real atomic adds: slower, but still correct.
+	   Clearing does not touch the shards, which would race with their owners; it records what
+	   the counts are now, and later reads subtract that.  An add that races with a clear lands
+	   on one side of it or the other. */
+	template<dim_t Dims, unsigned int Shards = 64>
+	class acounter_sharded : public acounter_base<Dims> {
+	public:
+
+		using acounter_base<Dims>::get_id_map;
+
+		acounter_sharded()
+			:m_overflow(make_shard())
+		{
+			for (std::atomic<shard*>& s : m_shards) {
+				s.store(nullptr, std::memory_order_relaxed);
+			}
+			for (std::atomic<acount_t>& c : m_cleared) {
+				c.store(0, std::memory_order_relaxed);
+			}
+		}
+
+		~acounter_sharded()
+		{
+			for (std::atomic<shard*>& s : m_shards) {
+				release_shard(s.load(std::memory_order_relaxed));
+			}
+			release_shard(m_overflow);
+		}
+
+		acounter_sharded(const acounter_sharded&) = delete;
+		acounter_sharded& operator = (const acounter_sharded&) = delete;
+
+		void clear_counter()
+		{
+			for (dim_t d = 0; d < Dims; d++) {
+				clear_counter_dim(d);
+			}
+		}
+
+		void clear_counter_dim(dim_t d)
+		{
+#ifdef _STRICT_CHECKS
+			if (d >= Dims) {
+				throw foundation_exception("acounter_sharded::clear_counter_dim -- index out of bounds.");
+			}
+#endif
+			m_cleared[d].store(total(d), std::memory_order_relaxed);
+		}
+
+		inline void add_to_counter(acount_t delta, dim_t d = 0)
+		{
+#ifdef _STRICT_CHECKS
+			if (d >= Dims) {
+				throw foundation_exception("acounter_sharded::add_to_counter -- index out of bounds.");
+			}
+#endif
+			unsigned int slot = athread_slots::current();
+			if (slot < Shards) {
+				shard* s = m_shards[slot].load(std::memory_order_relaxed);  // only this thread stores it
+				if (s == nullptr) {
+					s = own_shard(slot);
+				}
+				std::atomic<acount_t>& c = s->m_counters[d];
+				c.store(c.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+			}
+			else {
+				m_overflow->m_counters[d].fetch_add(delta, std::memory_order_relaxed);
+			}
+		}
+
+		// All the threads' counts on d, since the last clear
+		acount_t get_counter(dim_t d = 0) const
+		{
+			return total(d) - m_cleared[d].load(std::memory_order_relaxed);
+		}
+
+		std::array<acount_t, Dims> snapshot() const
+		{
+			std::array<acount_t, Dims> out;
+			for (dim_t d = 0; d < Dims; d++) {
+				out[d] = get_counter(d);
+			}
+			return out;
+		}
+	private:
+		struct alignas(64) shard
+		{
+			std::atomic<acount_t> m_counters[Dims];
+		};
+
+		static shard* make_shard()
+		{
+			shard* s = static_cast<shard*>(aligned_allocate(sizeof(shard), alignof(shard)));
+			for (std::atomic<acount_t>& c : s->m_counters) {
+				new (&c) std::atomic<acount_t>(0);
+			}
+			return s;
+		}
+
+		static void release_shard(shard* s)
+		{
+			if (s) {
+				aligned_release(s);  // the atomics are trivially destructible
+			}
+		}
+
+		shard* own_shard(unsigned int slot)
+		{
+			shard* s = make_shard();
+			m_shards[slot].store(s, std::memory_order_release);  // seen by snapshots
+			return s;
+		}
+
+		acount_t total(dim_t d) const
+		{
+			acount_t sum = m_overflow->m_counters[d].load(std::memory_order_relaxed);
+			for (const std::atomic<shard*>& s : m_shards) {
+				const shard* p = s.load(std::memory_order_acquire);
+				if (p) {
+					sum += p->m_counters[d].load(std::memory_order_relaxed);
+				}
+			}
+			return sum;
+		}
+
+		std::atomic<shard*> m_shards[Shards];
+		shard* m_overflow;
+		std::atomic<acount_t> m_cleared[Dims];
+	};
+
+	/* Time series of a counter: snapshots taken now and then, kept in a ring of the last
+	   capacity.  Samples are taken on demand with sample(), or every period by a thread of
+	   the sampler's own between start() and stop().  Counter is acounter_sharded, or an
+	   acounter that only the sampling thread touches. */
+	template<typename Counter>
+	class acounter_sampler
+	{
+	public:
+		static const dim_t sm_dims = Counter::sm_dims;
+
+		struct sample
+		{
+			std::chrono::nanoseconds m_at;  // since the sampler was made
+			std::array<acount_t, sm_dims> m_values;
+		};
+
+		acounter_sampler(const Counter& counter, size_t capacity = 1024)
+			:m_counter(counter),
+			m_epoch(std::chrono::steady_clock::now()),
+			m_ring(capacity > 0 ? capacity : 1),
+			m_next(0),
+			m_size(0),
+			m_stopping(false)
+		{ }
+
+		~acounter_sampler()
+		{
+			stop();
+		}
+
+		acounter_sampler(const acounter_sampler&) = delete;
+		acounter_sampler& operator = (const acounter_sampler&) = delete;
+
+		void sample_now()
+		{
+			sample s;
+			s.m_at = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_epoch);
+			s.m_values = m_counter.snapshot();
+
+			std::lock_guard<std::mutex> lock(m_lock);
+			m_ring[m_next] = s;
+			m_next = (m_next + 1) % m_ring.size();
+			if (m_size < m_ring.size()) {
+				m_size++;
+			}
+		}
+
+		// Sample every period until stop()
+		void start(std::chrono::milliseconds period)
+		{
+			stop();
+			m_stopping = false;
+			m_thread = std::thread([this, period]()
+			{
+				std::unique_lock<std::mutex> lock(m_wait_lock);
+				while (!m_wake.wait_for(lock, period, [this]() { return m_stopping; })) {
+					sample_now();
+				}
+			});
+		}
+
+		void stop()
+		{
+			if (m_thread.joinable()) {
+				{
+					std::lock_guard<std::mutex> lock(m_wait_lock);
+					m_stopping = true;
+				}
+				m_wake.notify_all();
+				m_thread.join();
+			}
+		}
+
+		// The samples in the ring, oldest first
+		std::vector<sample> samples() const
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			std::vector<sample> out;
+			out.reserve(m_size);
+			size_t first = (m_next + m_ring.size() - m_size) % m_ring.size();
+			for (size_t i = 0; i < m_size; i++) {
+				out.push_back(m_ring[(first + i) % m_ring.size()]);
+			}
+			return out;
+		}
+
+		// One dimension of the samples, oldest first
+		std::vector<acount_t> series(dim_t d) const
+		{
+			std::vector<acount_t> out;
+			for (const sample& s : samples()) {
+				out.push_back(s.m_values[d]);
+			}
+			return out;
+		}
 	private:
-		unsigned int  m_counters[Dims];
+		const Counter& m_counter;
+		const std::chrono::steady_clock::time_point m_epoch;
+
+		mutable std::mutex m_lock;  // over the ring
+		std::vector<sample> m_ring;
+		size_t m_next;
+		size_t m_size;
+
+		std::thread m_thread;
+		std::mutex m_wait_lock;
+		std::condition_variable m_wake;
+		bool m_stopping;
 	};
 
-	template<dim_t Dimz, dim_t Dims>
-	class acounter_view 
+	// Counter is acounter<Dims> or acounter_sharded<Dims>
+	template<dim_t Dimz, dim_t Dims, typename Counter = acounter<Dims> >
+	class acounter_view
 	{
 	public:
-		acounter_view(const acounter_map<Dimz>* map, acounter<Dims>* base)
+		acounter_view(const acounter_map<Dimz>* map, Counter* base)
 			:m_map(map),
 			m_base(base)
 		{ }
 
 		void clear_counter()
 		{
-			const dim_t* cmapping = m_map.get_mapping();
+			const dim_t* cmapping = m_map->get_mapping();
 			for (dim_t d = 0; d < Dimz; d++)
 			{
 				m_base->clear_counter_dim(cmapping[d]);
 			}
 		}
-		
+
 		void clear_counter_dim(dim_t d)
 		{
 #ifdef _STRICT_CHECKS
-			if (s >= Dimz) {
-				throw new foundation_exception("acounter_view::clear_counter_dim -- index out of bounds.");
+			if (d >= Dimz) {
+				throw foundation_exception("acounter_view::clear_counter_dim -- index out of bounds.");
 			}
 #endif
 			return m_base->clear_counter_dim(m_map->lookup(d));
 		}
 
-		void add_to_counter(unsigned int delta, dim_t d = 0)
+		void add_to_counter(acount_t delta, dim_t d = 0)
 		{
 #ifdef _STRICT_CHECKS
-			if (s >= Dimz) {
-				throw new foundation_exception("acounter_view::add_to_counter -- index out of bounds.");
+			if (d >= Dimz) {
+				throw foundation_exception("acounter_view::add_to_counter -- index out of bounds.");
 			}
 #endif
 			m_base->add_to_counter(delta, m_map->lookup(d));
 		}
+
+		acount_t get_counter(dim_t d = 0) const
+		{
+			return m_base->get_counter(m_map->lookup(d));
+		}
 	private:
 		const acounter_map<Dimz>*  m_map;
-		acounter<Dims>*  m_base;
+		Counter*  m_base;
 	};
 
-	// The class below helps build and visualize recursion trees.  It incorporates a counter.
-	// NOTE: No shared pointers here.
-	struct arecursion_tree_node 
+	/* The same mappings, fixed at compile time.
+	   acounter_static_map<T0, T1, ...> sends dimension d to Td.  A view over one resolves every
+	   add_to_counter to its counter slot while compiling, so an instrumented hot path costs the
+	   add and nothing else: no map to load, no index to look up.  acounter_view with a runtime
+	   acounter_map is still there for mappings only known when the program runs. */
+	template<dim_t... Targets>
+	struct acounter_static_map
 	{
-		arecursion_tree_node* m_parent;
-		std::vector<arecursion_tree_node*> m_children;
-		unsigned int m_step_count;
+		static_assert(sizeof...(Targets) > 0, "acounter_static_map -- needs at least one dimension");
 
-		arecursion_tree_node()
-			:m_parent(nullptr),
-			m_step_count(0)
-		{ }
+		static const dim_t sm_dims = sizeof...(Targets);
 
-		~arecursion_tree_node()
+		static constexpr dim_t lookup(dim_t d)
 		{
-			for (arecursion_tree_node* c : m_children) {
-				delete c;
+			const dim_t mapping[] = { Targets... };
+#ifdef _STRICT_CHECKS
+			if (d >= sm_dims) {
+				throw foundation_exception("acounter_static_map::lookup -- index out of bounds.");
 			}
+#endif
+			return mapping[d];
+		}
 
-			// Invalidate myself in the parent's vector.  It's worth it
-			if (m_parent)
-			{
-				m_parent->invalidate_child(this);
+		// One more than the highest target: the least dimensions a counter under this map needs
+		static constexpr dim_t reach()
+		{
+			const dim_t mapping[] = { Targets... };
+			dim_t r = 0;
+			for (dim_t t : mapping) {
+				r = t + 1 > r ? t + 1 : r;
 			}
+			return r;
 		}
 
-		arecursion_tree_node(arecursion_tree_node* p)
-			:m_parent(p)
+		template<dim_t D>
+		struct at
+		{
+			static_assert(D < sizeof...(Targets), "acounter_static_map -- index out of bounds");
+			static const dim_t value = lookup(D);
+		};
+
+		// The same map for the runtime view
+		static acounter_map<sm_dims> to_map()
+		{
+			const dim_t mapping[] = { Targets... };
+			return acounter_map<sm_dims>(mapping);
+		}
+	};
+
+	template<typename Seq>
+	struct acounter_seq_map;
+
+	template<dim_t... Ds>
+	struct acounter_seq_map<std::integer_sequence<dim_t, Ds...> >
+	{
+		using type = acounter_static_map<Ds...>;
+	};
+
+	template<dim_t Dims>
+	using acounter_static_identity = typename acounter_seq_map<std::make_integer_sequence<dim_t, Dims> >::type;
+
+	/* The compile-time form of acounter_map's composing constructor: dimension d goes where
+	   Base sends Targets[d]. */
+	template<typename Base, dim_t... Targets>
+	using acounter_compose = acounter_static_map<Base::template at<Targets>::value...>;
+
+	// A view through a static map.  Counter is acounter<Dims> or acounter_sharded<Dims>
+	template<typename Map, typename Counter>
+	class acounter_static_view
+	{
+	public:
+		static_assert(Map::reach() <= Counter::sm_dims, "acounter_static_view -- the map goes past the counter's dimensions");
+
+		static const dim_t sm_dims = Map::sm_dims;
+
+		explicit acounter_static_view(Counter* base)
+			:m_base(base)
 		{ }
 
-	private:
-		void invalidate_child(arecursion_tree_node* child)
+		void clear_counter()
 		{
-			// Note: we preserve order here, so we can't shuffle nodes around
-			for (arecursion_tree_node*& c : m_children) {
-				if (c == child) {
-					c = nullptr;
-				}
+			for (dim_t d = 0; d < Map::sm_dims; d++) {
+				m_base->clear_counter_dim(Map::lookup(d));
 			}
 		}
 
+		void clear_counter_dim(dim_t d)
+		{
+			m_base->clear_counter_dim(Map::lookup(d));
+		}
+
+		// With a constant d, as instrumentation has, the lookup folds away
+		inline void add_to_counter(acount_t delta, dim_t d = 0)
+		{
+			m_base->add_to_counter(delta, Map::lookup(d));
+		}
+
+		// The slot fixed whatever the optimizer does
+		template<dim_t D = 0>
+		inline void add(acount_t delta)
+		{
+			m_base->add_to_counter(delta, Map::template at<D>::value);
+		}
+
+		acount_t get_counter(dim_t d = 0) const
+		{
+			return m_base->get_counter(Map::lookup(d));
+		}
+	private:
+		Counter*  m_base;
+	};
+
+	// The class below helps build and visualize recursion trees.  It incorporates a counter.
+	// NOTE: No shared pointers here.  Nodes live in the builder's arena and are never destroyed one by one.
+	struct arecursion_tree_node
+	{
+		arecursion_tree_node* m_parent;
+		arecursion_tree_node* m_first_child;
+		arecursion_tree_node* m_last_child;  // so a call is appended in O(1), in call order
+		arecursion_tree_node* m_next_sibling;
+		const char* m_name;  // of the function called, as given to push; null if none was
+		acount_t m_step_count;  // this call's own steps, not its callees'.  Final once the call is popped
+
+		arecursion_tree_node()
+			:m_parent(nullptr),
+			m_first_child(nullptr),
+			m_last_child(nullptr),
+			m_next_sibling(nullptr),
+			m_name(nullptr),
+			m_step_count(0)
+		{ }
+
+		void append_child(arecursion_tree_node* child)
+		{
+			child->m_parent = this;
+			if (m_last_child) {
+				m_last_child->m_next_sibling = child;
+			}
+			else {
+				m_first_child = child;
+			}
+			m_last_child = child;
+		}
 	};
 
 	// This data structure is built up as we pop out
@@ -248,39 +696,81 @@ namespace foundation
 		arecursion_tree_level* m_deeper;
 		arecursion_tree_level* m_shallower;
 
-		arecursion_tree_node* m_last_visited;  // used for the top node 
-		unsigned int m_level_sum;		
-		bool m_owner;
+		arecursion_tree_node* m_last_visited;  // the last call popped at this depth; null without a tree
+		acount_t m_level_sum;  // steps of the calls at this depth
+		acount_t m_calls;  // calls made at this depth
 
-		arecursion_tree_level(bool owner)
-			:m_shallower(nullptr),
-			m_deeper(nullptr),
+		arecursion_tree_level()
+			:m_deeper(nullptr),
+			m_shallower(nullptr),
 			m_last_visited(nullptr),
 			m_level_sum(0),
-			m_owner(owner)  // maintain this faithfully
+			m_calls(0)
 		{ }
+	};
+
+	/* Call paths with their steps, merged: every call along the same path of function names
+	   adds to one entry, so the size goes with the number of distinct paths, not of calls.
+	   This is what folded stacks (a;b;c steps), the input of flame graph tools, are made from;
+	   see write_folded_stacks in TAnalyticsUtils.h.
 
-		~arecursion_tree_level()
+	   Paths form a trie, in a vector; 0 is the empty path above the top-level calls.  Names are
+	   matched by pointer first and by text after, and kept as pointers: they must outlive the
+	   paths (string literals, usually). */
+	class arecursion_folded
+	{
+	public:
+		static const size_t sm_top = 0;
+		static const size_t sm_none = ~(size_t)0;
+
+		struct path
 		{
-			if (m_owner) {
-				// Go to the end and delete one by one
-				arecursion_tree_level* plast = this;
-				while (plast->m_deeper) {
-					plast = plast->m_deeper;
-				}
+			size_t m_parent;
+			size_t m_first_child;
+			size_t m_next_sibling;
+			const char* m_name;
+			acount_t m_steps;  // own steps of the calls along this path
+			acount_t m_calls;
+		};
+
+		arecursion_folded()
+		{
+			m_paths.push_back(path{sm_top, sm_none, sm_none, nullptr, 0, 0});
+		}
 
-				// Now destroy
-				while (plast != nullptr) {
-					plast = plast->m_shallower;
-					delete plast->m_deeper;
+		// The path of a call to name from the path parent, made the first time it is seen
+		size_t enter(size_t parent, const char* name)
+		{
+			size_t* link = &m_paths[parent].m_first_child;
+			while (*link != sm_none) {
+				const path& p = m_paths[*link];
+				if (same_name(p.m_name, name)) {
+					m_paths[*link].m_calls++;
+					return *link;
 				}
+				link = &m_paths[*link].m_next_sibling;
+			}
 
-				// Don't want to destroy myself -- I am being destroyed
+			size_t id = m_paths.size();
+			*link = id;  // before the push_back: link points into m_paths
+			m_paths.push_back(path{parent, sm_none, sm_none, name, 0, 1});
+			return id;
+		}
 
-				// Destroy the tree also
-				delete m_last_visited;  // this is the root of the tree
-			}
+		void add_steps(size_t p, acount_t steps)
+		{
+			m_paths[p].m_steps += steps;
+		}
+
+		const std::vector<path>& paths() const { return m_paths; }
+		size_t size() const { return m_paths.size() - 1; }
+	private:
+		static bool same_name(const char* a, const char* b)
+		{
+			return a == b || (a && b && strcmp(a, b) == 0);
 		}
+
+		std::vector<path> m_paths;
 	};
 
 	class arecursion_null_counter
@@ -289,97 +779,193 @@ namespace foundation
 		arecursion_null_counter()
 		{ }
 
-		inline void add_to_counter(unsigned int m, dim_t d)
+		inline void add_to_counter(acount_t m, dim_t d)
 		{ }  // do nothing
 	};
 
+	enum arecursion_mode {
+		AR_TREE,  // a node per call, and the level sums
+		AR_LEVELS  // the level sums and call counts only: memory in the depth, not the calls
+	};
+
+	/* Builds the recursion tree of an instrumented recursion: push() on entering a call,
+	   add_to_counter() for the steps it takes, pop() on leaving.
+
+	   The only memory taken per call is a node from the builder's own arena, and only in AR_TREE
+	   mode; when the builder goes, the arena's slabs go with it, without a walk over the nodes.
+	   AR_LEVELS keeps a frame per open call and a level per depth reached, so profiling can
+	   stay on for recursions of any number of calls.  In AR_TREE mode max_nodes bounds the tree:
+	   past it, calls are only counted in their levels, and dropped_calls() says how many.
+
+	   The builder carves its nodes with an arena_cursor, which binds nothing to the thread:
+	   builders may go in any order, and ap_arena in the code being profiled is left alone. */
 	template<typename Counter = arecursion_null_counter>
 	class arecursion_tree_builder
 	{
 	private:
-//		using arecursion_tree_level_t = arecursion_tree_level<Measure>;
-//		using arecursion_tree_node_t = arecursion_tree_node<Measure>;
+		using arecursion_tree_level_t = arecursion_tree_level;
+		using arecursion_tree_node_t = arecursion_tree_node;
+
+		struct frame
+		{
+			arecursion_tree_level_t* m_level;
+			arecursion_tree_node_t* m_node;  // null in AR_LEVELS mode, and past max_nodes
+			size_t m_path;  // in m_folded
+			acount_t m_steps;
+		};
 	public:
-		arecursion_tree_builder(const std::shared_ptr<Counter>& counter)
+		arecursion_tree_builder(const std::shared_ptr<Counter>& counter, arecursion_mode mode = AR_TREE,
+			size_t max_nodes = std::numeric_limits<size_t>::max())
 			:m_counter(counter),  // possibly nullptr
-			m_level(new arecursion_tree_level_t(true))
+			m_mode(mode),
+			m_max_nodes(max_nodes),
+			m_nodes(0),
+			m_dropped(0),
+			m_root(nullptr),
+			m_last_root(nullptr),
+			m_folded(nullptr),
+			m_arena(1 << 12),
+			m_cursor(m_arena)
 		{ }
 
-		// Call when entering a recursive function
-		void push()
+		arecursion_tree_builder(const arecursion_tree_builder&) = delete;
+		arecursion_tree_builder& operator = (const arecursion_tree_builder&) = delete;
+
+		/* Merge the calls into folded, as they are pushed and popped, from now on.  Works in either
+		   mode, and needs no tree.  Call between top-level calls. */
+		void fold_into(arecursion_folded* folded)
 		{
-			// I am somewhere.  I need to create the next child -- perhaps the first child
-			arecursion_tree_node_t* nn = new arecursion_tree_node_t();
+			m_folded = folded;
+		}
 
-			if (m_node_stack.size() > 0)
-			{
-				arecursion_tree_node_t* cur = m_node_stack.back();
-				cur->m_children.push_back(nn);
-				nn->m_parent = cur;
+		// Call when entering a recursive function, name it if you like
+		void push(const char* name = nullptr)
+		{
+			const size_t depth = m_node_stack.size();
+			arecursion_tree_level_t* level = depth > 0 ? m_node_stack.back().m_level->m_deeper
+				: (m_levels.empty() ? nullptr : &m_levels.front());
+			if (level == nullptr) {
+				m_levels.emplace_back();
+				level = &m_levels.back();
+				if (depth > 0) {
+					level->m_shallower = m_node_stack.back().m_level;
+					level->m_shallower->m_deeper = level;
+				}
+			}
+			level->m_calls++;
+
+			arecursion_tree_node_t* nn = nullptr;
+			if (m_mode == AR_TREE) {
+				// The caller has to be in the tree too, or there is nowhere to hang the call
+				arecursion_tree_node_t* cur = depth > 0 ? m_node_stack.back().m_node : nullptr;
+				if (m_nodes < m_max_nodes && (depth == 0 || cur != nullptr)) {
+					nn = m_cursor.allocate();
+					nn->m_name = name;
+					m_nodes++;
+					if (cur) {
+						cur->append_child(nn);
+					}
+					else if (m_last_root) {
+						m_last_root->m_next_sibling = nn;  // another top-level call
+						m_last_root = nn;
+					}
+					else {
+						m_root = m_last_root = nn;
+					}
+				}
+				else {
+					m_dropped++;
+				}
 			}
 
-			m_node_stack.push_back(nn);
-
-			// Create or get the next level
-			arecursion_tree_level_t* nl = m_level->m_deeper;
-			if (nl == nullptr)
-			{
-				nl = new arecursion_tree_level_t(false);
-				m_level->m_deeper = nl;
-				nl->m_shallower = m_level;
+			size_t path = 0;
+			if (m_folded) {
+				size_t caller = arecursion_folded::sm_top;
+				if (depth > 0) {
+					caller = m_node_stack.back().m_path;
+				}
+				path = m_folded->enter(caller, name);
 			}
+
+			m_node_stack.push_back(frame{level, nn, path, 0});
 		}
 
 		void pop()
 		{
 #ifdef _STRICT_CHECKS
 			if (m_node_stack.size () == 0) {
-				throw new foundation_exception("arecursion_tree_builder::pop -- cannot pop without nodes.");
+				throw foundation_exception("arecursion_tree_builder::pop -- cannot pop without nodes.");
 			}
 #endif
 
 			// Add the total to the level count
-			m_level->m_level_sum += m_node_stack.back()->m_step_count;
-			m_level->m_last_visited = m_node_stack.back();
+			const frame& f = m_node_stack.back();
+			f.m_level->m_level_sum += f.m_steps;
+			if (f.m_node) {
+				f.m_node->m_step_count = f.m_steps;
+				f.m_level->m_last_visited = f.m_node;
+			}
+			if (m_folded) {
+				m_folded->add_steps(f.m_path, f.m_steps);
+			}
 
 			// Return
 			m_node_stack.pop_back();
 		}
 
-		void add_to_counter(unsigned int delta, dim_t d = 0)
+		void add_to_counter(acount_t delta, dim_t d = 0)
 		{
 #ifdef _STRICT_CHECKS
 			if (d != 0) {
-				throw new foundation_exception("arecursion_tree_builder::add_to_counter -- index must be 0.");
+				throw foundation_exception("arecursion_tree_builder::add_to_counter -- index must be 0.");
 			}
 
 			if (m_node_stack.size() == 0) {
-				throw new foundation_exception("arecursion_tree_builder::add_to_counter -- must first call push.");
+				throw foundation_exception("arecursion_tree_builder::add_to_counter -- must first call push.");
 			}
 #endif
 
-			m_counter->add_to_counter(delta, 1);
-			m_node_stack.back()->m_step_count += delta;
+			if (m_counter) {
+				m_counter->add_to_counter(delta, 0);
+			}
+			m_node_stack.back().m_steps += delta;
 		}
 
-		std::shared_ptr<arecursion_tree_level_t> get_tree() { 
-			return m_level;
-		}  
-	private:
-		bool m_tree_disowned;
-		std::shared_ptr<Counter> m_counter;  // a one-dimensional counter.  Its measure should be the same as Measure
-		std::vector<arecursion_tree_node_t*>  m_node_stack;
-		std::shared_ptr<arecursion_level_t> m_level;
-	};
+		// The shallowest level; null before the first push
+		const arecursion_tree_level_t* get_levels() const {
+			return m_levels.empty() ? nullptr : &m_levels.front();
+		}
 
-	// Print a recursion tree in various ways
-	// The simplest way is to go down the levels and print the sums
+		// The first top-level call, its siblings the later ones; null in AR_LEVELS mode
+		const arecursion_tree_node_t* get_tree() const {
+			return m_root;
+		}
 
-	void print_arecursion_tree_levels(const arecursion_tree_level* base);
+		arecursion_mode mode() const { return m_mode; }
+		size_t depth() const { return m_node_stack.size(); }
+		size_t max_depth() const { return m_levels.size(); }
+		size_t node_count() const { return m_nodes; }
+		acount_t dropped_calls() const { return m_dropped; }
+	private:
+		std::shared_ptr<Counter> m_counter;  // a one-dimensional counter, or none
+		arecursion_mode m_mode;
+		size_t m_max_nodes;
+		size_t m_nodes;
+		acount_t m_dropped;
+
+		std::vector<frame>  m_node_stack;
+		std::deque<arecursion_tree_level_t> m_levels;  // a deque, so the levels' links stay put as it grows
+		arecursion_tree_node_t* m_root;
+		arecursion_tree_node_t* m_last_root;
+		arecursion_folded* m_folded;
+
+		node_arena<arecursion_tree_node_t> m_arena;
+		arena_cursor<arecursion_tree_node_t> m_cursor;
+	};
 
-	// Next, we can print a tree using a stack 
+	// The printers and exporters of recursion trees are in TAnalyticsUtils.h
 
-	// The most fundamental type of analytic function is an actual 
+	// The most fundamental type of analytic function is an actual complexity model: see Complexity.h
 
 }
 #endif
\ No newline at end of file
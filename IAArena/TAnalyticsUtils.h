@@ -1,10 +1,93 @@
 #ifndef _IA_TANALYTICS_UTILS_H_
 #define _IA_TANALYTICS_UTILS_H_
 
+#include <algorithm>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
 #include "TAnalytics.h"
 
 namespace foundation
 {
+	// Print a recursion tree in various ways
+	// The simplest way is to go down the levels and print the sums: depth, calls, steps
+	inline void print_arecursion_tree_levels(std::ostream& os, const arecursion_tree_level* base)
+	{
+		size_t depth = 0;
+		for (const arecursion_tree_level* l = base; l != nullptr; l = l->m_deeper, depth++) {
+			os << depth << ' ' << l->m_calls << ' ' << l->m_level_sum << '\n';
+		}
+	}
 
+	/* Merge a finished tree (a builder's get_tree(): the first top-level call, its siblings the
+	   rest) into folded.  The walk keeps its own stack, so a tree of any depth will do. */
+	inline void fold_arecursion_tree(const arecursion_tree_node* root, arecursion_folded& folded)
+	{
+		std::vector<std::pair<const arecursion_tree_node*, size_t> > stack;  // a call, and its caller's path
+		for (const arecursion_tree_node* n = root; n != nullptr; n = n->m_next_sibling) {
+			stack.emplace_back(n, size_t(arecursion_folded::sm_top));
+		}
+		std::reverse(stack.begin(), stack.end());  // the first call on top
+
+		std::vector<const arecursion_tree_node*> children;
+		while (!stack.empty()) {
+			const arecursion_tree_node* n = stack.back().first;
+			size_t path = folded.enter(stack.back().second, n->m_name);
+			stack.pop_back();
+			folded.add_steps(path, n->m_step_count);
+
+			children.clear();
+			for (const arecursion_tree_node* c = n->m_first_child; c != nullptr; c = c->m_next_sibling) {
+				children.push_back(c);
+			}
+			for (size_t i = children.size(); i-- > 0; ) {
+				stack.emplace_back(children[i], path);
+			}
+		}
+	}
+
+	/* Folded stacks, one line per path with steps of its own: the names from the top down,
+	   split by ';', then a space and the steps.  flamegraph.pl and its kin read this.
+	   Calls pushed without a name show as unnamed; ';' and line breaks in names become '_'. */
+	inline void write_folded_stacks(std::ostream& os, const arecursion_folded& folded, const char* unnamed = "call")
+	{
+		using path = arecursion_folded::path;
+		const std::vector<path>& paths = folded.paths();
+
+		// Depth first down the trie, with the line so far; each entry is a path and the length of the line above it
+		std::string line;
+		std::vector<std::pair<size_t, size_t> > stack;
+		auto push_children = [&](size_t p, size_t above)
+		{
+			size_t first = stack.size();
+			for (size_t c = paths[p].m_first_child; c != arecursion_folded::sm_none; c = paths[c].m_next_sibling) {
+				stack.emplace_back(c, above);
+			}
+			std::reverse(stack.begin() + first, stack.end());  // the first seen comes out first
+		};
+
+		push_children(arecursion_folded::sm_top, 0);
+		while (!stack.empty()) {
+			size_t id = stack.back().first;
+			const path& p = paths[id];
+			line.resize(stack.back().second);
+			stack.pop_back();
+
+			if (!line.empty()) {
+				line.push_back(';');
+			}
+			for (const char* c = p.m_name ? p.m_name : unnamed; *c; ++c) {
+				line.push_back(*c == ';' || *c == '\n' || *c == '\r' ? '_' : *c);
+			}
+
+			if (p.m_steps > 0) {
+				os.write(line.data(), (std::streamsize)line.size());
+				os << ' ' << p.m_steps << '\n';
+			}
+
+			push_children(id, line.size());
+		}
+	}
 }
-#endif
\ No newline at end of file
+#endif
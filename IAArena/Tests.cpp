@@ -0,0 +1,566 @@
+// Tests.cpp : the unit tests, a program of its own that exits non-zero if any check fails.
+//
+// The shapes the benchmarks never build: the empty tree, one node, nodes with one child and
+// duplicate keys, through the traversers, the ranges, construction and the LISP reader and writer,
+// reserved bulk builds into a compact pool, snapshots damaged behind a good checksum, and recursion
+// tree builders that outlive one another in any order.
+// The benchmarks time things; these only say whether they are right.
+
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "BinaryTree.h"
+#include "CompactTree.h"
+#include "Construction.h"
+#include "FError.h"
+#include "IOUtils.h"
+#include "LispIO.h"
+#include "Snapshot.h"
+#include "TAnalytics.h"
+#include "Traversal.h"
+#include "TraversalRange.h"
+#include "TreeUtils.h"
+
+namespace
+{
+	using namespace dstruct::bin_tree_sample;
+	using ops_t = ops<foundation::tp_single_thread, foundation::ap_heap>;
+	using node_handle = ops_t::node_handle;
+
+	int failures = 0;
+
+	void check(bool ok, const char* what, const char* file, int line)
+	{
+		if (!ok) {
+			std::cerr << file << ":" << line << ": failed: " << what << std::endl;
+			failures++;
+		}
+	}
+
+#define IA_CHECK(cond) check((cond), #cond, __FILE__, __LINE__)
+
+	// A node with key k, attached under lbl of parent if there is one
+	node_handle add_node(node_handle parent, ilabel lbl, long k)
+	{
+		node_handle n = ops_t::create_free_node();
+		ops_t::set_key(n, k);
+		if (parent) {
+			ops_t::attach_node(parent, lbl, n);
+		}
+		return n;
+	}
+
+	node_handle build_add_to_bst(const std::vector<long>& keys)
+	{
+		node_handle root = nullptr;
+		node_handle added = nullptr;
+		for (long k : keys) {
+			add_to_bst<foundation::tp_single_thread>(k, root, added);
+		}
+		return root;
+	}
+
+	node_handle build_construct_at_end(const std::vector<long>& keys)
+	{
+		node_handle root = nullptr;
+		for (long k : keys) {
+			auto condition = [&](node_handle bn, int) -> ilabel
+			{
+				return k <= bn->m_key ? LABEL_LEFT : LABEL_RIGHT;
+			};
+
+			auto initializer = [&](node_handle nn)
+			{
+				nn->m_key = k;
+			};
+
+			using l_tr = dstruct::ttraversal::linear_tr<decltype(condition), ops_t>;
+			dstruct::tconstruction::construct_at_end<l_tr>(root, initializer, condition);
+		}
+		return root;
+	}
+
+	// The node a search for k stops at, or null
+	node_handle find(node_handle root, long k)
+	{
+		auto condition = [&](node_handle bn, int) -> ilabel
+		{
+			return k == bn->m_key ? LABEL_INVALID : (k < bn->m_key ? LABEL_LEFT : LABEL_RIGHT);
+		};
+
+		dstruct::ttraversal::linear_tr<decltype(condition), ops_t> trav(root, condition);
+		while (trav.next());
+		return trav.node() != nullptr && trav.node()->m_key == k ? trav.node() : nullptr;
+	}
+
+	template<typename Range>
+	std::vector<long> keys_of(const Range& range)
+	{
+		std::vector<long> keys;
+		for (node_handle n : range) {
+			keys.push_back(n->m_key);
+		}
+		return keys;
+	}
+
+	template<typename Range>
+	std::vector<long> reverse_keys_of(const Range& range)
+	{
+		using rit = std::reverse_iterator<typename Range::iterator>;
+		std::vector<long> keys;
+		for (rit it(range.end()); it != rit(range.begin()); ++it) {
+			keys.push_back((*it)->m_key);
+		}
+		return keys;
+	}
+
+	// The keys in the order traverser Tr first comes to their nodes
+	template<typename Tr>
+	std::vector<long> preorder_keys(node_handle root)
+	{
+		Tr trav(root);
+		std::vector<long> keys;
+		bool proceed = trav.depth() >= 0;
+		while (proceed) {
+			if (ops_t::is_index_pre(trav.node(0), trav.location(0))) {
+				keys.push_back(trav.node(0)->m_key);
+			}
+			proceed = trav.next();
+		}
+		return keys;
+	}
+
+	std::vector<long> level_keys(node_handle root)
+	{
+		dstruct::ttraversal::level_order_tr<ops_t> trav(root);
+		std::vector<long> keys;
+		bool proceed = trav.depth() >= 0;
+		while (proceed) {
+			keys.push_back(trav.node()->m_key);
+			proceed = trav.next();
+		}
+		return keys;
+	}
+
+	// child_order_tr and parent_order_tr make the same (node, location, depth) steps, and end together
+	bool same_events(node_handle root)
+	{
+		dstruct::ttraversal::child_order_tr<ops_t> a(root);
+		dstruct::ttraversal::parent_order_tr<ops_t> b(root);
+		if (root == nullptr) {
+			return a.is_trivial() && b.is_trivial() && !a.next() && !b.next();
+		}
+
+		bool more_a = a.depth() >= 0;
+		bool more_b = b.depth() >= 0;
+		while (more_a && more_b) {
+			if (a.node(0) != b.node(0) || a.location(0) != b.location(0) || a.depth() != b.depth()) {
+				return false;
+			}
+			more_a = a.next();
+			more_b = b.next();
+		}
+		return more_a == more_b && a.depth() == b.depth();
+	}
+
+	std::string lisp_text(node_handle root)
+	{
+		std::ostringstream os;
+		{
+			print::tree::text_buffer out(os);
+			print::tree::write_lisp_tree<ops_t>(out, root);
+		}
+		return os.str();
+	}
+
+	node_handle read_lisp(const std::string& text)
+	{
+		std::istringstream is(text);
+		return print::tree::read_lisp_tree<ops_t>(is);
+	}
+
+	// True if reading text throws a foundation_exception
+	bool lisp_rejected(const std::string& text)
+	{
+		try {
+			node_handle root = read_lisp(text);
+			dstruct::tree_utils::destroy_tree<ops_t>(root);
+		}
+		catch (const foundation::foundation_exception&) {
+			return true;
+		}
+		return false;
+	}
+
+	// What a tree looks like to everything that walks it, checked against the orders expected
+	void check_shape(node_handle root, const std::vector<long>& pre, const std::vector<long>& in,
+		const std::vector<long>& post, const std::vector<long>& level)
+	{
+		using namespace dstruct::ttraversal;
+
+		IA_CHECK(keys_of(preorder_range<ops_t>(root)) == pre);
+		IA_CHECK(keys_of(inorder_range<ops_t>(root)) == in);
+		IA_CHECK(keys_of(postorder_range<ops_t>(root)) == post);
+		IA_CHECK(reverse_keys_of(preorder_range<ops_t>(root)) == std::vector<long>(pre.rbegin(), pre.rend()));
+		IA_CHECK(reverse_keys_of(inorder_range<ops_t>(root)) == std::vector<long>(in.rbegin(), in.rend()));
+		IA_CHECK(reverse_keys_of(postorder_range<ops_t>(root)) == std::vector<long>(post.rbegin(), post.rend()));
+
+		IA_CHECK(preorder_keys<child_order_tr<ops_t> >(root) == pre);
+		IA_CHECK(preorder_keys<parent_order_tr<ops_t> >(root) == pre);
+		IA_CHECK(level_keys(root) == level);
+		IA_CHECK(same_events(root));
+
+		// Written, read back and written again, the text is the same, and so is the tree
+		std::string text = lisp_text(root);
+		node_handle back = read_lisp(text);
+		IA_CHECK(lisp_text(back) == text);
+		IA_CHECK(keys_of(preorder_range<ops_t>(back)) == pre);
+		IA_CHECK(keys_of(inorder_range<ops_t>(back)) == in);
+		dstruct::tree_utils::destroy_tree<ops_t>(back);
+	}
+
+	void test_empty()
+	{
+		using namespace dstruct::ttraversal;
+
+		node_handle root = nullptr;
+		check_shape(root, {}, {}, {}, {});
+
+		child_order_tr<ops_t> child(root);
+		IA_CHECK(child.is_trivial() && child.depth() == -2 && !child.next());
+		parent_order_tr<ops_t> parent(root);
+		IA_CHECK(parent.is_trivial() && parent.depth() == -2 && !parent.next());
+		level_order_tr<ops_t> level(root);
+		IA_CHECK(level.is_trivial() && level.node() == nullptr && !level.next());
+
+		IA_CHECK(preorder_range<ops_t>(root).empty());
+		IA_CHECK(preorder_range<ops_t>(root).begin() == preorder_range<ops_t>(root).end());
+		IA_CHECK(key_range<ops_t>(root, LONG_MIN, LONG_MAX).empty());
+		IA_CHECK(find(root, 0) == nullptr);
+
+		IA_CHECK(lisp_text(root).empty());
+		IA_CHECK(read_lisp("") == nullptr);
+		IA_CHECK(read_lisp(" \n\t") == nullptr);
+
+		dstruct::tree_utils::destroy_tree<ops_t>(root);  // nothing to do
+	}
+
+	void test_single()
+	{
+		using namespace dstruct::ttraversal;
+
+		node_handle root = build_add_to_bst({ 42 });
+		check_shape(root, { 42 }, { 42 }, { 42 }, { 42 });
+		IA_CHECK(lisp_text(root) == "42");
+
+		// The root is the only event: the first next() ends the walk
+		child_order_tr<ops_t> child(root);
+		IA_CHECK(child.depth() == 0 && child.node(0) == root);
+		IA_CHECK(!child.next() && child.depth() == -1 && child.node(0) == nullptr);
+		parent_order_tr<ops_t> parent(root);
+		IA_CHECK(parent.depth() == 0 && parent.node(0) == root);
+		IA_CHECK(!parent.next() && parent.depth() == -1 && parent.node(0) == nullptr);
+
+		IA_CHECK(find(root, 42) == root);
+		IA_CHECK(find(root, 41) == nullptr);
+		IA_CHECK(find(root, 43) == nullptr);
+		IA_CHECK(keys_of(key_range<ops_t>(root, 42, 43)) == std::vector<long>({ 42 }));
+		IA_CHECK(key_range<ops_t>(root, 43, 100).empty());
+		IA_CHECK(key_range<ops_t>(root, 0, 42).empty());
+		dstruct::tree_utils::destroy_tree<ops_t>(root);
+
+		// The extremes of the key type survive the text
+		for (long k : { LONG_MIN, LONG_MAX, 0L, -1L }) {
+			root = add_node(nullptr, LABEL_INVALID, k);
+			check_shape(root, { k }, { k }, { k }, { k });
+			dstruct::tree_utils::destroy_tree<ops_t>(root);
+		}
+	}
+
+	void test_one_child()
+	{
+		// Sorted keys: every node has only a right child
+		node_handle root = build_add_to_bst({ 1, 2, 3, 4 });
+		check_shape(root, { 1, 2, 3, 4 }, { 1, 2, 3, 4 }, { 4, 3, 2, 1 }, { 1, 2, 3, 4 });
+		dstruct::tree_utils::destroy_tree<ops_t>(root);
+
+		// Reverse keys: only left children
+		root = build_add_to_bst({ 4, 3, 2, 1 });
+		check_shape(root, { 4, 3, 2, 1 }, { 1, 2, 3, 4 }, { 1, 2, 3, 4 }, { 4, 3, 2, 1 });
+		dstruct::tree_utils::destroy_tree<ops_t>(root);
+
+		// A lone right child, written with the empty left one before it
+		root = add_node(nullptr, LABEL_INVALID, 1);
+		add_node(root, LABEL_RIGHT, 2);
+		check_shape(root, { 1, 2 }, { 1, 2 }, { 2, 1 }, { 1, 2 });
+		IA_CHECK(find(root, 2) != nullptr);
+		dstruct::tree_utils::destroy_tree<ops_t>(root);
+
+		// Left, then right, then left again
+		root = add_node(nullptr, LABEL_INVALID, 10);
+		node_handle five = add_node(root, LABEL_LEFT, 5);
+		node_handle seven = add_node(five, LABEL_RIGHT, 7);
+		add_node(seven, LABEL_LEFT, 6);
+		check_shape(root, { 10, 5, 7, 6 }, { 5, 6, 7, 10 }, { 6, 7, 5, 10 }, { 10, 5, 7, 6 });
+		for (long k : { 5, 6, 7, 10 }) {
+			IA_CHECK(find(root, k) != nullptr);
+		}
+		IA_CHECK(keys_of(dstruct::ttraversal::key_range<ops_t>(root, 6, 10)) == std::vector<long>({ 6, 7 }));
+		dstruct::tree_utils::destroy_tree<ops_t>(root);
+	}
+
+	void test_duplicates()
+	{
+		using namespace dstruct::ttraversal;
+
+		// An equal key goes left, under add_to_bst and construct_at_end alike
+		const std::vector<long> keys = { 5, 3, 5, 5, 7, 3 };
+		node_handle root = build_add_to_bst(keys);
+		node_handle built = build_construct_at_end(keys);
+		IA_CHECK(lisp_text(root) == lisp_text(built));
+
+		check_shape(root, { 5, 3, 3, 5, 5, 7 }, { 3, 3, 5, 5, 5, 7 }, { 3, 5, 5, 3, 7, 5 }, { 5, 3, 7, 3, 5, 5 });
+		IA_CHECK(keys_of(key_range<ops_t>(root, 5, 6)) == std::vector<long>({ 5, 5, 5 }));
+		IA_CHECK(keys_of(key_range<ops_t>(root, 3, 5)) == std::vector<long>({ 3, 3 }));
+		IA_CHECK(find(root, 5) == root);
+
+		// In chunks smaller than the run of equal keys
+		key_scan<ops_t> scan(root, 0, 100);
+		std::vector<long> scanned;
+		long buf[2];
+		for (size_t got = scan.next_chunk(buf, 2); got > 0; got = scan.next_chunk(buf, 2)) {
+			scanned.insert(scanned.end(), buf, buf + got);
+		}
+		IA_CHECK(scan.done());
+		IA_CHECK(scanned == std::vector<long>({ 3, 3, 5, 5, 5, 7 }));
+
+		dstruct::tree_utils::destroy_tree<ops_t>(built);
+		dstruct::tree_utils::destroy_tree<ops_t>(root);
+
+		// All the same key: a chain to the left
+		root = build_add_to_bst({ 2, 2, 2 });
+		check_shape(root, { 2, 2, 2 }, { 2, 2, 2 }, { 2, 2, 2 }, { 2, 2, 2 });
+		IA_CHECK(keys_of(key_range<ops_t>(root, 2, 3)).size() == 3);
+		dstruct::tree_utils::destroy_tree<ops_t>(root);
+	}
+
+	void test_lisp_reader()
+	{
+		// 19 digits either side, and the one key whose magnitude is not a long long
+		node_handle root = read_lisp("(9223372036854775807 (-9223372036854775808 -999999999999999999))");
+		IA_CHECK(keys_of(dstruct::ttraversal::preorder_range<ops_t>(root)) == std::vector<long>({ LONG_MAX, LONG_MIN, -999999999999999999L }));
+		dstruct::tree_utils::destroy_tree<ops_t>(root);
+
+		root = read_lisp("007");
+		IA_CHECK(root != nullptr && root->m_key == 7);
+		dstruct::tree_utils::destroy_tree<ops_t>(root);
+
+		IA_CHECK(lisp_rejected("9223372036854775808"));
+		IA_CHECK(lisp_rejected("-9223372036854775809"));
+		IA_CHECK(lisp_rejected("99999999999999999999"));
+		IA_CHECK(lisp_rejected("-"));
+		IA_CHECK(lisp_rejected("()"));
+		IA_CHECK(lisp_rejected("(1"));
+		IA_CHECK(lisp_rejected("(1 (2"));
+		IA_CHECK(lisp_rejected("(1 (2 3 4))"));
+		IA_CHECK(lisp_rejected("1 2"));
+		IA_CHECK(lisp_rejected(")"));
+	}
+
+	void test_compact_reserve()
+	{
+		using cops_t = dstruct::compact_tree::ops<long>;
+		using chandle = cops_t::node_handle;
+
+		// A pool with recycled slots in it, and no room to spare
+		cops_t::pool pool;
+		cops_t::binding bind(pool);
+		std::vector<chandle> old;
+		for (int i = 0; i < 8; i++) {
+			old.push_back(cops_t::create_free_node());
+		}
+		for (int i = 0; i < 8; i += 2) {
+			cops_t::recycle_node(old[i]);
+		}
+
+		// A reserved build comes from one run at the end, in creation order, and never moves the pool
+		std::vector<long> keys;
+		for (long k = 0; k < 100; k++) {
+			keys.push_back(k);
+		}
+		auto constructor = [](chandle n, long k) { cops_t::set_key(n, k); };
+		cops_t::reserve_nodes(keys.size());  // as the build will: after this, nothing may move
+		const cops_t::mnode* before = &pool.at(0);
+		chandle root = dstruct::tconstruction::construct_balanced<cops_t>(keys.begin(), keys.end(), constructor);
+		IA_CHECK(&pool.at(0) == before);
+
+		std::vector<dstruct::compact_tree::cindex> created;
+		for (chandle n : dstruct::ttraversal::preorder_range<cops_t>(root)) {
+			created.push_back(n.m_idx);
+		}
+		bool contiguous = created.size() == keys.size();
+		for (size_t i = 0; i < created.size(); i++) {
+			contiguous = contiguous && created[i] == created[0] + i;
+		}
+		IA_CHECK(contiguous);
+		IA_CHECK(created[0] == old.back().m_idx + 1);
+
+		// Past the reservation, the recycled slots are used again
+		IA_CHECK(cops_t::create_free_node() == old[6]);
+	}
+
+	void test_balanced_orders()
+	{
+		using dstruct::tconstruction::construct_balanced;
+
+		std::vector<long> keys;
+		for (long k = 1; k <= 10; k++) {
+			keys.push_back(11 - k);  // sorted first
+		}
+		auto constructor = [](node_handle n, long k) { n->m_key = k; };
+
+		// Either order makes the same tree: each node takes the median of its range
+		const std::vector<long> pre = { 6, 3, 2, 1, 5, 4, 9, 8, 7, 10 };
+		const std::vector<long> in = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+		const std::vector<long> post = { 1, 2, 4, 5, 3, 7, 8, 10, 9, 6 };
+		const std::vector<long> level = { 6, 3, 9, 2, 5, 8, 10, 1, 4, 7 };
+		for (auto order : { dstruct::tconstruction::BULK_DFS, dstruct::tconstruction::BULK_BFS }) {
+			node_handle root = construct_balanced<ops_t>(keys.begin(), keys.end(), constructor, order);
+			check_shape(root, pre, in, post, level);
+			dstruct::tree_utils::destroy_tree<ops_t>(root);
+		}
+		std::vector<long> none;
+		IA_CHECK((construct_balanced<ops_t>(none.begin(), none.end(), constructor, dstruct::tconstruction::BULK_BFS)) == nullptr);
+	}
+
+	using snap_record = dstruct::snapshot::record<long>;
+	using snap_edit = std::function<void(dstruct::snapshot::file_header&, snap_record*)>;
+
+	/* Save a small tree, change the file with edit and put the checksum right again, then open it.
+		The height it opened with, or -1 if it was refused. */
+	int snapshot_opens(const snap_edit& edit, bool verify = true)
+	{
+		using dstruct::snapshot::SNAPSHOT_RECORDS_AT;
+		const char* path = "ia_tests_snapshot.bin";
+
+		// Records in preorder: 1:4 2:2 3:1 4:3 5:6 6:5 7:7
+		node_handle root = build_add_to_bst({ 4, 2, 6, 1, 3, 5, 7 });
+		dstruct::snapshot::save<ops_t>(root, path);
+		dstruct::tree_utils::destroy_tree<ops_t>(root);
+
+		std::vector<char> bytes;
+		{
+			std::ifstream in(path, std::ios::binary);
+			bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+		}
+		dstruct::snapshot::file_header h;
+		std::memcpy(&h, bytes.data(), sizeof(h));
+		snap_record* records = reinterpret_cast<snap_record*>(bytes.data() + SNAPSHOT_RECORDS_AT);
+		edit(h, records);
+		h.m_checksum = dstruct::snapshot::checksum(records, (size_t)(h.m_count + 1) * sizeof(snap_record));
+		std::memcpy(bytes.data(), &h, sizeof(h));
+		{
+			std::ofstream out(path, std::ios::binary);
+			out.write(bytes.data(), (std::streamsize)bytes.size());
+		}
+
+		int height = -1;
+		try {
+			dstruct::snapshot::snapshot_file<long> snap(path, verify);
+			height = snap.height();
+		}
+		catch (const foundation::foundation_exception&) {
+		}
+		std::remove(path);
+		return height;
+	}
+
+	void test_snapshot_verify()
+	{
+		using dstruct::snapshot::file_header;
+		const int LEFT = LABEL_LEFT, RIGHT = LABEL_RIGHT, PARENT = LABEL_PARENT;
+
+		IA_CHECK(snapshot_opens([](file_header&, snap_record*) { }) == 3);
+		IA_CHECK(snapshot_opens([](file_header&, snap_record*) { }, false) == 3);
+
+		// The height is measured, not taken from the header, and never believed past the node count
+		IA_CHECK(snapshot_opens([](file_header& h, snap_record*) { h.m_height = 1; }) == 3);
+		IA_CHECK(snapshot_opens([](file_header& h, snap_record*) { h.m_height = 3000000000u; }, false) == -1);
+		IA_CHECK(snapshot_opens([](file_header& h, snap_record*) { h.m_height = 3000000000u; }) == -1);
+
+		// A child whose parent edge leads elsewhere
+		IA_CHECK(snapshot_opens([=](file_header&, snap_record* r) { r[3].m_edges[PARENT] = 5; }) == -1);
+		// A loop back up, with the parent edges made to agree with it
+		IA_CHECK(snapshot_opens([=](file_header&, snap_record* r) { r[3].m_edges[LEFT] = 2; r[2].m_edges[PARENT] = 3; }) == -1);
+		// A parent above the root
+		IA_CHECK(snapshot_opens([=](file_header&, snap_record* r) { r[1].m_edges[PARENT] = 7; }) == -1);
+		// The same child twice
+		IA_CHECK(snapshot_opens([=](file_header&, snap_record* r) { r[2].m_edges[RIGHT] = 3; }) == -1);
+		// A subtree cut off from the root
+		IA_CHECK(snapshot_opens([=](file_header&, snap_record* r) { r[1].m_edges[RIGHT] = 0; }) == -1);
+		// An empty tree that says it has a root
+		IA_CHECK(snapshot_opens([](file_header& h, snap_record*) { h.m_count = 0; h.m_height = 0; }) == -1);
+	}
+
+	void test_recursion_builders()
+	{
+		using builder_t = foundation::arecursion_tree_builder<>;
+		using foundation::arecursion_tree_node;
+
+		// Two builders, the first made going first; neither is the thread's arena scope
+		std::unique_ptr<builder_t> a(new builder_t(nullptr));
+		std::unique_ptr<builder_t> b(new builder_t(nullptr));
+		for (int i = 0; i < 3; i++) {
+			a->push();
+			b->push();
+			b->pop();
+			a->pop();
+		}
+		IA_CHECK(foundation::arena_scope<arecursion_tree_node>::current() == nullptr);
+		a.reset();
+		b->push();
+		b->pop();
+		IA_CHECK(b->node_count() == 4);
+		b.reset();
+		IA_CHECK(foundation::arena_scope<arecursion_tree_node>::current() == nullptr);
+
+		// A scope opened around a builder is still the one ap_arena uses
+		foundation::node_arena<arecursion_tree_node> arena;
+		foundation::arena_scope<arecursion_tree_node> scope(arena);
+		{
+			builder_t inner(nullptr);
+			inner.push();
+			inner.pop();
+			IA_CHECK(foundation::arena_scope<arecursion_tree_node>::current() == &scope);
+		}
+		IA_CHECK(foundation::arena_scope<arecursion_tree_node>::current() == &scope);
+	}
+}
+
+int main()
+{
+	test_empty();
+	test_single();
+	test_one_child();
+	test_duplicates();
+	test_lisp_reader();
+	test_balanced_orders();
+	test_compact_reserve();
+	test_snapshot_verify();
+	test_recursion_builders();
+
+	if (failures) {
+		std::cerr << failures << " checks failed" << std::endl;
+		return 1;
+	}
+	std::cout << "all checks passed" << std::endl;
+	return 0;
+}
@@ -1,21 +1,76 @@
 #ifndef _IA_THREAD_POLICY
 #define _IA_THREAD_POLICY
 
+#include <atomic>
+#include <thread>
+
 namespace foundation
 {
+	/* A thread policy says how node fields shared between threads are declared, and how the
+	   sequence number of a node is used to guard it.
+
+	   Under tp_multi_thread the sequence is a seqlock: a writer makes it odd before it touches
+	   a node and even again when it is done.  A reader takes the (even) sequence with read_begin,
+	   reads what it needs, and keeps the result only if read_validate says the sequence did not move.
+	   Under tp_single_thread all of this is a plain counter and read_validate is constant true,
+	   so retry loops built on it compile away. */
+
 	struct tp_single_thread
 	{
-		template<typename I>
-		struct atomique {
-			using type = I;
-		};
+		static const bool sm_concurrent = false;
+
+		template<typename S>
+		static inline S read_begin(const S& seq) { return seq; }
+
+		template<typename S>
+		static inline bool read_validate(const S&, S) { return true; }
+
+		template<typename S>
+		static inline void write_begin(S& seq) { seq++; }
+
+		template<typename S>
+		static inline void write_end(S& seq) { seq++; }
 	};
 
 	struct tp_multi_thread
 	{
+		static const bool sm_concurrent = true;
+
+		// Wait for any writer to finish, then take the sequence
+		template<typename I>
+		static inline I read_begin(const std::atomic<I>& seq)
+		{
+			I s = seq.load(std::memory_order_acquire);
+			while (s & 1) {
+				std::this_thread::yield();
+				s = seq.load(std::memory_order_acquire);
+			}
+			return s;
+		}
+
+		// True if nothing was written since read_begin returned s
+		template<typename I>
+		static inline bool read_validate(const std::atomic<I>& seq, I s)
+		{
+			std::atomic_thread_fence(std::memory_order_acquire);
+			return seq.load(std::memory_order_relaxed) == s;
+		}
 
+		template<typename I>
+		static inline void write_begin(std::atomic<I>& seq)
+		{
+			seq.fetch_add(1, std::memory_order_relaxed);  // odd: keep out
+			std::atomic_thread_fence(std::memory_order_release);
+		}
+
+		template<typename I>
+		static inline void write_end(std::atomic<I>& seq)
+		{
+			seq.fetch_add(1, std::memory_order_release);  // even again
+		}
 	};
 
+	// How a policy declares a field of type I that threads share: atomique<P, I>::type
 	template<typename P, typename I>
 	struct atomique {
 	};
@@ -25,11 +80,24 @@ namespace foundation
 	{
 		using type = I;
 	};
-	
+
 	template<typename I>
 	struct atomique<tp_multi_thread, I>
 	{
 		using type = std::atomic<I>;
 	};
+
+	// The value held by a (possibly) atomic field
+	template<typename A>
+	struct atomique_value
+	{
+		using type = A;
+	};
+
+	template<typename I>
+	struct atomique_value<std::atomic<I> >
+	{
+		using type = I;
+	};
 }
 #endif
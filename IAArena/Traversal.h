@@ -4,6 +4,8 @@
 #include <type_traits>
 #include <vector>
 #include <algorithm> // max
+#include "FError.h"
+#include "InstrumentPolicy.h"
 #include "TraversalIface.h"
 
 namespace dstruct
@@ -35,14 +37,39 @@ namespace dstruct
 			int m_depth;
 		};
 
+		// check_strict: a child must name the node we reached it from as its parent
+		template<typename TO>
+		inline void check_parent_edge(typename TO::node_handle c, typename TO::node_handle p, const char* context)
+		{
+			if (TO::get_node_labeled(c, TO::sm_parent_lbl) != p) {
+				throw foundation::foundation_exception("child does not lead back to its parent", context);
+			}
+		}
+
+		// The instrumentation policy (InstrumentPolicy.h) of a traverser; instrument_none if it has none
+		template<typename Tr>
+		struct tr_void { using type = void; };
+
+		template<typename Tr, typename = void>
+		struct instrument_policy_of
+		{
+			using type = foundation::instrument_none;
+		};
+
+		template<typename Tr>
+		struct instrument_policy_of<Tr, typename tr_void<typename Tr::instrument_policy>::type>
+		{
+			using type = typename Tr::instrument_policy;
+		};
+
 		// A linear condition-based traversal, as when
 		// doing an eliminating search.
 
 		// The arrow depends on the result of the direction predicate, which 
 		// produces a label
 
-		template<class DirPred, class TO>
-		class linear_tr 
+		template<class DirPred, class TO, class Instr = foundation::instrument_none>
+		class linear_tr : private Instr::op
 		{
 		private:
 			using node_handle_t = typename TO::node_handle;
@@ -51,6 +78,7 @@ namespace dstruct
 		public:
 			using tree_ops_t = TO;
 			using initializer = DirPred;  // If I needed to pack this, I could do it easily
+			using instrument_policy = Instr;
 
 			// At each node, the arrow is defined by DirPred
 			linear_tr(node_handle_t root, DirPred& pred)
@@ -83,6 +111,7 @@ namespace dstruct
 					return false;  // already at end, pointing at oblivion
 				}
 
+				this->on_arrow(static_cast<int>(m_next));
 				follow_arrow();
 				compute_arrow();
 				return m_next_node != nullptr;
@@ -92,11 +121,23 @@ namespace dstruct
 			{
 				if (m_depth == -1) {  // tree with no root
 					m_next = TO::sm_invalid_lbl;
+					refresh_arrow();
+					return;
 				}
-				else {
-					m_next = m_predicate(m_stack[m_depth], m_depth);
+
+				// Decide and look at the next node in one validated read; a writer
+				// in between sends us round again (never, in a single-threaded tree)
+				node_handle_t cur = m_stack[m_depth];
+				typename TO::sequence s;
+				for (;;) {
+					s = TO::read_begin(cur);
+					m_next = m_predicate(cur, m_depth);
+					refresh_arrow();
+					if (TO::read_validate(cur, s)) {
+						break;
+					}
+					this->on_retry();
 				}
-				refresh_arrow();
 			}
 
 			node_handle_t follow_arrow()
@@ -112,8 +153,10 @@ namespace dstruct
 				if ((int)m_stack.size() <= m_depth)
 				{
 					m_stack.emplace_back();
+					this->on_growth();
 				}
 				m_stack[m_depth] = nh;
+				this->on_visit(m_depth);
 			}
 
 			DirPred m_predicate;
@@ -123,8 +166,14 @@ namespace dstruct
 			std::vector<node_handle_t> m_stack;
 		};
 
-		template<typename TO>
-		class child_order_tr : private tree_tr_base<TO>
+		/* The traversers below take a check policy (CheckPolicy.h), by default the tree's own.
+			With check_sequence they fail fast: every call checks that the current node has not been
+			changed since the traverser got there.  With check_strict they also check, on the way down,
+			that each child's parent edge leads back.  With check_none neither is compiled in, and
+			no sequence number is read.
+			child_order_tr also takes an instrumentation policy, by default none (InstrumentPolicy.h). */
+		template<typename TO, typename Check = typename TO::check_policy, typename Instr = foundation::instrument_none>
+		class child_order_tr : private tree_tr_base<TO>, private Instr::op
 		{
 		private:
 			using node_state_t = node_state<TO>;
@@ -132,10 +181,12 @@ namespace dstruct
 			using node_index_t = typename TO::node_index;
 			using node_label_t = typename TO::node_label;
 
+			// In a concurrent tree every read is validated as it is made, so there is nothing to fail on
 			inline void fail_fast() const
 			{
-				if (m_failfast)
+				if (Check::sm_sequence && !TO::sm_concurrent && m_depth >= 0)
 				{
+					this->on_check();
 					const node_state_t& cur = m_nstack[m_depth];
 					if (cur.m_seq != TO::get_seq(cur.m_node))
 					{
@@ -145,11 +196,12 @@ namespace dstruct
 			}
 		public:
 			using tree_ops = TO;
+			using instrument_policy = Instr;
 
-			child_order_tr(node_handle_t root, bool failfast = true)
+			explicit child_order_tr(node_handle_t root)
 				:m_nstack(TO::tree_depth(root)),  // 0 if unknown works
-				m_depth(-1),
-				m_failfast(failfast)
+				m_arrow(TO::sm_invalid_lbl),  // a trivial traverser has nowhere to go
+				m_depth(-1)
 			{
 				if (root) {
 					push_new_node(root);  // root is now the current node and depth is 0.  Guaranteed.
@@ -182,13 +234,15 @@ namespace dstruct
 
 				follow_arrow(); // and compute the next one
 
-				return !(m_depth == 0 && m_arrow == TO::sm_parent_lbl);
+				// A lone root starts where the walk ends, so its first step goes off the tree
+				return m_depth >= 0 && !(m_depth == 0 && m_arrow == TO::sm_parent_lbl);
 			}
 		private:
 			void follow_arrow()
 			{
 				// In this case, an arrow can point to a child or to the parent.
 				node_state_t& cur_old = m_nstack[m_depth];
+				this->on_arrow(static_cast<int>(m_arrow));
 
 				bool returning = false;
 				if (m_arrow == TO::sm_parent_lbl) {
@@ -196,22 +250,40 @@ namespace dstruct
 					returning = true;
 				}
 				else {
-					push_new_node(TO::get_node_labeled(cur_old.m_node, m_arrow));
+					node_handle_t child = TO::get_node_labeled(cur_old.m_node, m_arrow);
+					if (TO::sm_concurrent && TO::is_null(child)) {
+						// A writer took the child away: look at the node again and go where it says now
+						this->on_retry();
+						cur_old.m_next_index = cur_old.m_index;
+						advance_index(cur_old);
+						compute_arrow();
+						follow_arrow();
+						return;
+					}
+
+					if (Check::sm_strict) {
+						check_parent_edge<TO>(child, cur_old.m_node, "child_order_tr::follow_arrow");
+					}
+
+					// While we are down there, the parent's location is the child we went into
+					TO::copy_index(cur_old.m_index, cur_old.m_next_index);
+					push_new_node(child);
+				}
+
+				if (m_depth < 0) {  // we went too far
+					m_arrow = TO::sm_invalid_lbl;
+					return;
 				}
 
 				node_state_t& cur = m_nstack[m_depth];
 				// Get next index and compute the arrow from it
 				if (returning) {
 					TO::move_index(cur.m_index, cur.m_next_index);
-					TO::increment_index(cur.m_node, cur.m_next_index);
+					advance_index(cur);
 				}
 
 				// Now compute the arrow
-				if (m_depth >= 0) {
-					compute_arrow();
-				} else {  // we went too far
-					m_arrow = TO::sm_invalid_lbl;
-				}
+				compute_arrow();
 			}
 
 			void compute_arrow()
@@ -241,9 +313,11 @@ namespace dstruct
 				if (m_depth >= (int)m_nstack.size()) // incremental; difference cannot be more than 1
 				{
 					m_nstack.emplace_back();
+					this->on_growth();
 				}
 
 				reset_obj(m_nstack[m_depth], nh);
+				this->on_visit(m_depth);
 			}
 
 			void pop_node()
@@ -253,18 +327,379 @@ namespace dstruct
 
 			void reset_obj(node_state_t& o, node_handle_t nh)
 			{
+				o.m_node = nh;
 				TO::init_child_index (nh, o.m_index);
 				TO::init_child_index(nh, o.m_next_index);  // we will now increment this
-				TO::increment_index(nh, o.m_next_index);  // guaranteed to work at least once
-				// Capture the sequence number of the node
-				o.m_seq = TO::get_seq(nh);
-				o.m_node = nh;
+				advance_index(o);  // guaranteed to work at least once
+				if (Check::sm_sequence && !TO::sm_concurrent) {
+					// Capture the sequence number of the node, for fail_fast
+					o.m_seq = TO::get_seq(nh);
+				}
+			}
+
+			// Move m_next_index on to the next child.  In a concurrent tree the children are
+			// read under the node's seqlock, and m_seq records the sequence they were read at.
+			void advance_index(node_state_t& o)
+			{
+				if (!TO::sm_concurrent) {
+					TO::increment_index(o.m_node, o.m_next_index);
+					return;
+				}
+
+				node_index_t from;
+				TO::copy_index(from, o.m_next_index);
+				for (;;) {
+					o.m_seq = TO::read_begin(o.m_node);
+					TO::copy_index(o.m_next_index, from);
+					TO::increment_index(o.m_node, o.m_next_index);
+					if (TO::read_validate(o.m_node, o.m_seq)) {
+						break;
+					}
+					this->on_retry();
+				}
 			}
 
 			std::vector<node_state_t> m_nstack;
 			node_label_t m_arrow;
 			int m_depth;
-			bool m_failfast;
+		};
+
+		/* The same walk as child_order_tr, with the same events, but without a stack.
+			Only the current node and its indices are kept; the way back up is the parent edge,
+			and the index of a child within its parent is asked of the ops (get_child_index).
+			So the traverser takes O(1) memory and never allocates, however deep the tree.
+
+			The price is in looking up: node(h) and location(h) walk h parent edges. */
+		template<typename TO, typename Check = typename TO::check_policy>
+		class parent_order_tr
+		{
+		private:
+			using node_handle_t = typename TO::node_handle;
+			using node_index_t = typename TO::node_index;
+			using node_label_t = typename TO::node_label;
+
+			inline void fail_fast() const
+			{
+				if (Check::sm_sequence && !TO::sm_concurrent && m_depth >= 0)
+				{
+					if (m_seq != TO::get_seq(m_node))
+					{
+						throw foundation::foundation_exception("node changed", "parent_order_tr::fail_fast");
+					}
+				}
+			}
+		public:
+			using tree_ops = TO;
+
+			explicit parent_order_tr(node_handle_t root)
+				:m_node(root),
+				m_seq(),
+				m_arrow(TO::sm_invalid_lbl),  // a trivial traverser has nowhere to go
+				m_depth(-1)
+			{
+				if (root) {
+					m_depth = 0;
+					arrive_from_above();
+				}
+				else {
+					m_depth = -2;  // trivial
+				}
+			}
+
+			int depth() const { fail_fast(); return m_depth; }  // -1 for "tree traversed"
+
+			node_index_t location(int h = 0) const
+			{
+				fail_fast();
+				h = std::min(h, std::max(m_depth, 0));
+				if (h == 0) {
+					return m_index;
+				}
+
+				node_handle_t c = m_node;
+				node_handle_t p = TO::get_node_labeled(c, TO::sm_parent_lbl);
+				for (int i = 1; i < h; i++) {
+					c = p;
+					p = TO::get_node_labeled(c, TO::sm_parent_lbl);
+				}
+				return TO::get_child_index(p, c);
+			}
+
+			node_handle_t node(int h = 0) const
+			{
+				fail_fast();
+				if (m_depth == -1) {
+					return nullptr;
+				}
+
+				node_handle_t n = m_node;
+				for (h = std::min(h, std::max(m_depth, 0)); h > 0; h--) {
+					n = TO::get_node_labeled(n, TO::sm_parent_lbl);
+				}
+				return n;
+			}
+
+			bool is_trivial() const { return m_depth == -2; }
+			node_label_t get_arrow() const
+			{
+				return m_arrow;
+			}
+
+			void refresh_arrow()
+			{ }
+
+			bool next()
+			{
+				fail_fast();
+
+				if (m_arrow == TO::sm_invalid_lbl) {
+					return false;
+				}
+
+				follow_arrow();
+
+				// A lone root starts where the walk ends, so its first step goes off the tree
+				return m_depth >= 0 && !(m_depth == 0 && m_arrow == TO::sm_parent_lbl);
+			}
+		private:
+			void follow_arrow()
+			{
+				if (m_arrow == TO::sm_parent_lbl)
+				{
+					if (m_depth == 0) {  // the root: we are done
+						m_depth = -1;
+						m_arrow = TO::sm_invalid_lbl;
+						return;
+					}
+
+					node_handle_t c = m_node;
+					m_node = TO::get_node_labeled(c, TO::sm_parent_lbl);
+					m_depth--;
+
+					// We are back at the child we left
+					m_index = TO::get_child_index(m_node, c);
+					TO::copy_index(m_next_index, m_index);
+					advance_index();
+					if (Check::sm_sequence && !TO::sm_concurrent) {
+						m_seq = TO::get_seq(m_node);
+					}
+				}
+				else
+				{
+					node_handle_t p = m_node;
+					m_node = TO::get_node_labeled(p, m_arrow);
+					if (Check::sm_strict) {
+						check_parent_edge<TO>(m_node, p, "parent_order_tr::follow_arrow");
+					}
+					m_depth++;
+					arrive_from_above();
+				}
+
+				compute_arrow();
+			}
+
+			void arrive_from_above()
+			{
+				TO::init_child_index(m_node, m_index);
+				TO::init_child_index(m_node, m_next_index);
+				advance_index();
+				if (Check::sm_sequence && !TO::sm_concurrent) {
+					m_seq = TO::get_seq(m_node);
+				}
+				compute_arrow();
+			}
+
+			void compute_arrow()
+			{
+				if (TO::is_index_final(m_node, m_next_index)) {
+					m_arrow = TO::sm_parent_lbl;
+				}
+				else {
+					m_arrow = TO::get_index_label(m_node, m_next_index);
+				}
+			}
+
+			// As in child_order_tr: in a concurrent tree, read the children under the seqlock
+			void advance_index()
+			{
+				if (!TO::sm_concurrent) {
+					TO::increment_index(m_node, m_next_index);
+					return;
+				}
+
+				node_index_t from;
+				TO::copy_index(from, m_next_index);
+				do {
+					m_seq = TO::read_begin(m_node);
+					TO::copy_index(m_next_index, from);
+					TO::increment_index(m_node, m_next_index);
+				} while (!TO::read_validate(m_node, m_seq));
+			}
+
+			node_handle_t m_node;
+			node_index_t m_index;
+			node_index_t m_next_index;
+			typename TO::sequence m_seq;
+			node_label_t m_arrow;
+			int m_depth;
+		};
+
+		/* Level order: the root, then its children, then theirs, each level left to right.
+			The frontier is a ring buffer that grows by doubling and is kept across reset(),
+			so a walk does not allocate per node, and a traverser reused for many walks soon
+			does not allocate at all.
+
+			Each node is an event of its own: next() moves to the next node and is false at the end.
+			depth() is the level of the node; is_level_start() and level_size() mark the levels.
+			With prefetch on, the node a few places ahead in the frontier is asked for while
+			this one is visited, so that a wide level is not walked one cache miss at a time. */
+		template<typename TO, typename Check = typename TO::check_policy>
+		class level_order_tr
+		{
+		private:
+			using node_handle_t = typename TO::node_handle;
+			using node_index_t = typename TO::node_index;
+
+			static const size_t sm_prefetch_distance = 8;
+
+			inline void fail_fast() const
+			{
+				if (Check::sm_sequence && !TO::sm_concurrent && m_depth >= 0)
+				{
+					if (m_seq != TO::get_seq(m_node))
+					{
+						throw foundation::foundation_exception("node changed", "level_order_tr::fail_fast");
+					}
+				}
+			}
+		public:
+			using tree_ops = TO;
+
+			explicit level_order_tr(node_handle_t root, bool prefetch = false)
+				:m_ring(16),
+				m_prefetch(prefetch)
+			{
+				reset(root);
+			}
+
+			// Start again from another root, keeping the frontier's storage
+			void reset(node_handle_t root)
+			{
+				m_head = m_count = 0;
+				m_node = root;
+				if (TO::is_null(root)) {
+					m_depth = -2;  // trivial
+					m_level_size = m_level_left = 0;
+					return;
+				}
+
+				m_depth = 0;
+				m_level_size = m_level_left = 1;
+				arrive();
+			}
+
+			int depth() const { return m_depth; }  // -1 for "tree traversed"
+			node_handle_t node() const { return m_depth >= 0 ? m_node : nullptr; }
+			bool is_trivial() const { return m_depth == -2; }
+
+			// The first node of its level, and how many nodes the level has
+			bool is_level_start() const { return m_depth >= 0 && m_level_left == m_level_size; }
+			size_t level_size() const { return m_level_size; }
+
+			bool next()
+			{
+				if (m_depth < 0) {
+					return false;
+				}
+
+				fail_fast();  // the children we are about to queue must be the ones we came for
+				push_children(m_node);
+
+				if (--m_level_left == 0)
+				{
+					// All of this level is visited, so the frontier holds exactly the next one
+					if (m_count == 0) {
+						m_depth = -1;
+						return false;
+					}
+					m_depth++;
+					m_level_size = m_level_left = m_count;
+				}
+
+				m_node = pop();
+				arrive();
+				return true;
+			}
+		private:
+			void arrive()
+			{
+				if (m_prefetch && m_count > sm_prefetch_distance) {
+					TO::prefetch_node(m_ring[(m_head + sm_prefetch_distance) & (m_ring.size() - 1)]);
+				}
+				if (Check::sm_sequence && !TO::sm_concurrent) {
+					m_seq = TO::get_seq(m_node);
+				}
+			}
+
+			void push_children(node_handle_t n)
+			{
+				size_t count = m_count;
+				typename TO::sequence s;
+				do {
+					m_count = count;  // a writer got in: forget what we queued and read the node again
+					s = TO::read_begin(n);
+
+					node_index_t idx;
+					TO::init_child_index(n, idx);
+					TO::increment_index(n, idx);
+					while (!TO::is_index_final(n, idx)) {
+						node_handle_t c = TO::get_node_at_index(n, idx);
+						if (Check::sm_strict) {
+							check_parent_edge<TO>(c, n, "level_order_tr::push_children");
+						}
+						push(c);
+						TO::increment_index(n, idx);
+					}
+				} while (!TO::read_validate(n, s));
+			}
+
+			inline void push(node_handle_t h)
+			{
+				if (m_count == m_ring.size()) {
+					grow();
+				}
+				m_ring[(m_head + m_count) & (m_ring.size() - 1)] = h;
+				m_count++;
+			}
+
+			inline node_handle_t pop()
+			{
+				node_handle_t h = m_ring[m_head];
+				m_head = (m_head + 1) & (m_ring.size() - 1);
+				m_count--;
+				return h;
+			}
+
+			// Double the ring, unwrapping it so that the head is at 0
+			void grow()
+			{
+				std::vector<node_handle_t> bigger(m_ring.size() * 2);
+				for (size_t i = 0; i < m_count; i++) {
+					bigger[i] = m_ring[(m_head + i) & (m_ring.size() - 1)];
+				}
+				m_ring.swap(bigger);
+				m_head = 0;
+			}
+
+			std::vector<node_handle_t> m_ring;  // the size is a power of 2
+			size_t m_head;
+			size_t m_count;
+			node_handle_t m_node;
+			typename TO::sequence m_seq;
+			int m_depth;
+			size_t m_level_size;
+			size_t m_level_left;
+			bool m_prefetch;
 		};
 
 	}
@@ -0,0 +1,525 @@
+#ifndef _IA_TRAVERSAL_RANGE_H_
+#define _IA_TRAVERSAL_RANGE_H_
+
+#include <cstddef>
+#include <iterator>
+#include "FError.h"
+#include "Traversal.h"
+
+namespace dstruct
+{
+	namespace ttraversal
+	{
+		/* Iterators and ranges over the traversals, for range-for and <algorithm>:
+
+				for (auto n : preorder_range<TO>(root)) { ... }
+				auto it = std::find_if(inorder_range<TO>(root).begin(), ...);
+
+			An iterator yields node handles by value; a handle is a pointer or an index, so there is
+			no operator ->.  The order iterators are bidirectional and keep only the current node; they step through
+			the parent edges, as parent_order_tr does, so they never allocate.  A step looks at a
+			handful of edges and nothing else.
+			The fail-fast check of the traversers (check_sequence and up) is made once per step, on
+			the node being left, instead of on every accessor call.  In a concurrent tree each node's edges are read
+			under its seqlock instead.
+
+			The iterators walk the subtree under the root they were given, even if that root has
+			a parent.  The in-order iterator needs a binary tree (sm_left_lbl/sm_right_lbl). */
+
+		// Reading the edges of one node, consistently
+		template<typename TO>
+		struct tree_nav
+		{
+			using node_handle_t = typename TO::node_handle;
+			using node_index_t = typename TO::node_index;
+			using node_label_t = typename TO::node_label;
+
+			// Run f() until it has read n without a writer in between
+			template<typename F>
+			static inline node_handle_t read_stable(node_handle_t n, F f)
+			{
+				if (!TO::sm_concurrent) {
+					return f();
+				}
+
+				node_handle_t r;
+				typename TO::sequence s;
+				do {
+					s = TO::read_begin(n);
+					r = f();
+				} while (!TO::read_validate(n, s));
+				return r;
+			}
+
+			static inline node_handle_t edge(node_handle_t n, node_label_t lbl)
+			{
+				return read_stable(n, [&]() { return TO::get_node_labeled(n, lbl); });
+			}
+
+			static inline node_handle_t parent(node_handle_t n) { return edge(n, TO::sm_parent_lbl); }
+
+			static inline node_handle_t first_child(node_handle_t n)
+			{
+				return read_stable(n, [&]() -> node_handle_t {
+					node_index_t idx;
+					TO::init_child_index(n, idx);
+					TO::increment_index(n, idx);
+					return TO::is_index_final(n, idx) ? node_handle_t(nullptr) : TO::get_node_at_index(n, idx);
+				});
+			}
+
+			static inline node_handle_t last_child(node_handle_t n)
+			{
+				return read_stable(n, [&]() -> node_handle_t {
+					node_index_t idx;
+					TO::init_child_index(n, idx);
+					TO::increment_index(n, idx);
+					if (TO::is_index_final(n, idx)) {
+						return nullptr;
+					}
+					while (!TO::is_index_final(n, idx)) {  // to the end, and one back
+						TO::increment_index(n, idx);
+					}
+					TO::decrement_index(n, idx);
+					return TO::get_node_at_index(n, idx);
+				});
+			}
+
+			// The child of p after (before) c, or null
+			static inline node_handle_t next_sibling(node_handle_t p, node_handle_t c)
+			{
+				return read_stable(p, [&]() -> node_handle_t {
+					node_index_t idx = TO::get_child_index(p, c);
+					TO::increment_index(p, idx);
+					return TO::is_index_final(p, idx) ? node_handle_t(nullptr) : TO::get_node_at_index(p, idx);
+				});
+			}
+
+			static inline node_handle_t prev_sibling(node_handle_t p, node_handle_t c)
+			{
+				return read_stable(p, [&]() -> node_handle_t {
+					node_index_t idx = TO::get_child_index(p, c);
+					TO::decrement_index(p, idx);
+					return TO::is_index_pre(p, idx) ? node_handle_t(nullptr) : TO::get_node_at_index(p, idx);
+				});
+			}
+
+			static inline node_handle_t deepest_first(node_handle_t n)
+			{
+				for (node_handle_t c = first_child(n); !TO::is_null(c); c = first_child(n)) {
+					n = c;
+				}
+				return n;
+			}
+
+			static inline node_handle_t deepest_last(node_handle_t n)
+			{
+				for (node_handle_t c = last_child(n); !TO::is_null(c); c = last_child(n)) {
+					n = c;
+				}
+				return n;
+			}
+		};
+
+		/* The orders.  Each knows its first and last node under a root, and how to step either way.
+			next() past the last node and prev() before the first return null. */
+
+		template<typename TO>
+		struct pre_order
+		{
+			using nav = tree_nav<TO>;
+			using node_handle_t = typename TO::node_handle;
+
+			static node_handle_t first(node_handle_t root) { return root; }
+			static node_handle_t last(node_handle_t root) { return nav::deepest_last(root); }
+
+			static node_handle_t next(node_handle_t root, node_handle_t n)
+			{
+				node_handle_t c = nav::first_child(n);
+				if (!TO::is_null(c)) {
+					return c;
+				}
+				while (n != root) {
+					node_handle_t p = nav::parent(n);
+					if (TO::is_null(p)) {
+						return nullptr;  // taken out of the tree by a writer
+					}
+					node_handle_t s = nav::next_sibling(p, n);
+					if (!TO::is_null(s)) {
+						return s;
+					}
+					n = p;
+				}
+				return nullptr;
+			}
+
+			static node_handle_t prev(node_handle_t root, node_handle_t n)
+			{
+				if (n == root) {
+					return nullptr;
+				}
+				node_handle_t p = nav::parent(n);
+				if (TO::is_null(p)) {
+					return nullptr;
+				}
+				node_handle_t s = nav::prev_sibling(p, n);
+				return TO::is_null(s) ? p : nav::deepest_last(s);
+			}
+		};
+
+		template<typename TO>
+		struct post_order
+		{
+			using nav = tree_nav<TO>;
+			using node_handle_t = typename TO::node_handle;
+
+			static node_handle_t first(node_handle_t root) { return nav::deepest_first(root); }
+			static node_handle_t last(node_handle_t root) { return root; }
+
+			static node_handle_t next(node_handle_t root, node_handle_t n)
+			{
+				if (n == root) {
+					return nullptr;
+				}
+				node_handle_t p = nav::parent(n);
+				if (TO::is_null(p)) {
+					return nullptr;
+				}
+				node_handle_t s = nav::next_sibling(p, n);
+				return TO::is_null(s) ? p : nav::deepest_first(s);
+			}
+
+			static node_handle_t prev(node_handle_t root, node_handle_t n)
+			{
+				node_handle_t c = nav::last_child(n);
+				if (!TO::is_null(c)) {
+					return c;
+				}
+				while (n != root) {
+					node_handle_t p = nav::parent(n);
+					if (TO::is_null(p)) {
+						return nullptr;  // taken out of the tree by a writer
+					}
+					node_handle_t s = nav::prev_sibling(p, n);
+					if (!TO::is_null(s)) {
+						return s;
+					}
+					n = p;
+				}
+				return nullptr;
+			}
+		};
+
+		// Binary trees only: left subtree, node, right subtree
+		template<typename TO>
+		struct in_order
+		{
+			using nav = tree_nav<TO>;
+			using node_handle_t = typename TO::node_handle;
+
+			static node_handle_t extreme(node_handle_t n, typename TO::node_label lbl)
+			{
+				for (node_handle_t c = nav::edge(n, lbl); !TO::is_null(c); c = nav::edge(n, lbl)) {
+					n = c;
+				}
+				return n;
+			}
+
+			static node_handle_t first(node_handle_t root) { return extreme(root, TO::sm_left_lbl); }
+			static node_handle_t last(node_handle_t root) { return extreme(root, TO::sm_right_lbl); }
+
+			static node_handle_t next(node_handle_t root, node_handle_t n) { return step(root, n, TO::sm_right_lbl, TO::sm_left_lbl); }
+			static node_handle_t prev(node_handle_t root, node_handle_t n) { return step(root, n, TO::sm_left_lbl, TO::sm_right_lbl); }
+		private:
+			// Forwards: into the right subtree if there is one, else up until we come from the left
+			static node_handle_t step(node_handle_t root, node_handle_t n,
+				typename TO::node_label ahead, typename TO::node_label behind)
+			{
+				node_handle_t c = nav::edge(n, ahead);
+				if (!TO::is_null(c)) {
+					return extreme(c, behind);
+				}
+				while (n != root) {
+					node_handle_t p = nav::parent(n);
+					if (TO::is_null(p)) {
+						return nullptr;  // taken out of the tree by a writer
+					}
+					if (nav::edge(p, behind) == n) {
+						return p;
+					}
+					n = p;
+				}
+				return nullptr;
+			}
+		};
+
+		template<typename TO, typename Order, typename Check = typename TO::check_policy>
+		class order_iterator
+		{
+		public:
+			using iterator_category = std::bidirectional_iterator_tag;
+			using value_type = typename TO::node_handle;
+			using difference_type = std::ptrdiff_t;
+			using pointer = void;
+			using reference = value_type;  // a handle, by value: std::reverse_iterator dereferences a copy
+
+			order_iterator()
+				:m_root(nullptr),
+				m_node(nullptr),
+				m_seq()
+			{ }
+
+			order_iterator(value_type root, value_type n)
+				:m_root(root),
+				m_node(n),
+				m_seq()
+			{
+				capture();
+			}
+
+			reference operator * () const { return m_node; }
+
+			order_iterator& operator ++ ()
+			{
+				check();
+				m_node = Order::next(m_root, m_node);
+				capture();
+				return *this;
+			}
+
+			order_iterator operator ++ (int)
+			{
+				order_iterator was(*this);
+				++*this;
+				return was;
+			}
+
+			// From end(), back to the last node
+			order_iterator& operator -- ()
+			{
+				if (TO::is_null(m_node)) {
+					m_node = TO::is_null(m_root) ? m_root : Order::last(m_root);
+				}
+				else {
+					check();
+					m_node = Order::prev(m_root, m_node);
+				}
+				capture();
+				return *this;
+			}
+
+			order_iterator operator -- (int)
+			{
+				order_iterator was(*this);
+				--*this;
+				return was;
+			}
+
+			friend bool operator == (const order_iterator& a, const order_iterator& b) { return a.m_node == b.m_node; }
+			friend bool operator != (const order_iterator& a, const order_iterator& b) { return a.m_node != b.m_node; }
+		private:
+			// The node we are about to leave must not have changed since we got to it
+			inline void check() const
+			{
+				if (Check::sm_sequence && !TO::sm_concurrent && !TO::is_null(m_node) && m_seq != TO::get_seq(m_node))
+				{
+					throw foundation::foundation_exception("node changed", "order_iterator");
+				}
+			}
+
+			inline void capture()
+			{
+				if (Check::sm_sequence && !TO::sm_concurrent && !TO::is_null(m_node)) {
+					m_seq = TO::get_seq(m_node);
+				}
+			}
+
+			value_type m_root;
+			value_type m_node;
+			typename TO::sequence m_seq;
+		};
+
+		template<typename TO, typename Order, typename Check = typename TO::check_policy>
+		class order_range
+		{
+		public:
+			using iterator = order_iterator<TO, Order, Check>;
+			using const_iterator = iterator;
+
+			explicit order_range(typename TO::node_handle root)
+				:m_root(root)
+			{ }
+
+			iterator begin() const { return iterator(m_root, TO::is_null(m_root) ? m_root : Order::first(m_root)); }
+			iterator end() const { return iterator(m_root, nullptr); }
+			bool empty() const { return TO::is_null(m_root); }
+		private:
+			typename TO::node_handle m_root;
+		};
+
+		template<typename TO, typename Check = typename TO::check_policy>
+		using preorder_range = order_range<TO, pre_order<TO>, Check>;
+
+		template<typename TO, typename Check = typename TO::check_policy>
+		using inorder_range = order_range<TO, in_order<TO>, Check>;
+
+		template<typename TO, typename Check = typename TO::check_policy>
+		using postorder_range = order_range<TO, post_order<TO>, Check>;
+
+		/* The nodes a linear_tr visits, root first: the path of a search.
+			The range owns the traverser and a search is made once, so its iterators are single-pass. */
+		template<class DirPred, class TO>
+		class search_range
+		{
+		private:
+			using trav_t = linear_tr<DirPred, TO>;
+		public:
+			class iterator
+			{
+			public:
+				using iterator_category = std::input_iterator_tag;
+				using value_type = typename TO::node_handle;
+				using difference_type = std::ptrdiff_t;
+				using pointer = void;
+				using reference = value_type;
+
+				iterator()
+					:m_trav(nullptr),
+					m_node(nullptr)
+				{ }
+
+				explicit iterator(trav_t* trav)
+					:m_trav(trav),
+					m_node(trav->node())
+				{
+					if (TO::is_null(m_node)) {
+						m_trav = nullptr;
+					}
+				}
+
+				reference operator * () const { return m_node; }
+
+				// next() is false on arriving at the last node, so watch the depth instead
+				iterator& operator ++ ()
+				{
+					int depth = m_trav->depth();
+					m_trav->next();
+					if (m_trav->depth() != depth) {
+						m_node = m_trav->node();
+					}
+					else {
+						m_trav = nullptr;
+						m_node = nullptr;
+					}
+					return *this;
+				}
+
+				void operator ++ (int) { ++*this; }
+
+				friend bool operator == (const iterator& a, const iterator& b) { return a.m_trav == b.m_trav && a.m_node == b.m_node; }
+				friend bool operator != (const iterator& a, const iterator& b) { return !(a == b); }
+			private:
+				trav_t* m_trav;
+				value_type m_node;
+			};
+
+			search_range(typename TO::node_handle root, DirPred& pred)
+				:m_trav(root, pred)
+			{ }
+
+			search_range(const search_range&) = delete;
+			search_range& operator = (const search_range&) = delete;
+
+			iterator begin() { return iterator(&m_trav); }
+			iterator end() { return iterator(); }
+
+			// Where the search stopped, once the range has been run through
+			typename TO::node_handle last() const { return m_trav.node(); }
+		private:
+			trav_t m_trav;
+		};
+
+		/* Ordered scans of a BST, by key.  The first node of a scan is found by one descent from
+			the root, and from there the scan steps in order through the parent edges, so a scan of
+			k keys looks at O(log n + k) nodes however big the tree is. */
+
+		// The first node whose key is not less than key, or null if there is none
+		template<typename TO>
+		typename TO::node_handle lower_bound_node(typename TO::node_handle root, typename TO::key_type key)
+		{
+			using node_handle_t = typename TO::node_handle;
+			using node_label_t = typename TO::node_label;
+
+			node_handle_t best = nullptr;
+			auto condition = [&](node_handle_t bn, int) -> node_label_t
+			{
+				if (TO::get_key(bn) < key) {
+					return TO::sm_right_lbl;
+				}
+				best = bn;  // a candidate; anything better is to its left
+				return TO::sm_left_lbl;
+			};
+
+			linear_tr<decltype(condition), TO> trav(root, condition);
+			while (trav.next());
+			return best;
+		}
+
+		// The nodes with keys in [lo, hi), in order
+		template<typename TO, typename Check = typename TO::check_policy>
+		class key_range
+		{
+		public:
+			using iterator = order_iterator<TO, in_order<TO>, Check>;
+			using const_iterator = iterator;
+
+			key_range(typename TO::node_handle root, typename TO::key_type lo, typename TO::key_type hi)
+				:m_root(root),
+				m_first(lower_bound_node<TO>(root, lo)),
+				m_stop(hi > lo ? lower_bound_node<TO>(root, hi) : m_first)
+			{ }
+
+			iterator begin() const { return iterator(m_root, m_first); }
+			iterator end() const { return iterator(m_root, m_stop); }
+			bool empty() const { return m_first == m_stop; }
+		private:
+			typename TO::node_handle m_root;
+			typename TO::node_handle m_first;
+			typename TO::node_handle m_stop;  // the first node past hi, or null
+		};
+
+		/* A key_range taken a chunk at a time: each call copies the next keys into the caller's
+			buffer, ready for code that wants them in an array.  The scan fails fast, as the
+			iterators do, if the node it stopped at is changed between two chunks. */
+		template<typename TO, typename Check = typename TO::check_policy>
+		class key_scan
+		{
+		public:
+			using key_type = typename TO::key_type;
+
+			key_scan(typename TO::node_handle root, key_type lo, key_type hi)
+				:m_range(root, lo, hi),
+				m_at(m_range.begin()),
+				m_end(m_range.end())
+			{ }
+
+			// Up to cap keys, in order; 0 once the range is done
+			size_t next_chunk(key_type* buf, size_t cap)
+			{
+				size_t n = 0;
+				for (; n < cap && m_at != m_end; ++m_at) {
+					buf[n++] = TO::get_key(*m_at);
+				}
+				return n;
+			}
+
+			bool done() const { return m_at == m_end; }
+		private:
+			key_range<TO, Check> m_range;
+			typename key_range<TO, Check>::iterator m_at;
+			typename key_range<TO, Check>::iterator m_end;
+		};
+	}
+}
+
+#endif
@@ -25,8 +25,8 @@ namespace dstruct
 		}
 
 		template<class TO>
-		void swap_node(typename TO::node_handle_t to, typename TO::node_handle_t from,
-			typename TO::node_label_t label)
+		void swap_node(typename TO::node_handle to, typename TO::node_handle from,
+			typename TO::node_label label)
 		{
 			// Move the child of a node, preserving the order
 #ifdef _STRICT_CHECKS
@@ -36,9 +36,39 @@ namespace dstruct
 			}
 #endif
 			// Detach and reattach
-			node_handle_t nf = TO::detach_node(from, label);
+			typename TO::node_handle nf = TO::detach_node(from, label);
 			TO::attach_node(to, label, nf);
 		}
+
+		// Give every node of a tree back to its allocation policy.
+		// Leaves are detached and recycled one by one, so no stack is needed.
+		template<class TO>
+		void destroy_tree(typename TO::node_handle root)
+		{
+			using node_handle = typename TO::node_handle;
+			using node_index = typename TO::node_index;
+
+			node_handle n = root;
+			while (!TO::is_null(n))
+			{
+				node_index idx;
+				TO::init_child_index(n, idx);
+				TO::increment_index(n, idx);
+
+				if (!TO::is_index_final(n, idx)) {
+					n = TO::get_node_at_index(n, idx);  // keep going down
+					continue;
+				}
+
+				// n is a leaf now
+				node_handle p = n != root ? TO::get_node_labeled(n, TO::sm_parent_lbl) : nullptr;
+				if (!TO::is_null(p)) {
+					TO::detach_node(n, TO::sm_parent_lbl);
+				}
+				TO::recycle_node(n);
+				n = p;
+			}
+		}
 	}
 }
 
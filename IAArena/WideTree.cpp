@@ -0,0 +1,7 @@
+
+#include <iostream>
+#include "WideTree.h"
+
+template struct dstruct::wide_tree::ops<long>;
+template struct dstruct::wide_tree::ops<int>;
+template struct dstruct::wide_tree::ops<long, foundation::ap_arena>;
@@ -0,0 +1,544 @@
+#ifndef _IA_WIDE_TREE_H_
+#define _IA_WIDE_TREE_H_
+
+#include <cstddef>
+#include <ostream>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include "FError.h"
+#include "TraversalIface.h"
+#include "ThreadPolicy.h"
+#include "CheckPolicy.h"
+#include "NodeAllocator.h"
+#include "Prefetch.h"
+#include "Traversal.h"
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+namespace dstruct
+{
+	/* A B-tree: each node holds up to sm_capacity sorted keys and, unless it is a leaf, one
+		more child than keys.  The keys fill the node's first cache line, so finding where a key
+		goes in a node is one line read and, with AVX2 or SSE, a couple of compares and a popcount
+		rather than a chain of branches.  A tree of n keys is about log(n) / log(capacity) deep,
+		a fifth of a binary tree's height for 64-bit keys.
+
+		Child i holds the keys between key i-1 and key i.  The ops walk children like any other
+		tree, so child_order_tr, linear_tr and the ranges of TraversalRange.h work unchanged
+		(in_order does not: it is for binary trees).  insert() and find() are built on linear_tr.
+
+		Splits touch several nodes with no single write to publish them, so these trees are
+		single-threaded. */
+
+	namespace wide_tree
+	{
+		template<typename Key = long>
+		struct alignas(64) node
+		{
+			static_assert(std::is_arithmetic<Key>::value, "wide_tree -- keys are padded with the largest Key");
+
+			static const int sm_slots = 64 / sizeof(Key) >= 4 ? (int)(64 / sizeof(Key)) : 4;  // the first cache line
+			static const int sm_capacity = sm_slots - 1;  // the spare slot holds the key that makes a node split
+
+			using sequence_t = unsigned long;
+			Key m_keys[sm_slots];  // sorted; the unused ones are the largest Key, so they are never less than a key searched for
+			node* m_children[sm_slots + 1];  // all null in a leaf
+			node* m_parent;
+			sequence_t m_sequence;
+			int m_count;  // keys in use
+
+			node()
+				:m_parent(nullptr),
+				m_sequence(0),
+				m_count(0)
+			{
+				for (int i = 0; i < sm_slots; ++i) {
+					m_keys[i] = std::numeric_limits<Key>::max();
+				}
+				for (int i = 0; i <= sm_slots; ++i) {
+					m_children[i] = nullptr;
+				}
+			}
+		};
+
+		inline int popcount(unsigned m)
+		{
+#if defined(_MSC_VER)
+			return (int)__popcnt(m);
+#elif defined(__GNUC__)
+			return __builtin_popcount(m);
+#else
+			int c = 0;
+			for (; m; m &= m - 1) {
+				++c;
+			}
+			return c;
+#endif
+		}
+
+		/* How many of a node's keys are less than x.  The keys are sorted and padded, so that is
+			also where x goes, and it is the same as counting over every slot.  Signed 64- and
+			32-bit keys are compared a register at a time; anything else a slot at a time. */
+		template<typename Key, int Width = (std::is_integral<Key>::value && std::is_signed<Key>::value) ? (int)sizeof(Key) : 0>
+		struct key_search
+		{
+			static inline int count_less(const Key* keys, Key x)
+			{
+				int c = 0;
+				for (int i = 0; i < node<Key>::sm_slots; ++i) {
+					c += keys[i] < x;
+				}
+				return c;
+			}
+		};
+
+		template<typename Key>
+		struct key_search<Key, 8>
+		{
+			static_assert(node<Key>::sm_slots == 8, "wide_tree -- eight 64-bit keys to a line");
+
+			static inline int count_less(const Key* keys, Key x)
+			{
+#if defined(__AVX2__)
+				const __m256i v = _mm256_set1_epi64x((long long)x);
+				__m256i lo = _mm256_cmpgt_epi64(v, _mm256_load_si256((const __m256i*)keys));
+				__m256i hi = _mm256_cmpgt_epi64(v, _mm256_load_si256((const __m256i*)(keys + 4)));
+				unsigned m = (unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(lo))
+					| ((unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(hi)) << 4);
+				return popcount(m);
+#elif defined(__SSE4_2__)
+				const __m128i v = _mm_set1_epi64x((long long)x);
+				unsigned m = 0;
+				for (int i = 0; i < 4; ++i) {
+					__m128i lt = _mm_cmpgt_epi64(v, _mm_load_si128((const __m128i*)(keys + 2 * i)));
+					m |= (unsigned)_mm_movemask_pd(_mm_castsi128_pd(lt)) << (2 * i);
+				}
+				return popcount(m);
+#else
+				return key_search<Key, 0>::count_less(keys, x);
+#endif
+			}
+		};
+
+		template<typename Key>
+		struct key_search<Key, 4>
+		{
+			static_assert(node<Key>::sm_slots == 16, "wide_tree -- sixteen 32-bit keys to a line");
+
+			static inline int count_less(const Key* keys, Key x)
+			{
+#if defined(__AVX2__)
+				const __m256i v = _mm256_set1_epi32((int)x);
+				__m256i lo = _mm256_cmpgt_epi32(v, _mm256_load_si256((const __m256i*)keys));
+				__m256i hi = _mm256_cmpgt_epi32(v, _mm256_load_si256((const __m256i*)(keys + 8)));
+				unsigned m = (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(lo))
+					| ((unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(hi)) << 8);
+				return popcount(m);
+#elif defined(__SSE2__) || defined(_M_X64)
+				const __m128i v = _mm_set1_epi32((int)x);
+				unsigned m = 0;
+				for (int i = 0; i < 4; ++i) {
+					__m128i lt = _mm_cmpgt_epi32(v, _mm_load_si128((const __m128i*)(keys + 4 * i)));
+					m |= (unsigned)_mm_movemask_ps(_mm_castsi128_ps(lt)) << (4 * i);
+				}
+				return popcount(m);
+#else
+				return key_search<Key, 0>::count_less(keys, x);
+#endif
+			}
+		};
+
+		/* Indices: CHILD_PRE, then the children 0..m_count (none in a leaf), then CHILD_FINAL.
+			Labels: a child's slot, or LABEL_PARENT. */
+		static const int CHILD_PRE = -1;
+		static const int LABEL_INVALID = -2;
+
+		template<typename Key = long,
+			typename AllocPolicy = foundation::ap_heap,
+			typename Check = foundation::check_default>
+		struct ops
+		{
+			using mnode = node<Key>;
+			using alloc_policy = AllocPolicy;
+			using check_policy = Check;
+			using node_handle = mnode*;
+			using node_index = int;
+			using node_label = int;
+			using key_type = Key;
+			using sequence = typename mnode::sequence_t;
+			using thread_policy = foundation::tp_single_thread;
+
+			static const bool sm_concurrent = false;
+
+			static const int sm_capacity = mnode::sm_capacity;
+			static const int sm_final_index = mnode::sm_slots + 1;  // past any child
+			static const int sm_parent_lbl = mnode::sm_slots + 1;
+			static const int sm_invalid_lbl = LABEL_INVALID;
+
+			static inline void check_label(mnode* n, int lbl, const char* context)
+			{
+				if (lbl != sm_parent_lbl && (lbl < 0 || lbl > n->m_count))
+				{
+					std::string exc_c("wide_tree_ops::");
+					exc_c.append(context);
+					throw foundation::foundation_exception("label not valid", exc_c.c_str());
+				}
+			}
+
+			static inline bool is_null(mnode* n) { return n == nullptr; }
+			static inline bool is_index_pre(mnode*, int idx) { return idx == CHILD_PRE; }
+			static inline sequence get_seq(mnode* n) { return n->m_sequence; }
+
+			static inline sequence read_begin(mnode* n) { return thread_policy::read_begin(n->m_sequence); }
+			static inline bool read_validate(mnode* n, sequence s) { return thread_policy::read_validate(n->m_sequence, s); }
+
+			static inline int key_count(mnode* n) { return n->m_count; }
+			static inline Key get_key(mnode* n, int i) { return n->m_keys[i]; }
+
+			// Where key goes among n's keys: the number of them less than key
+			static inline int lower_slot(mnode* n, Key key)
+			{
+				return key_search<Key>::count_less(n->m_keys, key);
+			}
+
+			// In a B-tree a node has all its children or none
+			static inline bool is_leaf(mnode* n) { return n->m_children[0] == nullptr; }
+
+			/* The index functions skip empty child slots, as the binary ops do, so that a tree
+				being taken apart (destroy_tree detaches children one by one) is still walked right. */
+			static inline int first_child_slot(mnode* n)
+			{
+				int i = 0;
+				while (i <= n->m_count && n->m_children[i] == nullptr) {
+					++i;
+				}
+				return i <= n->m_count ? i : CHILD_PRE;
+			}
+
+			static inline int last_child_slot(mnode* n)
+			{
+				int i = n->m_count;
+				while (i >= 0 && n->m_children[i] == nullptr) {
+					--i;
+				}
+				return i;  // CHILD_PRE if there is none
+			}
+
+			static inline bool is_index_first(mnode* n, int idx) { return idx >= 0 && idx == first_child_slot(n); }
+			static inline bool is_index_post(mnode* n, int idx) { return idx == last_child_slot(n); }
+
+			static inline bool is_index_final(mnode*, int idx) { return idx == sm_final_index; }
+
+			// Every leaf is at the same depth
+			static inline int tree_depth(mnode* n)
+			{
+				int d = 0;
+				for (; n; n = n->m_children[0]) {
+					++d;
+				}
+				return d;
+			}
+
+			static inline void init_child_index(mnode*, int& idx) { idx = CHILD_PRE; }
+
+			static inline void increment_index(mnode* n, int& idx)
+			{
+				if (Check::sm_strict) {
+					if (idx >= sm_final_index) {
+						throw foundation::foundation_exception("wide tree ops increment index-- index too large.");
+					}
+				}
+				do {
+					++idx;
+				} while (idx <= n->m_count && n->m_children[idx] == nullptr);
+
+				if (idx > n->m_count) {
+					idx = sm_final_index;
+				}
+			}
+
+			// The way back: the previous child there is, or CHILD_PRE.  From the final index, the last child.
+			static inline void decrement_index(mnode* n, int& idx)
+			{
+				if (Check::sm_strict) {
+					if (idx <= CHILD_PRE) {
+						throw foundation::foundation_exception("wide tree ops decrement index-- index too small.");
+					}
+				}
+				if (idx == sm_final_index) {
+					idx = n->m_count + 1;
+				}
+				do {
+					--idx;
+				} while (idx >= 0 && n->m_children[idx] == nullptr);
+
+				if (idx < 0) {
+					idx = CHILD_PRE;
+				}
+			}
+
+			static inline EExists peek_node_labeled(mnode* n, int lbl)
+			{
+				return get_node_labeled(n, lbl) != nullptr ? EXISTS : UNEXISTS;
+			}
+
+			static inline mnode* get_node_labeled(mnode* n, int lbl)
+			{
+				if (Check::sm_strict) {
+					check_label(n, lbl, "get_node_labeled");
+				}
+				return lbl == sm_parent_lbl ? n->m_parent : n->m_children[lbl];
+			}
+
+			static inline mnode* get_node_at_index(mnode* n, int idx)
+			{
+				if (Check::sm_strict) {
+					if (idx < 0 || idx > n->m_count) {
+						throw foundation::foundation_exception("index invalid.", "wide_tree_ops::get_node_at_index");
+					}
+				}
+				return n->m_children[idx];
+			}
+
+			static inline mnode* create_free_node()
+			{
+				return AllocPolicy::template create<mnode>();
+			}
+
+			static inline void recycle_node(mnode* n)
+			{
+				AllocPolicy::template recycle<mnode>(n);
+			}
+
+			static inline void reserve_nodes(size_t n)
+			{
+				AllocPolicy::template reserve<mnode>(n);
+			}
+
+			// Cut the edge between a node and one of its children.  The slot is left empty, so the
+			// parent is not a valid B-tree node until something is attached there again.
+			static inline mnode* detach_node(mnode* n, int lbl)
+			{
+				if (Check::sm_strict) {
+					check_label(n, lbl, "detach_node");
+				}
+				mnode* p = lbl == sm_parent_lbl ? n->m_parent : n;
+				mnode* c = lbl == sm_parent_lbl ? n : n->m_children[lbl];
+				if (Check::sm_strict) {
+					if (p == nullptr || c == nullptr) {
+						throw foundation::foundation_exception("detaching nonexistent node", "wide_tree_ops::detach_node");
+					}
+				}
+
+				thread_policy::write_begin(p->m_sequence);
+				thread_policy::write_begin(c->m_sequence);
+				p->m_children[get_child_index(p, c)] = nullptr;
+				c->m_parent = nullptr;
+				thread_policy::write_end(c->m_sequence);
+				thread_policy::write_end(p->m_sequence);
+
+				return lbl == sm_parent_lbl ? p : c;
+			}
+
+			// Attach n as child lbl of to (or to as a child of n, with LABEL_PARENT: into n's first empty child slot)
+			static inline void attach_node(mnode* to, int lbl, mnode* n)
+			{
+				if (Check::sm_strict) {
+					if (lbl != sm_parent_lbl) {
+						check_label(to, lbl, "attach_node");
+					}
+				}
+				mnode* p = lbl == sm_parent_lbl ? n : to;
+				mnode* c = lbl == sm_parent_lbl ? to : n;
+				int slot = lbl;
+				if (lbl == sm_parent_lbl) {
+					for (slot = 0; slot < p->m_count && p->m_children[slot]; ++slot);
+				}
+
+				if (Check::sm_strict) {
+					if (c->m_parent) {
+						throw foundation::foundation_exception("attaching an attached node", "wide_tree_ops::attach_node");
+					}
+					if (p->m_children[slot]) {
+						throw foundation::foundation_exception("nowhere to attach node", "wide_tree_ops::attach_node");
+					}
+				}
+
+				thread_policy::write_begin(p->m_sequence);
+				thread_policy::write_begin(c->m_sequence);
+				c->m_parent = p;
+				p->m_children[slot] = c;
+				thread_policy::write_end(c->m_sequence);
+				thread_policy::write_end(p->m_sequence);
+			}
+
+			// Put key in slot pos of n, with right (may be null) as the child after it
+			static inline void insert_at(mnode* n, int pos, Key key, mnode* right)
+			{
+				thread_policy::write_begin(n->m_sequence);
+				for (int i = n->m_count; i > pos; --i) {
+					n->m_keys[i] = n->m_keys[i - 1];
+					n->m_children[i + 1] = n->m_children[i];
+				}
+				n->m_keys[pos] = key;
+				n->m_children[pos + 1] = right;
+				if (right) {
+					right->m_parent = n;
+				}
+				n->m_count++;
+				thread_policy::write_end(n->m_sequence);
+			}
+
+			/* n has one key too many: move the keys above the middle one to a new sibling and the
+				middle one up into the parent (a new root if n was the root).  Returns the parent,
+				which may now be too full in its turn. */
+			static inline mnode* split(mnode* n, mnode*& root)
+			{
+				mnode* right = create_free_node();
+				const int mid = n->m_count / 2;
+				const Key median = n->m_keys[mid];
+
+				thread_policy::write_begin(n->m_sequence);
+				int j = 0;
+				for (int i = mid + 1; i < n->m_count; ++i, ++j) {
+					right->m_keys[j] = n->m_keys[i];
+					right->m_children[j] = n->m_children[i];
+					n->m_keys[i] = std::numeric_limits<Key>::max();
+					n->m_children[i] = nullptr;
+				}
+				right->m_children[j] = n->m_children[n->m_count];
+				n->m_children[n->m_count] = nullptr;
+				right->m_count = j;
+				n->m_keys[mid] = std::numeric_limits<Key>::max();
+				n->m_count = mid;
+				thread_policy::write_end(n->m_sequence);
+
+				for (int i = 0; i <= right->m_count && right->m_children[i]; ++i) {
+					right->m_children[i]->m_parent = right;
+				}
+
+				mnode* p = n->m_parent;
+				if (p == nullptr) {
+					p = create_free_node();
+					p->m_keys[0] = median;
+					p->m_count = 1;
+					p->m_children[0] = n;
+					p->m_children[1] = right;
+					n->m_parent = right->m_parent = p;
+					root = p;
+					return p;
+				}
+
+				insert_at(p, get_child_index(p, n), median, right);
+				return p;
+			}
+
+			static inline void prefetch_node(mnode* n)
+			{
+				foundation::prefetch(n);
+			}
+
+			static inline int get_child_index(mnode* p, mnode* c)
+			{
+				int i = 0;
+				while (i < p->m_count && p->m_children[i] != c) {
+					++i;
+				}
+				return i;
+			}
+
+			static inline int get_index_label(mnode* n, int idx)
+			{
+				return idx >= 0 && idx <= n->m_count ? idx : LABEL_INVALID;
+			}
+
+			static void copy_index(int& to, int& from)
+			{
+				to = from;
+			}
+
+			static void move_index(int& to, int& from)
+			{
+				to = from;
+			}
+
+			static void print_node(std::ostream& os, mnode* n)
+			{
+				os << '[';
+				for (int i = 0; i < n->m_count; ++i) {
+					if (i) {
+						os << ' ';
+					}
+					os << n->m_keys[i];
+				}
+				os << ']';
+			}
+		};
+
+		/* The node holding key, or null, and the key's slot in it.  Each node visited costs one
+			lower_slot: either the key is there, or the slot says which child to go down. */
+		template<typename TO>
+		typename TO::mnode* find(typename TO::mnode* root, typename TO::key_type key, int& slot)
+		{
+			using mnode = typename TO::mnode;
+
+			bool found = false;
+			auto condition = [&](mnode* bn, int) -> int
+			{
+				int r = TO::lower_slot(bn, key);
+				if (r < bn->m_count && !(key < bn->m_keys[r])) {
+					found = true;
+					slot = r;
+					return TO::sm_invalid_lbl;  // here
+				}
+				return TO::is_leaf(bn) ? TO::sm_invalid_lbl : r;
+			};
+
+			ttraversal::linear_tr<decltype(condition), TO> trav(root, condition);
+			while (trav.next());
+			return found ? trav.node() : nullptr;
+		}
+
+		template<typename TO>
+		bool contains(typename TO::mnode* root, typename TO::key_type key)
+		{
+			int slot;
+			return find<TO>(root, key, slot) != nullptr;
+		}
+
+		/* Add key (duplicates are kept): go down to the leaf where it belongs, put it there, and
+			split the nodes that overflow on the way back up.  root changes when the root splits. */
+		template<typename TO>
+		void insert(typename TO::key_type key, typename TO::mnode*& root)
+		{
+			using mnode = typename TO::mnode;
+
+			if (root == nullptr) {
+				root = TO::create_free_node();
+				TO::insert_at(root, 0, key, nullptr);
+				return;
+			}
+
+			int pos = 0;
+			auto condition = [&](mnode* bn, int) -> int
+			{
+				pos = TO::lower_slot(bn, key);
+				return TO::is_leaf(bn) ? TO::sm_invalid_lbl : pos;
+			};
+
+			ttraversal::linear_tr<decltype(condition), TO> trav(root, condition);
+			while (trav.next());
+
+			mnode* n = trav.node();
+			TO::insert_at(n, pos, key, nullptr);
+			while (n->m_count > TO::sm_capacity) {
+				n = TO::split(n, root);
+			}
+		}
+	}
+}
+
+#endif
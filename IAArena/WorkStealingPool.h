@@ -0,0 +1,205 @@
+#ifndef _IA_WORK_STEALING_POOL_H_
+#define _IA_WORK_STEALING_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "NodeAllocator.h"
+
+namespace foundation
+{
+	/* A fork-join pool with work stealing.  run() deals a batch of task indices out to the
+	   workers in contiguous blocks; each worker takes tasks from the back of its own deque and,
+	   when that is empty, steals from the front of the others'.  The calling thread is worker 0
+	   and works too, so a pool of one thread is just a loop. */
+	class ws_pool
+	{
+	public:
+		// 0 threads: one per hardware thread
+		explicit ws_pool(unsigned int threads = 0)
+			:m_generation(0),
+			m_active(0),
+			m_remaining(0),
+			m_shutdown(false)
+		{
+			if (threads == 0) {
+				threads = std::thread::hardware_concurrency();
+			}
+			if (threads == 0) {
+				threads = 1;
+			}
+
+			for (unsigned int w = 0; w < threads; w++) {
+				m_queues.emplace_back(make_queue());
+			}
+
+			for (unsigned int w = 1; w < threads; w++) {
+				m_threads.emplace_back(&ws_pool::worker_main, this, w);
+			}
+		}
+
+		~ws_pool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_lock);
+				m_shutdown = true;
+			}
+			m_wake.notify_all();
+			for (std::thread& t : m_threads) {
+				t.join();
+			}
+		}
+
+		ws_pool(const ws_pool&) = delete;
+		ws_pool& operator = (const ws_pool&) = delete;
+
+		unsigned int size() const { return (unsigned int)m_queues.size(); }
+
+		// Call job(task, worker) for every task in [0, count); returns when all of them are done
+		void run(size_t count, const std::function<void(size_t, unsigned int)>& job)
+		{
+			if (count == 0) {
+				return;
+			}
+
+			m_job = job;
+			m_remaining = count;
+
+			size_t workers = m_queues.size();
+			for (size_t w = 0; w < workers; w++) {
+				worker_queue& q = *m_queues[w];
+				std::lock_guard<std::mutex> lock(q.m_lock);
+				for (size_t t = count * w / workers; t < count * (w + 1) / workers; t++) {
+					q.m_tasks.push_back(t);
+				}
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(m_lock);
+				m_generation++;
+			}
+			m_wake.notify_all();
+
+			drain(0);
+
+			std::unique_lock<std::mutex> lock(m_lock);
+			m_done.wait(lock, [this]() { return m_remaining == 0 && m_active == 0; });
+		}
+	private:
+		struct alignas(64) worker_queue
+		{
+			std::mutex m_lock;
+			std::deque<size_t> m_tasks;
+		};
+
+		// A queue on its own cache lines: plain new would not honour the alignas before C++17
+		struct queue_release
+		{
+			void operator()(worker_queue* q) const
+			{
+				q->~worker_queue();
+				aligned_release(q);
+			}
+		};
+
+		using queue_ptr = std::unique_ptr<worker_queue, queue_release>;
+
+		static queue_ptr make_queue()
+		{
+			void* p = aligned_allocate(sizeof(worker_queue), alignof(worker_queue));
+			try {
+				return queue_ptr(new (p) worker_queue());
+			}
+			catch (...) {
+				aligned_release(p);
+				throw;
+			}
+		}
+
+		bool pop_own(unsigned int w, size_t& task)
+		{
+			worker_queue& q = *m_queues[w];
+			std::lock_guard<std::mutex> lock(q.m_lock);
+			if (q.m_tasks.empty()) {
+				return false;
+			}
+			task = q.m_tasks.back();
+			q.m_tasks.pop_back();
+			return true;
+		}
+
+		bool steal(unsigned int w, size_t& task)
+		{
+			size_t workers = m_queues.size();
+			for (size_t i = 1; i < workers; i++) {
+				worker_queue& q = *m_queues[(w + i) % workers];
+				std::lock_guard<std::mutex> lock(q.m_lock);
+				if (!q.m_tasks.empty()) {
+					task = q.m_tasks.front();
+					q.m_tasks.pop_front();
+					return true;
+				}
+			}
+			return false;
+		}
+
+		void drain(unsigned int w)
+		{
+			size_t task = 0;
+			while (pop_own(w, task) || steal(w, task)) {
+				m_job(task, w);
+				if (--m_remaining == 0) {
+					{
+						std::lock_guard<std::mutex> lock(m_lock);  // so that run() cannot miss this
+					}
+					m_done.notify_all();
+				}
+			}
+		}
+
+		void worker_main(unsigned int w)
+		{
+			size_t seen = 0;
+			while (true)
+			{
+				{
+					std::unique_lock<std::mutex> lock(m_lock);
+					m_wake.wait(lock, [&]() { return m_shutdown || m_generation != seen; });
+					if (m_shutdown) {
+						return;
+					}
+					seen = m_generation;
+					m_active++;
+				}
+
+				drain(w);
+
+				{
+					std::lock_guard<std::mutex> lock(m_lock);
+					m_active--;
+				}
+				m_done.notify_all();
+			}
+		}
+
+		std::vector<queue_ptr> m_queues;
+		std::vector<std::thread> m_threads;
+		std::function<void(size_t, unsigned int)> m_job;
+
+		std::mutex m_lock;
+		std::condition_variable m_wake;
+		std::condition_variable m_done;
+		size_t m_generation;
+		unsigned int m_active;
+		std::atomic<size_t> m_remaining;
+		bool m_shutdown;
+	};
+}
+
+#endif